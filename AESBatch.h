@@ -0,0 +1,340 @@
+// AESBatch.h
+// Batch calls for large numbers of small records under one key
+//
+// - Each record is an AESRecord with its own IV, input, length, and output
+// - Blocks are gathered across record boundaries, so every call into the engine carries up to batchBlocks blocks
+//   from several records at once and the 8 and 16 block engines always have full groups to work on,
+//   however short each record is
+// - CTR and CBC decryption have no chain between blocks, so any mix of records packs together. CBC encryption
+//   is serial within a record and goes through cbcEncryptMulti, which keeps one block of many records in flight
+// - With AES-NI, CTR gathers its counter blocks straight into registers, eight at a time, and skips the keystream buffer
+// - Batches with more than batchTaskRecords records are split across the thread pool
+// - encodeRecords turns a batch's outputs into hex or Base64 text in one buffer, for text based transports
+//
+// A call costs one engine lookup and a few pointer stores per block, instead of a key setup and a dispatch per record
+
+#ifndef AES_BATCH_H
+#define AES_BATCH_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <atomic> //failure count shared between tasks
+
+#include "AESCore.h" //AESKeyContext, AESRecord, and xorBytes
+#include "AESEngine.h" //the active engine
+#include "AESCTR.h" //big endian counter helpers
+#include "AESCBC.h" //PKCS#7 and cbcEncryptMulti
+#include "AESThreadPool.h" //splits large batches across cores
+#include "AESNI.h" //AES_HAVE_AESNI and the target attribute for the fused CTR loop
+#include "AESEncoding.h" //hex and Base64 text for encodeRecords
+
+inline constexpr size_t batchBlocks = 64;//blocks handed to the engine per call, whole groups for the 8 and 16 block engines
+inline constexpr size_t batchTaskRecords = 4096;//records per thread pool task
+inline constexpr size_t invalidRecordLength = SIZE_MAX;//plain length reported for a record that failed to decrypt
+
+inline uint64_t recordBytes(const AESRecord* records, size_t count) {
+    //total input length of a batch, for the metrics
+    uint64_t bytes = 0;
+
+    for(size_t r = 0; r < count; r++) {
+        bytes += records[r].length;
+    }
+
+    return bytes;
+}
+
+template<class Range>
+inline void forRecordTasks(size_t count, AESThreadPool* pool, Range&& range) {
+    //calls range(first, records) over all count records, in tasks of batchTaskRecords spread over pool
+    if(pool == nullptr || pool->size() == 1 || count <= batchTaskRecords) {
+        range(0, count);
+        return;
+    }
+
+    size_t tasks = (count + batchTaskRecords - 1) / batchTaskRecords;
+
+    pool->parallelFor(tasks, [&](size_t task) {
+        size_t first = task * batchTaskRecords;
+        size_t records = count - first < batchTaskRecords ? count - first : batchTaskRecords;
+
+        range(first, records);
+    });
+}
+
+#if AES_HAVE_AESNI
+
+template<int Nr>
+AES_TARGET_AESNI inline void ctrRecordsHardwareRounds(const AESKeyContext& ctx, const AESRecord* records, size_t count) {
+    //ctrRecordsRange with the AES-NI engine: counter blocks from across records are gathered eight at a time straight
+    //into registers, and the keystream is XOR'ed into each record on the way out
+    __m128i rk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        rk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(ctx.roundKey(round)));
+    }
+
+    __m128i b[8];
+    const uint8_t* from[8];
+    uint8_t* to[8];
+    size_t bytes[8];
+
+    auto finish = [&](int j, __m128i keystream) AES_TARGET_AESNI {
+        //whole blocks are XOR'ed in a register, a short last block goes through memory
+        if(bytes[j] == 16) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from[j]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(to[j]), _mm_xor_si128(data, keystream));
+            return;
+        }
+
+        alignas(16) uint8_t block[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), keystream);
+        xorBytes(to[j], from[j], block, bytes[j]);
+    };
+
+    int n = 0;
+
+    for(size_t r = 0; r < count; r++) {
+        const AESRecord& record = records[r];
+
+        uint64_t high = loadBigEndian64(record.iv);
+        uint64_t low = loadBigEndian64(record.iv + 8);
+
+        for(size_t offset = 0; offset < record.length; offset += 16) {
+            b[n] = _mm_xor_si128(counterBlock(high, low), rk[0]);
+
+            low++;
+            high += (low == 0);
+
+            from[n] = record.in + offset;
+            to[n] = record.out + offset;
+            bytes[n] = record.length - offset < 16 ? record.length - offset : 16;
+
+            if(++n < 8) {
+                continue;
+            }
+
+#pragma GCC unroll 16
+            for(int round = 1; round < Nr; round++) {
+#pragma GCC unroll 8
+                for(int j = 0; j < 8; j++) {
+                    b[j] = _mm_aesenc_si128(b[j], rk[round]);
+                }
+            }
+
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                finish(j, _mm_aesenclast_si128(b[j], rk[Nr]));
+            }
+
+            n = 0;
+        }
+    }
+
+    for(int j = 0; j < n; j++) {
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+            b[j] = _mm_aesenc_si128(b[j], rk[round]);
+        }
+
+        finish(j, _mm_aesenclast_si128(b[j], rk[Nr]));
+    }
+}
+
+#endif
+
+inline void ctrRecordsRange(const AESKeyContext& ctx, const AESRecord* records, size_t count) {
+    //CTR over each record on the calling thread, each record's keystream starting from its own IV
+#if AES_HAVE_AESNI
+    if(&activeEngine() == &hardwareEngine) {
+        switch(ctx.rounds) {
+            case 10:
+                ctrRecordsHardwareRounds<10>(ctx, records, count);
+                return;
+            case 12:
+                ctrRecordsHardwareRounds<12>(ctx, records, count);
+                return;
+            case 14:
+                ctrRecordsHardwareRounds<14>(ctx, records, count);
+                return;
+        }
+    }
+#endif
+
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    alignas(16) uint8_t counters[batchBlocks * 16];
+    alignas(16) uint8_t keystream[batchBlocks * 16];
+
+    //where each keystream block in the batch goes, the last block of a record can be short
+    const uint8_t* from[batchBlocks];
+    uint8_t* to[batchBlocks];
+    size_t bytes[batchBlocks];
+
+    size_t n = 0;
+
+    auto flush = [&]() {
+        encrypt(ctx, counters, keystream, n);
+
+        for(size_t j = 0; j < n; j++) {
+            if(bytes[j] == 16) {
+                xorBytes(to[j], from[j], keystream + 16 * j, 16);//the common case, with a constant length the XOR is two words
+            }
+            else {
+                xorBytes(to[j], from[j], keystream + 16 * j, bytes[j]);
+            }
+        }
+
+        n = 0;
+    };
+
+    for(size_t r = 0; r < count; r++) {
+        const AESRecord& record = records[r];
+
+        uint64_t high = loadBigEndian64(record.iv);
+        uint64_t low = loadBigEndian64(record.iv + 8);
+
+        for(size_t offset = 0; offset < record.length; offset += 16) {
+            storeBigEndian64(counters + 16 * n, high);
+            storeBigEndian64(counters + 16 * n + 8, low);
+
+            low++;
+            high += (low == 0);
+
+            from[n] = record.in + offset;
+            to[n] = record.out + offset;
+            bytes[n] = record.length - offset < 16 ? record.length - offset : 16;
+
+            if(++n == batchBlocks) {
+                flush();
+            }
+        }
+    }
+
+    if(n > 0) {
+        flush();
+    }
+}
+
+inline void ctrEncryptRecords(const AESKeyContext& ctx, const AESRecord* records, size_t count, AESThreadPool* pool = &defaultThreadPool()) {
+    //encrypts count records in CTR mode, each record's IV is its initial counter block and its output is as long as its input
+    //a record's in and out may be the same buffer, but records must not overlap each other
+    //large batches are spread over pool, pass nullptr to stay on the calling thread
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CTRRecords, recordBytes(records, count));
+
+    forRecordTasks(count, pool, [&](size_t first, size_t taskRecords) {
+        ctrRecordsRange(ctx, records + first, taskRecords);
+    });
+}
+
+inline void ctrDecryptRecords(const AESKeyContext& ctx, const AESRecord* records, size_t count, AESThreadPool* pool = &defaultThreadPool()) {
+    //CTR decryption is the same keystream XOR as encryption
+    ctrEncryptRecords(ctx, records, count, pool);
+}
+
+inline void cbcEncryptRecords(const AESKeyContext& ctx, const AESRecord* records, size_t count, AESThreadPool* pool = &defaultThreadPool()) {
+    //pads and encrypts count records in CBC mode, each output needs room for pkcs7PaddedLength of its length
+    forRecordTasks(count, pool, [&](size_t first, size_t taskRecords) {
+        cbcEncryptMulti(ctx, records + first, taskRecords);
+    });
+}
+
+inline size_t cbcDecryptRecordsRange(const AESKeyContext& ctx, const AESRecord* records, size_t count, size_t* plainLengths) {
+    //CBC decryption of each record on the calling thread, returns how many failed
+    //ciphertext blocks are copied into the batch, so the chain block for every block but the first in a batch is still there
+    //even when a record is decrypted in place. The first one chains off carry, the last block of the batch before
+    BlockFunction decrypt = activeDecryptBlockFunction(ctx);
+
+    alignas(16) uint8_t cipher[batchBlocks * 16];
+    alignas(16) uint8_t plain[batchBlocks * 16];
+    uint8_t carry[16];
+
+    size_t slotRecord[batchBlocks];
+    size_t slotBlock[batchBlocks];
+
+    size_t n = 0;
+    size_t failed = 0;
+
+    auto flush = [&]() {
+        decrypt(ctx, cipher, plain, n);
+
+        for(size_t j = 0; j < n; j++) {
+            const AESRecord& record = records[slotRecord[j]];
+            size_t block = slotBlock[j];
+
+            const uint8_t* chain = block == 0 ? record.iv : j == 0 ? carry : cipher + 16 * (j - 1);
+
+            xorBytes(record.out + 16 * block, plain + 16 * j, chain, 16);
+
+            if(16 * (block + 1) == record.length && !pkcs7Unpad(record.out, record.length, plainLengths[slotRecord[j]])) {
+                plainLengths[slotRecord[j]] = invalidRecordLength;
+                failed++;
+            }
+        }
+
+        memcpy(carry, cipher + 16 * (n - 1), 16);
+        n = 0;
+    };
+
+    for(size_t r = 0; r < count; r++) {
+        const AESRecord& record = records[r];
+
+        if(record.length == 0 || record.length % 16 != 0) {
+            plainLengths[r] = invalidRecordLength;
+            failed++;
+            continue;
+        }
+
+        for(size_t block = 0; block < record.length / 16; block++) {
+            memcpy(cipher + 16 * n, record.in + 16 * block, 16);
+            slotRecord[n] = r;
+            slotBlock[n] = block;
+
+            if(++n == batchBlocks) {
+                flush();
+            }
+        }
+    }
+
+    if(n > 0) {
+        flush();
+    }
+
+    return failed;
+}
+
+inline size_t cbcDecryptRecords(const AESKeyContext& ctx, const AESRecord* records, size_t count, size_t* plainLengths, AESThreadPool* pool = &defaultThreadPool()) {
+    //decrypts count records written by cbcEncryptRecords and strips their padding, plainLengths[i] gets record i's length
+    //returns how many records failed, because their length was not a positive multiple of 16 or their padding was malformed.
+    //Those get invalidRecordLength, and their output is still written
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CBCDecryptRecords, recordBytes(records, count));
+
+    std::atomic<size_t> failed{0};
+
+    forRecordTasks(count, pool, [&](size_t first, size_t taskRecords) {
+        failed.fetch_add(cbcDecryptRecordsRange(ctx, records + first, taskRecords, plainLengths + first), std::memory_order_relaxed);
+    });
+
+    return failed.load();
+}
+
+inline size_t encodeRecords(AESTextEncoding encoding, const AESRecord* records, size_t count, char* text, size_t* textOffsets, AESThreadPool* pool = &defaultThreadPool()) {
+    //writes the first length bytes of each record's out as text, back to back, and returns the characters written
+    //record i's text runs from textOffsets[i] to textOffsets[i + 1], so textOffsets needs count + 1 entries
+    //and text needs room for the encodedLength of every record. For a CBC batch, give each record its padded length
+    textOffsets[0] = 0;
+
+    for(size_t r = 0; r < count; r++) {
+        textOffsets[r + 1] = textOffsets[r] + encodedLength(encoding, records[r].length);
+    }
+
+    forRecordTasks(count, pool, [&](size_t first, size_t taskRecords) {
+        for(size_t r = first; r < first + taskRecords; r++) {
+            encodeText(encoding, records[r].out, records[r].length, text + textOffsets[r]);
+        }
+    });
+
+    return textOffsets[count];
+}
+
+#endif
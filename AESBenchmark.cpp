@@ -0,0 +1,614 @@
+// AESBenchmark.cpp
+// Measures every round step, key setup, engine, and mode, and prints the results as CSV or JSON
+//
+// - The round steps (subBytes, shiftRows, mixColumns, addRoundKey and their inverses) are timed on a single state
+// - Key setup is timed through createKeys, each engine's expandKey, and the bulk prepareKeys
+// - Block encryption and decryption are timed for every engine this machine supports, with every key size
+// - Every mode is timed under every engine, with message sizes going up by 4x from 16 bytes to --max-size, 1 GiB by default
+// - Hex and Base64 encoding and decoding are timed with the scalar, SSSE3, and AVX2 code, in the engine column
+// - Each measurement repeats until it has run for at least --min-time seconds. Once a single pass at some size
+//   would take longer than --max-pass seconds, the larger sizes are left out for that engine and mode
+// - Cycles come from the time stamp counter on x86. It ticks at a fixed rate rather than with the core clock,
+//   so cycles per byte is for comparing runs on the same machine. The column is empty on other CPUs
+// - Modes that use the thread pool get their own pool of --threads threads, 1 by default, so numbers are per core
+//
+// Build: g++ -std=c++17 -O2 -pthread AESBenchmark.cpp -o AESBenchmark
+// Every row has the same columns, so runs from two releases can be joined on group, name, engine, key_bits, and bytes
+
+#include <iostream> //usage and errors
+#include <string> //arguments and result names
+#include <vector> //keys, records, and result rows
+#include <memory> //large buffers
+#include <chrono> //wall clock timing
+#include <cstdio> //printf for the result rows
+#include <cstdlib> //strtod and strtoull for arguments
+#include <cstring> //memset
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> //__rdtsc
+#define AES_HAVE_RDTSC 1
+#else
+#define AES_HAVE_RDTSC 0
+#endif
+
+#include "AESCore.h" //round steps and the reference block cipher
+#include "AESKeySchedule.h" //createKeys and expandKey
+#include "AESEngine.h" //every engine and useEngine
+#include "AESCTR.h" //CTR
+#include "AESCBC.h" //CBC
+#include "AESOFB.h" //OFB
+#include "AESCFB.h" //CFB
+#include "AESGCM.h" //GCM and GHASH
+#include "AESXTS.h" //XTS
+#include "AESBatch.h" //multi-record calls
+#include "AESThreadPool.h" //the pool handed to modes that can use one
+#include "AESEncoding.h" //hex and Base64
+
+using namespace std;
+
+struct BenchmarkOptions {
+    bool json = false;
+    string filter;//only run measurements whose group/name/engine contains this
+    double minTime = 0.1;//seconds each measurement runs for at least
+    double maxPass = 1.0;//longest single pass worth running, in seconds
+    size_t maxSize = size_t(1) << 30;//largest message size
+    unsigned threads = 1;//threads in the pool handed to modes
+};
+
+struct BenchmarkResult {
+    string group;
+    string name;
+    string engine;
+    int keyBits;
+    size_t bytes;//bytes per operation
+    uint64_t iterations;
+    double seconds;
+    uint64_t cycles;
+};
+
+volatile uint8_t benchmarkSink = 0;//results are folded in here so the measured work cannot be optimized out
+
+inline uint64_t readCycles() {
+    //time stamp counter, or 0 where there is none
+#if AES_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+inline double secondsNow() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class BenchmarkReport {
+    //prints result rows as they come in, so a long run can be watched and a cut short run still has its rows
+public:
+    explicit BenchmarkReport(const BenchmarkOptions& options) : options(options) {
+        if(options.json) {
+            printf("[\n");
+        }
+        else {
+            printf("group,name,engine,key_bits,bytes,threads,iterations,ns_per_op,ns_per_block,cycles_per_byte,mb_per_s\n");
+        }
+    }
+
+    ~BenchmarkReport() {
+        if(options.json) {
+            printf("\n]\n");
+        }
+    }
+
+    bool wanted(const string& group, const string& name, const string& engine) const {
+        //whether a measurement passes --filter
+        return options.filter.empty() || (group + "/" + name + "/" + engine).find(options.filter) != string::npos;
+    }
+
+    void add(const BenchmarkResult& result) {
+        double nsPerOp = result.seconds * 1e9 / static_cast<double>(result.iterations);
+        double nsPerBlock = nsPerOp * 16.0 / static_cast<double>(result.bytes);
+        double mbPerSecond = static_cast<double>(result.bytes) * static_cast<double>(result.iterations) / result.seconds / 1e6;
+
+        char cycles[32] = "";
+        if(AES_HAVE_RDTSC) {
+            double cyclesPerByte = static_cast<double>(result.cycles) / static_cast<double>(result.iterations) / static_cast<double>(result.bytes);
+            snprintf(cycles, sizeof(cycles), "%.3f", cyclesPerByte);
+        }
+
+        if(options.json) {
+            printf("%s  {\"group\": \"%s\", \"name\": \"%s\", \"engine\": \"%s\", \"key_bits\": %d, \"bytes\": %zu, \"threads\": %u, "
+                   "\"iterations\": %llu, \"ns_per_op\": %.3f, \"ns_per_block\": %.3f, \"cycles_per_byte\": %s, \"mb_per_s\": %.2f}",
+                   rows == 0 ? "" : ",\n", result.group.c_str(), result.name.c_str(), result.engine.c_str(), result.keyBits, result.bytes,
+                   threadsFor(result), static_cast<unsigned long long>(result.iterations), nsPerOp, nsPerBlock,
+                   AES_HAVE_RDTSC ? cycles : "null", mbPerSecond);
+        }
+        else {
+            printf("%s,%s,%s,%d,%zu,%u,%llu,%.3f,%.3f,%s,%.2f\n", result.group.c_str(), result.name.c_str(), result.engine.c_str(),
+                   result.keyBits, result.bytes, threadsFor(result), static_cast<unsigned long long>(result.iterations), nsPerOp, nsPerBlock,
+                   cycles, mbPerSecond);
+        }
+
+        fflush(stdout);
+        rows++;
+    }
+
+private:
+    unsigned threadsFor(const BenchmarkResult& result) const {
+        return result.group == "mode" ? options.threads : 1;
+    }
+
+    const BenchmarkOptions& options;
+    size_t rows = 0;
+};
+
+template<class Operation>
+BenchmarkResult measure(const BenchmarkOptions& options, Operation&& operation) {
+    //runs operation once to warm up, then doubles the repeat count until a run takes at least minTime
+    operation();
+
+    BenchmarkResult result{};
+
+    for(uint64_t iterations = 1; ; iterations *= 2) {
+        uint64_t startCycles = readCycles();
+        double start = secondsNow();
+
+        for(uint64_t i = 0; i < iterations; i++) {
+            operation();
+        }
+
+        double seconds = secondsNow() - start;
+        uint64_t cycles = readCycles() - startCycles;
+
+        if(seconds >= options.minTime || iterations >= (uint64_t(1) << 40)) {
+            result.iterations = iterations;
+            result.seconds = seconds;
+            result.cycles = cycles;
+            return result;
+        }
+    }
+}
+
+template<class Operation>
+void runBenchmark(BenchmarkReport& report, const BenchmarkOptions& options, const string& group, const string& name, const string& engine,
+                  int keyBits, size_t bytes, Operation&& operation) {
+    //measures one operation and adds its row, if it passes the filter
+    if(!report.wanted(group, name, engine)) {
+        return;
+    }
+
+    BenchmarkResult result = measure(options, operation);
+    result.group = group;
+    result.name = name;
+    result.engine = engine;
+    result.keyBits = keyBits;
+    result.bytes = bytes;
+
+    report.add(result);
+}
+
+template<class Operation>
+void runSizes(BenchmarkReport& report, const BenchmarkOptions& options, const string& group, const string& name, const string& engine,
+              int keyBits, size_t smallest, Operation&& operation) {
+    //measures operation(size) for sizes from smallest up to maxSize, growing 4x each time,
+    //and stops once the last measurement says a single pass at the next size would take longer than maxPass
+    if(!report.wanted(group, name, engine)) {
+        return;
+    }
+
+    for(size_t size = smallest; size <= options.maxSize; size *= 4) {
+        BenchmarkResult result = measure(options, [&] { operation(size); });
+        result.group = group;
+        result.name = name;
+        result.engine = engine;
+        result.keyBits = keyBits;
+        result.bytes = size;
+
+        report.add(result);
+
+        double secondsPerByte = result.seconds / static_cast<double>(result.iterations) / static_cast<double>(size);
+        if(secondsPerByte * static_cast<double>(size) * 4 > options.maxPass) {
+            break;
+        }
+    }
+}
+
+void fillPattern(uint8_t* data, size_t length, uint32_t seed) {
+    //cheap repeatable bytes for keys and messages, the content does not change the timing of any engine measured here
+    uint32_t x = seed * 2654435761u + 1;
+
+    for(size_t i = 0; i < length; i++) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<uint8_t>(x >> 24);
+    }
+}
+
+void benchmarkSteps(BenchmarkReport& report, const BenchmarkOptions& options) {
+    //the round steps on one state, chained so every call depends on the one before it
+    AESState state;
+    fillPattern(state.bytes, 16, 1);
+
+    uint8_t roundKey[16];
+    fillPattern(roundKey, 16, 2);
+
+    runBenchmark(report, options, "step", "subBytes", "-", 0, 16, [&] { subBytes(state); });
+    runBenchmark(report, options, "step", "shiftRows", "-", 0, 16, [&] { shiftRows(state); });
+    runBenchmark(report, options, "step", "mixColumns", "-", 0, 16, [&] { mixColumns(state); });
+    runBenchmark(report, options, "step", "addRoundKey", "-", 0, 16, [&] { addRoundKey(state, roundKey); });
+    runBenchmark(report, options, "step", "invSubBytes", "-", 0, 16, [&] { invSubBytes(state); });
+    runBenchmark(report, options, "step", "invShiftRows", "-", 0, 16, [&] { invShiftRows(state); });
+    runBenchmark(report, options, "step", "invMixColumns", "-", 0, 16, [&] { invMixColumns(state); });
+
+    benchmarkSink = benchmarkSink ^ state.bytes[0];
+}
+
+void benchmarkKeys(BenchmarkReport& report, const BenchmarkOptions& options) {
+    //key setup for each key size: the word by word createKeys, each engine's expandKey, and prepareKeys on a batch of keys
+    constexpr size_t bulkKeys = 256;
+
+    vector<uint8_t> keys(32 * bulkKeys);
+    fillPattern(keys.data(), keys.size(), 3);
+
+    vector<AESKeyContext> contexts(bulkKeys);
+
+    for(int keyBytes : {16, 24, 32}) {
+        int keyBits = 8 * keyBytes;
+        vector<uint8_t> key(keys.begin(), keys.begin() + keyBytes);
+
+        runBenchmark(report, options, "key", "createKeys", "-", keyBits, static_cast<size_t>(keyBytes), [&] {
+            benchmarkSink = benchmarkSink ^ createKeys(key)[0][0];
+        });
+
+        for(const AESEngine* engine : allEngines) {
+            if(!engine->isSupported()) {
+                continue;
+            }
+
+            runBenchmark(report, options, "key", "expandKey", engine->name, keyBits, static_cast<size_t>(keyBytes), [&] {
+                engine->expandKey(contexts[0], key.data(), key.size());
+                benchmarkSink = benchmarkSink ^ contexts[0].roundKeys[16];
+            });
+
+            useEngine(*engine);
+
+            //one operation is the whole batch, so ns_per_op / 256 is the cost of one key
+            runBenchmark(report, options, "key", "prepareKeys/256", engine->name, keyBits, static_cast<size_t>(keyBytes) * bulkKeys, [&] {
+                prepareKeys(contexts.data(), keys.data(), static_cast<size_t>(keyBytes), bulkKeys);
+                benchmarkSink = benchmarkSink ^ contexts[bulkKeys - 1].roundKeys[16];
+            });
+        }
+    }
+}
+
+void benchmarkBlocks(BenchmarkReport& report, const BenchmarkOptions& options, uint8_t* in, uint8_t* out) {
+    //independent blocks straight through each engine, with no mode around them
+    for(int keyBytes : {16, 24, 32}) {
+        int keyBits = 8 * keyBytes;
+
+        uint8_t key[32];
+        fillPattern(key, sizeof(key), 4);
+
+        AESKeyContext ctx;
+        expandKey(ctx, key, static_cast<size_t>(keyBytes));
+
+        runBenchmark(report, options, "block", "encryptBlock", "reference", keyBits, 16, [&] {
+            encryptBlock(ctx, in, in);
+        });
+
+        for(const AESEngine* engine : allEngines) {
+            if(!engine->isSupported()) {
+                continue;
+            }
+
+            runSizes(report, options, "block", "encryptBlocks", engine->name, keyBits, 16, [&](size_t size) {
+                engine->encryptBlocks(ctx, in, out, size / 16);
+            });
+
+            runSizes(report, options, "block", "decryptBlocks", engine->name, keyBits, 16, [&](size_t size) {
+                engine->decryptBlocks(ctx, in, out, size / 16);
+            });
+        }
+    }
+
+    benchmarkSink = benchmarkSink ^ out[0];
+}
+
+void benchmarkModes(BenchmarkReport& report, const BenchmarkOptions& options, uint8_t* in, uint8_t* out) {
+    //every mode under every engine, with the engine switched in through useEngine
+    AESThreadPool pool(options.threads);
+
+    uint8_t iv[16];
+    fillPattern(iv, sizeof(iv), 5);
+
+    uint8_t tag[16];
+
+    for(const AESEngine* engine : allEngines) {
+        if(!useEngine(*engine)) {
+            continue;
+        }
+
+        const char* name = engine->name;
+
+        for(int keyBytes : {16, 24, 32}) {
+            int keyBits = 8 * keyBytes;
+
+            uint8_t key[64];
+            fillPattern(key, sizeof(key), 6);
+
+            AESKeyContext ctx;
+            prepareKey(ctx, key, static_cast<size_t>(keyBytes));
+
+            runSizes(report, options, "mode", "ctr", name, keyBits, 16, [&](size_t size) {
+                ctrEncrypt(ctx, iv, in, out, size, &pool);
+            });
+
+            runSizes(report, options, "mode", "cbc-encrypt", name, keyBits, 16, [&](size_t size) {
+                cbcEncrypt(ctx, iv, in, size, out);
+            });
+
+            runSizes(report, options, "mode", "cbc-decrypt", name, keyBits, 16, [&](size_t size) {
+                size_t plainLength;
+                cbcDecrypt(ctx, iv, in, size, out, plainLength, &pool);
+            });
+
+            runSizes(report, options, "mode", "ofb", name, keyBits, 16, [&](size_t size) {
+                ofbEncrypt(ctx, iv, in, out, size);
+            });
+
+            runSizes(report, options, "mode", "cfb-encrypt", name, keyBits, 16, [&](size_t size) {
+                cfbEncrypt(ctx, iv, in, out, size);
+            });
+
+            runSizes(report, options, "mode", "cfb-decrypt", name, keyBits, 16, [&](size_t size) {
+                cfbDecrypt(ctx, iv, in, out, size, &pool);
+            });
+
+            AESGCMContext gcm;
+            gcmSetKey(gcm, key, static_cast<size_t>(keyBytes));
+
+            runSizes(report, options, "mode", "gcm-encrypt", name, keyBits, 16, [&](size_t size) {
+                gcmEncrypt(gcm, iv, 12, nullptr, 0, in, out, size, tag);
+            });
+
+            //decryption is timed on a valid message, so it is not cut short or followed by wiping the output
+            size_t sealed = 0;
+            runSizes(report, options, "mode", "gcm-decrypt", name, keyBits, 16, [&](size_t size) {
+                if(sealed != size) {
+                    gcmEncrypt(gcm, iv, 12, nullptr, 0, in, in, size, tag);
+                    sealed = size;
+                }
+                gcmDecrypt(gcm, iv, 12, nullptr, 0, in, out, size, tag);
+            });
+
+            if(keyBytes != 24) {
+                //XTS is only defined for two AES128 or two AES256 keys
+                AESXTSContext xts;
+                xtsSetKey(xts, key, 2 * static_cast<size_t>(keyBytes));
+
+                runSizes(report, options, "mode", "xts-encrypt", name, keyBits, 16, [&](size_t size) {
+                    size_t sector = size < 4096 ? size : 4096;
+                    xtsEncryptSectors(xts, 0, in, out, sector, size / sector, &pool);
+                });
+
+                runSizes(report, options, "mode", "xts-decrypt", name, keyBits, 16, [&](size_t size) {
+                    size_t sector = size < 4096 ? size : 4096;
+                    xtsDecryptSectors(xts, 0, in, out, sector, size / sector, &pool);
+                });
+            }
+
+            for(size_t recordBytes : {32, 256}) {
+                //a batch of small records with their own IVs, each operation is about 1 MiB of records
+                size_t count = (size_t(1) << 20) / recordBytes;
+                if(count * (recordBytes + 16) > options.maxSize) {
+                    count = options.maxSize / (recordBytes + 16);
+                }
+
+                vector<AESRecord> records(count);
+                for(size_t r = 0; r < count; r++) {
+                    records[r] = {iv, in + recordBytes * r, recordBytes, out + (recordBytes + 16) * r};
+                }
+
+                string suffix = "/" + to_string(recordBytes);
+
+                runBenchmark(report, options, "mode", "ctr-records" + suffix, name, keyBits, recordBytes * count, [&] {
+                    ctrEncryptRecords(ctx, records.data(), count, &pool);
+                });
+
+                runBenchmark(report, options, "mode", "cbc-records" + suffix, name, keyBits, recordBytes * count, [&] {
+                    cbcEncryptRecords(ctx, records.data(), count, &pool);
+                });
+            }
+        }
+    }
+
+    useEngine(selectEngine());
+
+    //GHASH does not go through an engine, its two versions are told apart by name
+    uint8_t h[16];
+    fillPattern(h, sizeof(h), 7);
+
+    GHASHKey ghash;
+    ghashInit(ghash, h);
+
+    uint8_t state[16] = {};
+
+    runSizes(report, options, "mode", "ghash-table", "-", 0, 16, [&](size_t size) {
+        ghashBlocksTable(ghash, state, in, size / 16);
+    });
+
+#if AES_HAVE_AESNI
+    if(ghash.hardware) {
+        runSizes(report, options, "mode", "ghash-pclmul", "-", 0, 16, [&](size_t size) {
+            ghashBlocksHardware(ghash, state, in, size / 16);
+        });
+    }
+#endif
+
+    benchmarkSink = benchmarkSink ^ state[0] ^ out[0] ^ tag[0];
+}
+
+size_t encodeBulkNone(const uint8_t*, size_t, char*) {
+    return 0;
+}
+
+size_t decodeBulkNone(const char*, size_t, uint8_t*) {
+    return 0;
+}
+
+struct EncodingVariant {
+    //the vector part of each encoder and decoder, the scalar code finishes whatever it leaves
+    const char* name;
+    bool supported;
+    size_t (*hexEncodeBulk)(const uint8_t*, size_t, char*);
+    size_t (*hexDecodeBulk)(const char*, size_t, uint8_t*);
+    size_t (*base64EncodeBulk)(const uint8_t*, size_t, char*);
+    size_t (*base64DecodeBulk)(const char*, size_t, uint8_t*);
+};
+
+void benchmarkEncodings(BenchmarkReport& report, const BenchmarkOptions& options, uint8_t* in, uint8_t* out) {
+    //encoding and decoding in each version, sizes are bytes of binary data. Runs last, decoding writes over in
+    vector<EncodingVariant> variants = {{"scalar", true, encodeBulkNone, decodeBulkNone, encodeBulkNone, decodeBulkNone}};
+
+#if AES_HAVE_AESNI
+    variants.push_back({"ssse3", cpuFeatures().ssse3, hexEncodeSSSE3, hexDecodeSSSE3, base64EncodeSSSE3, base64DecodeSSSE3});
+    variants.push_back({"avx2", cpuFeatures().avx2, hexEncodeAVX2, hexDecodeAVX2, base64EncodeAVX2, base64DecodeAVX2});
+#endif
+
+    //hex text is twice as long as its data and has to fit in out
+    BenchmarkOptions halfSize = options;
+    halfSize.maxSize = options.maxSize / 2;
+
+    char* text = reinterpret_cast<char*>(out);
+    bool decoded = true;
+
+    for(const EncodingVariant& variant : variants) {
+        if(!variant.supported) {
+            continue;
+        }
+
+        runSizes(report, halfSize, "encode", "hex-encode", variant.name, 0, 16, [&](size_t size) {
+            size_t done = variant.hexEncodeBulk(in, size, text);
+            hexEncodeScalar(in + done, size - done, text + 2 * done);
+        });
+
+        runSizes(report, halfSize, "encode", "base64-encode", variant.name, 0, 16, [&](size_t size) {
+            size_t done = variant.base64EncodeBulk(in, size, text);
+            base64EncodeScalar(in + done, size - done, text + done / 3 * 4);
+        });
+    }
+
+    //the decoders read text made from in, which is written once up front
+    hexEncode(in, halfSize.maxSize, text);
+
+    for(const EncodingVariant& variant : variants) {
+        if(variant.supported) {
+            runSizes(report, halfSize, "encode", "hex-decode", variant.name, 0, 16, [&](size_t size) {
+                size_t done = variant.hexDecodeBulk(text, 2 * size, in);
+                decoded &= hexDecodeScalar(text + done, 2 * size - done, in + done / 2);
+            });
+        }
+    }
+
+    base64Encode(in, halfSize.maxSize, text);
+
+    for(const EncodingVariant& variant : variants) {
+        if(variant.supported) {
+            runSizes(report, halfSize, "encode", "base64-decode", variant.name, 0, 16, [&](size_t size) {
+                //sizes that are not a multiple of 3 decode the whole groups before them
+                size_t textLength = size / 3 * 4;
+                size_t done = variant.base64DecodeBulk(text, textLength, in);
+                size_t tail = 0;
+                decoded &= base64DecodeScalar(text + done, textLength - done, in + done / 4 * 3, tail);
+            });
+        }
+    }
+
+    benchmarkSink = benchmarkSink ^ in[0] ^ static_cast<uint8_t>(decoded);
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--format csv|json] [--filter TEXT] [--min-time SECONDS] [--max-pass SECONDS] [--max-size BYTES] [--threads N]" << endl;
+    cerr << "  --filter keeps only measurements whose group/name/engine contains TEXT, for example mode/gcm or /aesni" << endl;
+    cerr << "  --max-size takes a byte count with an optional K, M, or G suffix, the default is 1G" << endl;
+}
+
+bool parseSize(const char* text, size_t& size) {
+    //a byte count with an optional K, M, or G suffix, powers of 1024
+    char* end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if(end == text) {
+        return false;
+    }
+
+    switch(*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+
+    size = static_cast<size_t>(value);
+    return *end == '\0' && size >= 16;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--format" && hasValue) {
+            string format = argv[++i];
+            if(format != "csv" && format != "json") {
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.json = format == "json";
+        }
+        else if(arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        }
+        else if(arg == "--min-time" && hasValue) {
+            options.minTime = strtod(argv[++i], nullptr);
+        }
+        else if(arg == "--max-pass" && hasValue) {
+            options.maxPass = strtod(argv[++i], nullptr);
+        }
+        else if(arg == "--max-size" && hasValue) {
+            if(!parseSize(argv[++i], options.maxSize)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if(arg == "--threads" && hasValue) {
+            options.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+            if(options.threads == 0) {
+                options.threads = 1;
+            }
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    //one input and one output buffer, with room for CBC padding, written once so their pages are in place before timing
+    size_t bufferBytes = options.maxSize + 16;
+    unique_ptr<uint8_t[]> in(new uint8_t[bufferBytes]);
+    unique_ptr<uint8_t[]> out(new uint8_t[bufferBytes]);
+    fillPattern(in.get(), bufferBytes, 8);
+    memset(out.get(), 0, bufferBytes);
+
+    {
+        BenchmarkReport report(options);
+
+        benchmarkSteps(report, options);
+        benchmarkKeys(report, options);
+        benchmarkBlocks(report, options, in.get(), out.get());
+        benchmarkModes(report, options, in.get(), out.get());
+        benchmarkEncodings(report, options, in.get(), out.get());
+    }
+
+    return 0;
+}
@@ -0,0 +1,617 @@
+// AESBitsliced.h
+// Bitsliced constant time AES engine
+//
+// - Blocks are processed in groups of 8 with SSE2, or 16 with AVX2, and the whole group goes through every round together
+// - The state is split into 8 bit planes. Plane b holds bit b of every byte of every block in the group,
+//   so the S-box becomes a fixed circuit of AND, XOR, and NOT gates run on all of them at once
+// - Nothing indexes memory with secret data, not even the key schedule, so there is no cache timing leak
+// - Decryption reuses the S-box circuit between two inverse affine transforms, and inverse mix columns is
+//   the forward mix columns after one extra multiply by 4, so both directions share almost all of their gates
+//
+// Plane layout: a plane is 16 bytes per 8 block group. Byte p of a plane is byte p of the state (4 * column + row),
+// and bit k of that byte belongs to block k. Read as 32 bit lanes, lane c is column c and byte r of a lane is row r,
+// which turns shift rows into lane shuffles and mix columns into rotates within each lane.
+// Blocks move in and out of the planes with a register wide bit transpose
+//
+// The bit planes use GCC vector extensions, so the same code compiles to SSE2 for 8 blocks and AVX2 for 16
+
+#ifndef AES_BITSLICED_H
+#define AES_BITSLICED_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy for packing planes
+
+#include "AESCore.h" //AESKeyContext, AESKeySize, and the round constants
+#include "AESKeySchedule.h" //expandKeyFixed, which takes the constant time sub word here
+#include "AESCPU.h" //picks 8 or 16 block groups
+
+#if defined(__GNUC__)
+#define AES_HAVE_BITSLICED 1
+#else
+#define AES_HAVE_BITSLICED 0
+#endif
+
+#if AES_HAVE_BITSLICED
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi" //16 block planes are only passed by value inside code compiled for AVX2
+
+typedef uint32_t BitslicePlane8 __attribute__((vector_size(16)));//one plane for 8 blocks, one SSE2 register
+typedef uint32_t BitslicePlane16 __attribute__((vector_size(32)));//one plane for 16 blocks, one AVX2 register
+
+template<class V>
+inline void sBoxBitsliced(V q[8]) {
+    //the AES S-box as a circuit of 113 gates (Boyar and Peralta), run on every byte of every plane at once
+    //q[0] is the low bit plane. The circuit numbers bits from the top, so x0 is q[7]
+
+    V x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    //top linear transform
+    V y14 = x3 ^ x5;
+    V y13 = x0 ^ x6;
+    V y9 = x0 ^ x3;
+    V y8 = x0 ^ x5;
+    V t0 = x1 ^ x2;
+    V y1 = t0 ^ x7;
+    V y4 = y1 ^ x3;
+    V y12 = y13 ^ y14;
+    V y2 = y1 ^ x0;
+    V y5 = y1 ^ x6;
+    V y3 = y5 ^ y8;
+    V t1 = x4 ^ y12;
+    V y15 = t1 ^ x5;
+    V y20 = t1 ^ x1;
+    V y6 = y15 ^ x7;
+    V y10 = y15 ^ t0;
+    V y11 = y20 ^ y9;
+    V y7 = x7 ^ y11;
+    V y17 = y10 ^ y11;
+    V y19 = y10 ^ y8;
+    V y16 = t0 ^ y11;
+    V y21 = y13 ^ y16;
+    V y18 = x0 ^ y16;
+
+    //shared non linear middle, the inverse in GF(2^4)^2
+    V t2 = y12 & y15;
+    V t3 = y3 & y6;
+    V t4 = t3 ^ t2;
+    V t5 = y4 & x7;
+    V t6 = t5 ^ t2;
+    V t7 = y13 & y16;
+    V t8 = y5 & y1;
+    V t9 = t8 ^ t7;
+    V t10 = y2 & y7;
+    V t11 = t10 ^ t7;
+    V t12 = y9 & y11;
+    V t13 = y14 & y17;
+    V t14 = t13 ^ t12;
+    V t15 = y8 & y10;
+    V t16 = t15 ^ t12;
+    V t17 = t4 ^ t14;
+    V t18 = t6 ^ t16;
+    V t19 = t9 ^ t14;
+    V t20 = t11 ^ t16;
+    V t21 = t17 ^ y20;
+    V t22 = t18 ^ y19;
+    V t23 = t19 ^ y21;
+    V t24 = t20 ^ y18;
+
+    V t25 = t21 ^ t22;
+    V t26 = t21 & t23;
+    V t27 = t24 ^ t26;
+    V t28 = t25 & t27;
+    V t29 = t28 ^ t22;
+    V t30 = t23 ^ t24;
+    V t31 = t22 ^ t26;
+    V t32 = t31 & t30;
+    V t33 = t32 ^ t24;
+    V t34 = t23 ^ t33;
+    V t35 = t27 ^ t33;
+    V t36 = t24 & t35;
+    V t37 = t36 ^ t34;
+    V t38 = t27 ^ t36;
+    V t39 = t29 & t38;
+    V t40 = t25 ^ t39;
+
+    V t41 = t40 ^ t37;
+    V t42 = t29 ^ t33;
+    V t43 = t29 ^ t40;
+    V t44 = t33 ^ t37;
+    V t45 = t42 ^ t41;
+    V z0 = t44 & y15;
+    V z1 = t37 & y6;
+    V z2 = t33 & x7;
+    V z3 = t43 & y16;
+    V z4 = t40 & y1;
+    V z5 = t29 & y7;
+    V z6 = t42 & y11;
+    V z7 = t45 & y17;
+    V z8 = t41 & y10;
+    V z9 = t44 & y12;
+    V z10 = t37 & y3;
+    V z11 = t33 & y4;
+    V z12 = t43 & y13;
+    V z13 = t40 & y5;
+    V z14 = t29 & y2;
+    V z15 = t42 & y9;
+    V z16 = t45 & y14;
+    V z17 = t41 & y8;
+
+    //bottom linear transform, which also folds in the affine constant 0x63
+    V t46 = z15 ^ z16;
+    V t47 = z10 ^ z11;
+    V t48 = z5 ^ z13;
+    V t49 = z9 ^ z10;
+    V t50 = z2 ^ z12;
+    V t51 = z2 ^ z5;
+    V t52 = z7 ^ z8;
+    V t53 = z0 ^ z3;
+    V t54 = z6 ^ z7;
+    V t55 = z16 ^ z17;
+    V t56 = z12 ^ t48;
+    V t57 = t50 ^ t53;
+    V t58 = z4 ^ t46;
+    V t59 = z3 ^ t54;
+    V t60 = t46 ^ t57;
+    V t61 = z14 ^ t57;
+    V t62 = t52 ^ t58;
+    V t63 = t49 ^ t58;
+    V t64 = z4 ^ t59;
+    V t65 = t61 ^ t62;
+    V t66 = z1 ^ t63;
+    V s0 = t59 ^ t63;
+    V s6 = t56 ^ ~t62;
+    V s7 = t48 ^ ~t60;
+    V t67 = t64 ^ t65;
+    V s3 = t53 ^ t66;
+    V s4 = t51 ^ t66;
+    V s5 = t47 ^ t65;
+    V s1 = t64 ^ ~s3;
+    V s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+inline void rotateColumns(const BitslicePlane8& x, int by, BitslicePlane8& out) {
+    //lane c takes lane (c + by) % 4, which is one row of shift rows
+    switch(by) {
+        case 1:
+            out = __builtin_shuffle(x, BitslicePlane8{1, 2, 3, 0});
+            break;
+        case 2:
+            out = __builtin_shuffle(x, BitslicePlane8{2, 3, 0, 1});
+            break;
+        default:
+            out = __builtin_shuffle(x, BitslicePlane8{3, 0, 1, 2});
+            break;
+    }
+}
+
+inline void rotateColumns(const BitslicePlane16& x, int by, BitslicePlane16& out) {
+    //the same shuffle, done separately in each 128 bit half
+    switch(by) {
+        case 1:
+            out = __builtin_shuffle(x, BitslicePlane16{1, 2, 3, 0, 5, 6, 7, 4});
+            break;
+        case 2:
+            out = __builtin_shuffle(x, BitslicePlane16{2, 3, 0, 1, 6, 7, 4, 5});
+            break;
+        default:
+            out = __builtin_shuffle(x, BitslicePlane16{3, 0, 1, 2, 7, 4, 5, 6});
+            break;
+    }
+}
+
+template<class V>
+inline void rotateRows(const V& x, int rows, V& out) {
+    //row r of every column takes row r + rows, a rotate right by 8 * rows bits inside each 32 bit lane
+    //planes are passed by reference, so 16 block planes never cross a call boundary by value
+    out = (x >> (8 * rows)) | (x << (32 - 8 * rows));
+}
+
+template<class V>
+inline void shiftRowsBitsliced(V q[8]) {
+    //row r of the state moves left by r columns, rows are picked out of each lane with a byte mask
+    const V row0 = V{} + 0x000000ffu;
+    const V row1 = V{} + 0x0000ff00u;
+    const V row2 = V{} + 0x00ff0000u;
+    const V row3 = V{} + 0xff000000u;
+
+    for(int b = 0; b < 8; b++) {
+        V x1, x2, x3;
+        rotateColumns(q[b], 1, x1);
+        rotateColumns(q[b], 2, x2);
+        rotateColumns(q[b], 3, x3);
+
+        q[b] = (q[b] & row0) | (x1 & row1) | (x2 & row2) | (x3 & row3);
+    }
+}
+
+template<class V>
+inline void xtimeBitsliced(V t[8]) {
+    //multiplies every byte by 2 under GF(2^8)
+    //each plane moves up one bit, and the old top plane folds back in as 0x1b
+    V top = t[7];
+
+    t[7] = t[6];
+    t[6] = t[5];
+    t[5] = t[4];
+    t[4] = t[3] ^ top;
+    t[3] = t[2] ^ top;
+    t[2] = t[1];
+    t[1] = t[0] ^ top;
+    t[0] = top;
+}
+
+template<class V>
+inline void mixColumnsBitsliced(V q[8]) {
+    //out = 2 * (a ^ a1) ^ a1 ^ a2 ^ a3, where ak is the column rotated up by k rows
+
+    V a1[8];
+    V t[8];
+
+    for(int b = 0; b < 8; b++) {
+        rotateRows(q[b], 1, a1[b]);
+        t[b] = q[b] ^ a1[b];
+    }
+
+    xtimeBitsliced(t);
+
+    for(int b = 0; b < 8; b++) {
+        V a2, a3;
+        rotateRows(q[b], 2, a2);
+        rotateRows(q[b], 3, a3);
+
+        q[b] = t[b] ^ a1[b] ^ a2 ^ a3;
+    }
+}
+
+template<class V>
+inline void invAffineBitsliced(V q[8]) {
+    //the inverse S-box affine transform with its constant, rotl(x, 1) ^ rotl(x, 3) ^ rotl(x, 6) ^ 0x05
+    V t[8];
+
+    for(int b = 0; b < 8; b++) {
+        t[b] = q[(b + 7) & 7] ^ q[(b + 5) & 7] ^ q[(b + 2) & 7];
+    }
+
+    for(int b = 0; b < 8; b++) {
+        q[b] = t[b];
+    }
+
+    q[0] = ~q[0];
+    q[2] = ~q[2];
+}
+
+template<class V>
+inline void invSBoxBitsliced(V q[8]) {
+    //S^-1(y) = A^-1(S(A^-1(y))), where A^-1 is invAffineBitsliced
+    //the first A^-1 leaves the field inverse of the answer as its input, and the S-box circuit plus the second A^-1
+    //takes that inverse back again
+    invAffineBitsliced(q);
+    sBoxBitsliced(q);
+    invAffineBitsliced(q);
+}
+
+template<class V>
+inline void invShiftRowsBitsliced(V q[8]) {
+    //row r of the state moves right by r columns, which is left by 4 - r
+    const V row0 = V{} + 0x000000ffu;
+    const V row1 = V{} + 0x0000ff00u;
+    const V row2 = V{} + 0x00ff0000u;
+    const V row3 = V{} + 0xff000000u;
+
+    for(int b = 0; b < 8; b++) {
+        V x1, x2, x3;
+        rotateColumns(q[b], 3, x1);
+        rotateColumns(q[b], 2, x2);
+        rotateColumns(q[b], 1, x3);
+
+        q[b] = (q[b] & row0) | (x1 & row1) | (x2 & row2) | (x3 & row3);
+    }
+}
+
+template<class V>
+inline void invMixColumnsBitsliced(V q[8]) {
+    //folds 4 * (a ^ a2) into every column and then runs the forward mix columns, the same split invMixColumns uses
+    V t[8];
+
+    for(int b = 0; b < 8; b++) {
+        rotateRows(q[b], 2, t[b]);
+        t[b] ^= q[b];
+    }
+
+    xtimeBitsliced(t);
+    xtimeBitsliced(t);
+
+    for(int b = 0; b < 8; b++) {
+        q[b] ^= t[b];
+    }
+
+    mixColumnsBitsliced(q);
+}
+
+template<class V>
+inline void addRoundKeyBitsliced(V q[8], const V* keyPlanes) {
+    for(int b = 0; b < 8; b++) {
+        q[b] ^= keyPlanes[b];
+    }
+}
+
+template<class V>
+inline void swapMove(V& a, V& b, int shift, uint32_t mask) {
+    //swaps the bits of b picked by mask with the bits of a that sit shift places above them
+    V t = (b ^ (a >> shift)) & mask;
+    b ^= t;
+    a ^= t << shift;
+}
+
+template<class V>
+inline void transposePlanes(V q[8]) {
+    //transposes the 8x8 bit matrix at every byte position: bit j of register k becomes bit k of register j
+    //it is its own inverse, so the same call packs blocks into planes and unpacks them again
+    swapMove(q[0], q[1], 1, 0x55555555u);
+    swapMove(q[2], q[3], 1, 0x55555555u);
+    swapMove(q[4], q[5], 1, 0x55555555u);
+    swapMove(q[6], q[7], 1, 0x55555555u);
+
+    swapMove(q[0], q[2], 2, 0x33333333u);
+    swapMove(q[1], q[3], 2, 0x33333333u);
+    swapMove(q[4], q[6], 2, 0x33333333u);
+    swapMove(q[5], q[7], 2, 0x33333333u);
+
+    swapMove(q[0], q[4], 4, 0x0f0f0f0fu);
+    swapMove(q[1], q[5], 4, 0x0f0f0f0fu);
+    swapMove(q[2], q[6], 4, 0x0f0f0f0fu);
+    swapMove(q[3], q[7], 4, 0x0f0f0f0fu);
+}
+
+template<class V>
+inline void packBitsliced(const uint8_t* in, V q[8]) {
+    //splits sizeof(V) / 2 blocks into bit planes
+    //register k starts out holding block k, and block k + 8 in the upper half when there are 16
+
+    for(int k = 0; k < 8; k++) {
+        for(size_t g = 0; g < sizeof(V) / 16; g++) {
+            memcpy(reinterpret_cast<uint8_t*>(&q[k]) + 16 * g, in + 16 * (k + 8 * g), 16);
+        }
+    }
+
+    transposePlanes(q);
+}
+
+template<class V>
+inline void unpackBitsliced(V q[8], uint8_t* out) {
+    //joins bit planes back into blocks, the inverse of packBitsliced. q is left transposed back
+
+    transposePlanes(q);
+
+    for(int k = 0; k < 8; k++) {
+        for(size_t g = 0; g < sizeof(V) / 16; g++) {
+            memcpy(out + 16 * (k + 8 * g), reinterpret_cast<const uint8_t*>(&q[k]) + 16 * g, 16);
+        }
+    }
+}
+
+template<class V>
+inline void expandKeyPlanes(const AESKeyContext& ctx, V* keyPlanes) {
+    //spreads each round key across the planes, every block in the group uses the same key
+    //bit b of round key byte p becomes an all ones or all zeros byte p in plane b, by smearing that bit across its byte
+
+    for(int round = 0; round <= ctx.rounds; round++) {
+        V rk;
+
+        for(size_t g = 0; g < sizeof(V) / 16; g++) {
+            memcpy(reinterpret_cast<uint8_t*>(&rk) + 16 * g, ctx.roundKey(round), 16);
+        }
+
+        for(int b = 0; b < 8; b++) {
+            V plane = (rk >> b) & 0x01010101u;
+            plane |= plane << 1;
+            plane |= plane << 2;
+            plane |= plane << 4;
+
+            keyPlanes[8 * round + b] = plane;
+        }
+    }
+}
+
+template<class V, int Nr>
+inline void encryptPlanesBitsliced(V q[8], const V* keyPlanes) {
+    //the full cipher on one packed group
+    addRoundKeyBitsliced(q, keyPlanes);
+
+    for(int round = 1; round < Nr; round++) {
+        sBoxBitsliced(q);
+        shiftRowsBitsliced(q);
+        mixColumnsBitsliced(q);
+        addRoundKeyBitsliced(q, keyPlanes + 8 * round);
+    }
+
+    sBoxBitsliced(q);
+    shiftRowsBitsliced(q);
+    addRoundKeyBitsliced(q, keyPlanes + 8 * Nr);
+}
+
+template<class V, int Nr>
+inline void decryptPlanesBitsliced(V q[8], const V* keyPlanes) {
+    //the inverse cipher on one packed group, using the encryption round keys from last to first
+    addRoundKeyBitsliced(q, keyPlanes + 8 * Nr);
+
+    for(int round = Nr - 1; round > 0; round--) {
+        invShiftRowsBitsliced(q);
+        invSBoxBitsliced(q);
+        addRoundKeyBitsliced(q, keyPlanes + 8 * round);
+        invMixColumnsBitsliced(q);
+    }
+
+    invShiftRowsBitsliced(q);
+    invSBoxBitsliced(q);
+    addRoundKeyBitsliced(q, keyPlanes);
+}
+
+template<class V, int Nr, bool Decrypt>
+inline void cipherPlanesBitsliced(V q[8], const V* keyPlanes) {
+    if constexpr(Decrypt) {
+        decryptPlanesBitsliced<V, Nr>(q, keyPlanes);
+    }
+    else {
+        encryptPlanesBitsliced<V, Nr>(q, keyPlanes);
+    }
+}
+
+template<class V, int Nr, bool Decrypt>
+inline void cipherBlocksBitslicedWidth(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //encrypts or decrypts blocks in groups of sizeof(V) / 2, a short last group is padded with zero blocks
+
+    constexpr size_t groupBlocks = sizeof(V) / 2;
+
+    V keyPlanes[8 * (Nr + 1)];
+    expandKeyPlanes(ctx, keyPlanes);
+
+    V q[8];
+
+    size_t i = 0;
+
+    for(; i + groupBlocks <= blocks; i += groupBlocks) {
+        packBitsliced(in + 16 * i, q);
+        cipherPlanesBitsliced<V, Nr, Decrypt>(q, keyPlanes);
+        unpackBitsliced(q, out + 16 * i);
+    }
+
+    if(i < blocks) {
+        uint8_t tail[16 * groupBlocks] = {};
+        memcpy(tail, in + 16 * i, 16 * (blocks - i));
+
+        packBitsliced(tail, q);
+        cipherPlanesBitsliced<V, Nr, Decrypt>(q, keyPlanes);
+        unpackBitsliced(q, tail);
+
+        memcpy(out + 16 * i, tail, 16 * (blocks - i));
+    }
+}
+
+template<int Nr, bool Decrypt>
+inline void cipherBlocksBitsliced8(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //8 blocks per group in SSE2 registers, which every x86-64 CPU has
+    cipherBlocksBitslicedWidth<BitslicePlane8, Nr, Decrypt>(ctx, in, out, blocks);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template<int Nr, bool Decrypt>
+__attribute__((target("avx2"), flatten)) inline void cipherBlocksBitsliced16(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //16 blocks per group in AVX2 registers. flatten pulls the generic code in so all of it is compiled for AVX2
+    cipherBlocksBitslicedWidth<BitslicePlane16, Nr, Decrypt>(ctx, in, out, blocks);
+}
+
+#define AES_HAVE_BITSLICED_AVX2 1
+#else
+#define AES_HAVE_BITSLICED_AVX2 0
+#endif
+
+inline void subWordConstantTime(uint8_t word[4]) {
+    //runs the S-box over 4 bytes with the same circuit, so key expansion does not index a table with key bytes
+    //each plane is a plain 32 bit integer here and only its low 4 bits are used, one per byte
+
+    uint32_t q[8];
+
+    for(int b = 0; b < 8; b++) {
+        q[b] = 0;
+        for(int k = 0; k < 4; k++) {
+            q[b] |= static_cast<uint32_t>((word[k] >> b) & 1) << k;
+        }
+    }
+
+    sBoxBitsliced(q);
+
+    for(int k = 0; k < 4; k++) {
+        uint8_t byte = 0;
+        for(int b = 0; b < 8; b++) {
+            byte |= static_cast<uint8_t>(((q[b] >> k) & 1) << b);
+        }
+        word[k] = byte;
+    }
+}
+
+inline bool expandKeyConstantTime(AESKeyContext& ctx, const uint8_t* key, size_t keyLength) {
+    //expandKey with the S-box circuit in place of the table lookups
+    switch(keyLength) {
+        case 16:
+            expandKeyFixed<16, subWordConstantTime>(ctx, key);
+            return true;
+        case 24:
+            expandKeyFixed<24, subWordConstantTime>(ctx, key);
+            return true;
+        case 32:
+            expandKeyFixed<32, subWordConstantTime>(ctx, key);
+            return true;
+        default:
+            return false;
+    }
+}
+
+template<int Nr, bool Decrypt>
+inline void cipherBlocksBitslicedRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //uses 16 block groups when the CPU has AVX2, 8 block groups otherwise
+#if AES_HAVE_BITSLICED_AVX2
+    if(cpuFeatures().avx2) {
+        cipherBlocksBitsliced16<Nr, Decrypt>(ctx, in, out, blocks);
+        return;
+    }
+#endif
+    cipherBlocksBitsliced8<Nr, Decrypt>(ctx, in, out, blocks);
+}
+
+template<int Nr>
+inline void encryptBlocksBitslicedRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    cipherBlocksBitslicedRounds<Nr, false>(ctx, in, out, blocks);
+}
+
+template<int Nr>
+inline void decryptBlocksBitslicedRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    cipherBlocksBitslicedRounds<Nr, true>(ctx, in, out, blocks);
+}
+
+inline void encryptBlocksBitsliced(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call
+    switch(ctx.rounds) {
+        case 10:
+            encryptBlocksBitslicedRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            encryptBlocksBitslicedRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            encryptBlocksBitslicedRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+inline void decryptBlocksBitsliced(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call
+    switch(ctx.rounds) {
+        case 10:
+            decryptBlocksBitslicedRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            decryptBlocksBitslicedRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            decryptBlocksBitslicedRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+#endif
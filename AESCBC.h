@@ -0,0 +1,285 @@
+// AESCBC.h
+// AES in cipher block chaining (CBC) mode with PKCS#7 padding
+//
+// - Each plaintext block is XOR'ed with the previous ciphertext block, or the IV for the first one, before it is encrypted
+// - Encrypting one message is serial, every block waits on the one before it. cbcEncryptMulti gets the pipeline back
+//   by interleaving many independent messages, one block from each per call into the engine
+// - Decryption has no chain between block decryptions, so whole runs of blocks go through the engine at once
+//   and large buffers are split across the thread pool
+// - PKCS#7 always adds 1 to 16 bytes, each equal to the number added, so the padding can be removed without ambiguity
+//
+// Padding is checked without branching on its bytes, but CBC on its own does not authenticate anything.
+// Anything an attacker can tamper with should also carry a MAC, or use GCM instead
+
+#ifndef AES_CBC_H
+#define AES_CBC_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy
+
+#include "AESCore.h" //AESKeyContext, AESRecord, and xorBytes
+#include "AESEngine.h" //the active engine
+#include "AESThreadPool.h" //splits large buffers across cores
+#include "AESMemory.h" //scratch space for the chain blocks at chunk boundaries
+
+inline constexpr size_t cbcBatchBlocks = 64;//blocks decrypted per engine call
+inline constexpr size_t cbcChunkBytes = 256 * 1024;//bytes per thread pool task when decrypting, a multiple of 16
+inline constexpr size_t cbcLanes = 16;//messages cbcEncryptMulti keeps in flight, whole groups for the 8 and 16 block engines
+
+inline size_t pkcs7PaddedLength(size_t length) {
+    //length after padding, always at least one byte more than length
+    return (length / 16 + 1) * 16;
+}
+
+inline void pkcs7PadBlock(const uint8_t* tail, size_t tailLength, uint8_t block[16]) {
+    //builds the last block from the tailLength < 16 bytes left over at the end of a message
+    uint8_t pad = static_cast<uint8_t>(16 - tailLength);
+
+    if(tailLength > 0) {
+        memcpy(block, tail, tailLength);//tail may be null when the message is empty
+    }
+    memset(block + tailLength, pad, pad);
+}
+
+inline bool pkcs7Unpad(const uint8_t* data, size_t length, size_t& unpaddedLength) {
+    //checks the padding at the end of data and sets unpaddedLength to the length without it
+    //returns false if length is not a positive multiple of 16 or the padding is malformed
+    //all 16 bytes of the last block are looked at whatever the padding length is, so the time taken does not depend on it
+
+    if(length == 0 || length % 16 != 0) {
+        return false;
+    }
+
+    const uint8_t* last = data + length - 16;
+    uint8_t pad = last[15];
+
+    unsigned bad = static_cast<unsigned>(pad == 0) | static_cast<unsigned>(pad > 16);
+
+    for(unsigned i = 0; i < 16; i++) {
+        unsigned inPadding = static_cast<unsigned>(15 - i < pad);//1 for the last pad bytes
+        bad |= inPadding & static_cast<unsigned>(last[i] != pad);
+    }
+
+    if(bad) {
+        return false;
+    }
+
+    unpaddedLength = length - pad;
+    return true;
+}
+
+inline void cbcEncryptBlocks(const AESKeyContext& ctx, uint8_t chain[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    //encrypts whole blocks, chain starts as the IV and is left as the last ciphertext block so a message can be continued
+    //in and out may be the same buffer
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    for(size_t i = 0; i < blocks; i++) {
+        uint8_t block[16];
+
+        xorBytes(block, in + 16 * i, chain, 16);
+        encrypt(ctx, block, out + 16 * i, 1);
+        memcpy(chain, out + 16 * i, 16);
+    }
+}
+
+inline void cbcDecryptRange(const AESKeyContext& ctx, const uint8_t chain[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    //decrypts whole blocks given the ciphertext block before them, in and out may be the same buffer
+    //blocks go through the engine cbcBatchBlocks at a time, and each batch is XOR'ed back to front
+    //so an in place call never overwrites a ciphertext block it still needs
+    BlockFunction decrypt = activeDecryptBlockFunction(ctx);
+
+    alignas(16) uint8_t plain[cbcBatchBlocks * 16];
+    uint8_t previous[16];
+    uint8_t next[16];
+
+    memcpy(previous, chain, 16);
+
+    for(size_t i = 0; i < blocks; i += cbcBatchBlocks) {
+        size_t batch = blocks - i < cbcBatchBlocks ? blocks - i : cbcBatchBlocks;
+
+        const uint8_t* c = in + 16 * i;
+        uint8_t* p = out + 16 * i;
+
+        memcpy(next, c + 16 * (batch - 1), 16);//the chain for the next batch, saved before an in place call overwrites it
+
+        decrypt(ctx, c, plain, batch);
+
+        for(size_t j = batch - 1; j > 0; j--) {
+            xorBytes(p + 16 * j, plain + 16 * j, c + 16 * (j - 1), 16);
+        }
+        xorBytes(p, plain, previous, 16);
+
+        memcpy(previous, next, 16);
+    }
+}
+
+inline void cbcDecryptBlocks(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks, AESThreadPool* pool = &defaultThreadPool()) {
+    //decrypts whole blocks, in and out may be the same buffer
+    //buffers bigger than one chunk are spread over pool, pass nullptr to stay on the calling thread
+    constexpr size_t chunkBlocks = cbcChunkBytes / 16;
+
+    if(pool == nullptr || pool->size() == 1 || blocks <= chunkBlocks) {
+        cbcDecryptRange(ctx, iv, in, out, blocks);
+        return;
+    }
+
+    size_t chunks = (blocks + chunkBlocks - 1) / chunkBlocks;
+
+    //each chunk chains off the last ciphertext block of the chunk before it, which an in place call would overwrite,
+    //so they are all copied out first
+    AESArenaScope scratch;
+    uint8_t* chains = scratch.allocate<uint8_t>(16 * chunks);
+    memcpy(chains, iv, 16);
+    for(size_t chunk = 1; chunk < chunks; chunk++) {
+        memcpy(chains + 16 * chunk, in + 16 * (chunk * chunkBlocks - 1), 16);
+    }
+
+    pool->parallelFor(chunks, [&](size_t chunk) {
+        size_t first = chunk * chunkBlocks;
+        size_t count = blocks - first < chunkBlocks ? blocks - first : chunkBlocks;
+
+        cbcDecryptRange(ctx, chains + 16 * chunk, in + 16 * first, out + 16 * first, count);
+    });
+}
+
+inline size_t cbcEncrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, size_t length, uint8_t* out) {
+    //pads and encrypts length bytes, out needs room for pkcs7PaddedLength(length) bytes, which is what is returned
+    //in and out may be the same buffer if it has that much room
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CBCEncrypt, length);
+
+    uint8_t chain[16];
+    memcpy(chain, iv, 16);
+
+    size_t whole = length / 16;
+
+    cbcEncryptBlocks(ctx, chain, in, out, whole);
+
+    uint8_t last[16];
+    pkcs7PadBlock(in + 16 * whole, length - 16 * whole, last);
+    cbcEncryptBlocks(ctx, chain, last, out + 16 * whole, 1);
+
+    return 16 * (whole + 1);
+}
+
+inline bool cbcDecrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, size_t length, uint8_t* out, size_t& plainLength, AESThreadPool* pool = &defaultThreadPool()) {
+    //decrypts length bytes and strips the padding, out needs room for length bytes and plainLength is set to what is left
+    //returns false if length is not a positive multiple of 16 or the padding is malformed, out is still written
+    if(length == 0 || length % 16 != 0) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CBCDecrypt, length);
+
+    cbcDecryptBlocks(ctx, iv, in, out, length / 16, pool);
+
+    return pkcs7Unpad(out, length, plainLength);
+}
+
+using AESCBCJob = AESRecord;//one message for cbcEncryptMulti, out needs room for pkcs7PaddedLength(length) bytes
+
+inline void cbcEncryptMulti(const AESKeyContext& ctx, const AESCBCJob* jobs, size_t count) {
+    //pads and encrypts count independent messages under one key, each with its own IV
+    //up to cbcLanes messages are in flight, and every call into the engine carries the next block of each of them,
+    //so the engine sees full batches even though every single message is serial. A lane that finishes a message
+    //picks up the next one straight away, so short and long messages can be mixed freely
+    //each lane's chain block lives in its slot of the batch, so a step is just XOR in, encrypt, copy out
+
+    uint64_t bytes = 0;
+    for(size_t i = 0; i < count; i++) {
+        bytes += jobs[i].length;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CBCMulti, bytes);
+
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    struct Lane {
+        const AESCBCJob* job;
+        size_t block;//next block of the job
+        size_t blocks;//blocks in the job after padding
+    };
+
+    Lane lanes[cbcLanes];
+    size_t active = 0;
+    size_t nextJob = 0;
+
+    alignas(16) uint8_t batch[cbcLanes * 16];
+
+    auto start = [&](size_t slot) {
+        //points a lane at the next job and loads its IV as the chain, returns false when there are none left
+        if(nextJob == count) {
+            return false;
+        }
+
+        const AESCBCJob& job = jobs[nextJob++];
+
+        lanes[slot] = {&job, 0, job.length / 16 + 1};
+        memcpy(batch + 16 * slot, job.iv, 16);
+        return true;
+    };
+
+    while(active < cbcLanes && start(active)) {
+        active++;
+    }
+
+    while(active > 0) {
+        //every lane has at least this many full blocks before its padded one, so they run without any checks
+        size_t steps = lanes[0].blocks - 1 - lanes[0].block;
+        for(size_t l = 1; l < active; l++) {
+            size_t left = lanes[l].blocks - 1 - lanes[l].block;
+            steps = left < steps ? left : steps;
+        }
+
+        for(size_t step = 0; step < steps; step++) {
+            for(size_t l = 0; l < active; l++) {
+                xorBytes(batch + 16 * l, batch + 16 * l, lanes[l].job->in + 16 * (lanes[l].block + step), 16);
+            }
+
+            encrypt(ctx, batch, batch, active);
+
+            for(size_t l = 0; l < active; l++) {
+                memcpy(lanes[l].job->out + 16 * (lanes[l].block + step), batch + 16 * l, 16);
+            }
+        }
+
+        //at least one lane is now on its padded block, so this step checks each lane
+        for(size_t l = 0; l < active; l++) {
+            Lane& lane = lanes[l];
+            lane.block += steps;
+
+            const uint8_t* plain = lane.job->in + 16 * lane.block;
+            uint8_t block[16];
+
+            if(lane.block + 1 == lane.blocks) {
+                pkcs7PadBlock(plain, lane.job->length - 16 * lane.block, block);
+                plain = block;
+            }
+
+            xorBytes(batch + 16 * l, batch + 16 * l, plain, 16);
+        }
+
+        encrypt(ctx, batch, batch, active);
+
+        for(size_t l = 0; l < active; l++) {
+            memcpy(lanes[l].job->out + 16 * lanes[l].block, batch + 16 * l, 16);
+            lanes[l].block++;
+        }
+
+        //lanes that finished take the next job, or once there are none the last lane moves into their slot
+        for(size_t l = 0; l < active; ) {
+            if(lanes[l].block < lanes[l].blocks || start(l)) {
+                l++;
+                continue;
+            }
+
+            active--;
+            if(l < active) {
+                lanes[l] = lanes[active];
+                memcpy(batch + 16 * l, batch + 16 * active, 16);
+            }
+        }
+    }
+}
+
+#endif
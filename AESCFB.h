@@ -0,0 +1,114 @@
+// AESCFB.h
+// AES in full block cipher feedback (CFB128) mode
+//
+// - Each ciphertext block is the plaintext XOR'ed with the encryption of the ciphertext block before it, or of the IV
+//   for the first one. Only the forward cipher is used, in both directions
+// - Encryption is serial like CBC, every block waits on the one before it
+// - Decryption already has every ciphertext block, so whole runs of them go through the engine at once
+//   and large buffers are split across the thread pool
+// - No padding, the last block can be short and is XOR'ed with the front of its keystream block
+//
+// The segment size is the whole 16 byte block, which is what OpenSSL calls aes-128-cfb and NIST SP 800-38A CFB128
+
+#ifndef AES_CFB_H
+#define AES_CFB_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy
+
+#include "AESCore.h" //AESKeyContext and xorBytes
+#include "AESEngine.h" //the active engine
+#include "AESThreadPool.h" //splits large buffers across cores
+#include "AESMemory.h" //scratch space for the chain blocks at chunk boundaries
+
+inline constexpr size_t cfbBatchBlocks = 64;//blocks encrypted per engine call when decrypting
+inline constexpr size_t cfbChunkBytes = 256 * 1024;//bytes per thread pool task when decrypting, a multiple of 16
+
+inline void cfbEncrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length) {
+    //encrypts length bytes in CFB mode from iv, in and out may be the same buffer
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CFBEncrypt, length);
+
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    uint8_t chain[16];
+    memcpy(chain, iv, 16);
+
+    while(length > 0) {
+        size_t bytes = length < 16 ? length : 16;
+
+        encrypt(ctx, chain, chain, 1);
+        xorBytes(chain, chain, in, bytes);//chain becomes the ciphertext block, which feeds the next one
+        memcpy(out, chain, bytes);
+
+        in += bytes;
+        out += bytes;
+        length -= bytes;
+    }
+}
+
+inline void cfbDecryptRange(const AESKeyContext& ctx, const uint8_t chain[16], const uint8_t* in, uint8_t* out, size_t length) {
+    //decrypts length bytes given the ciphertext block before them, in and out may be the same buffer
+    //the engine inputs for a batch are the ciphertext blocks shifted back by one, and they are copied out
+    //before any plaintext is written, so an in place call never overwrites one it still needs
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    alignas(16) uint8_t feedback[cfbBatchBlocks * 16];
+    uint8_t previous[16];
+
+    memcpy(previous, chain, 16);
+
+    while(length > 0) {
+        size_t blocks = (length + 15) / 16;
+        if(blocks > cfbBatchBlocks) {
+            blocks = cfbBatchBlocks;
+        }
+
+        size_t bytes = blocks * 16 < length ? blocks * 16 : length;
+
+        memcpy(feedback, previous, 16);
+        memcpy(feedback + 16, in, 16 * (blocks - 1));
+        if(bytes == 16 * blocks) {
+            memcpy(previous, in + 16 * (blocks - 1), 16);//the chain for the next batch, only needed after a full one
+        }
+
+        encrypt(ctx, feedback, feedback, blocks);
+
+        xorBytes(out, in, feedback, bytes);
+
+        in += bytes;
+        out += bytes;
+        length -= bytes;
+    }
+}
+
+inline void cfbDecrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length, AESThreadPool* pool = &defaultThreadPool()) {
+    //decrypts length bytes in CFB mode from iv, in and out may be the same buffer
+    //buffers bigger than one chunk are spread over pool, pass nullptr to stay on the calling thread
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CFBDecrypt, length);
+
+    if(pool == nullptr || pool->size() == 1 || length <= cfbChunkBytes) {
+        cfbDecryptRange(ctx, iv, in, out, length);
+        return;
+    }
+
+    size_t chunks = (length + cfbChunkBytes - 1) / cfbChunkBytes;
+
+    //each chunk chains off the last ciphertext block of the chunk before it, which an in place call would overwrite,
+    //so they are all copied out first
+    AESArenaScope scratch;
+    uint8_t* chains = scratch.allocate<uint8_t>(16 * chunks);
+    memcpy(chains, iv, 16);
+    for(size_t chunk = 1; chunk < chunks; chunk++) {
+        memcpy(chains + 16 * chunk, in + chunk * cfbChunkBytes - 16, 16);
+    }
+
+    pool->parallelFor(chunks, [&](size_t chunk) {
+        size_t offset = chunk * cfbChunkBytes;
+        size_t bytes = length - offset < cfbChunkBytes ? length - offset : cfbChunkBytes;
+
+        cfbDecryptRange(ctx, chains + 16 * chunk, in + offset, out + offset, bytes);
+    });
+}
+
+#endif
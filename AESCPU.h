@@ -0,0 +1,65 @@
+// AESCPU.h
+// Asks the CPU which instruction set extensions it has
+//
+// - Detection runs once, the first time cpuFeatures() is called, and is then only read
+// - On compilers or targets without x86 CPUID every feature reads as missing, so callers fall back to portable code
+
+#ifndef AES_CPU_H
+#define AES_CPU_H
+
+#include <cstdint> //fixed width integer types
+
+#include "AESNI.h" //AES_HAVE_AESNI, which is set on x86 GCC and clang builds
+
+#if AES_HAVE_AESNI
+#include <cpuid.h> //__get_cpuid for feature detection
+#endif
+
+struct CPUFeatures {
+    //the instruction set extensions the engines care about
+    bool aesni = false;
+    bool pclmul = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+    uint32_t signature = 0;//family, model, and stepping from CPUID leaf 1, tells one CPU model from another
+};
+
+inline CPUFeatures detectCPUFeatures() {
+    //asks the CPU which extensions it has with CPUID
+    CPUFeatures features;
+
+#if AES_HAVE_AESNI
+    unsigned int eax, ebx, ecx, edx;
+
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        features.signature = eax;
+        features.aesni = (ecx & bit_AES) != 0;
+        features.pclmul = (ecx & bit_PCLMUL) != 0;
+        features.ssse3 = (ecx & bit_SSSE3) != 0;
+        features.sse41 = (ecx & bit_SSE4_1) != 0;
+
+        //AVX2 also needs the OS to save the upper halves of the ymm registers, which xgetbv reports
+        bool osSavesYmm = false;
+        if((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+            unsigned int xcr0Low, xcr0High;
+            __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            osSavesYmm = (xcr0Low & 0x6) == 0x6;
+        }
+
+        if(osSavesYmm && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            features.avx2 = (ebx & bit_AVX2) != 0;
+        }
+    }
+#endif
+
+    return features;
+}
+
+inline const CPUFeatures& cpuFeatures() {
+    //the features of this machine, detected the first time they are asked for
+    static const CPUFeatures features = detectCPUFeatures();
+    return features;
+}
+
+#endif
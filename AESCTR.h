@@ -0,0 +1,144 @@
+// AESCTR.h
+// AES in counter (CTR) mode
+//
+// - The keystream is the encryption of iv, iv + 1, iv + 2, ... with the counter treated as one 128 bit big endian number,
+//   which is the same counter layout OpenSSL and NIST SP 800-38A use
+// - Encryption and decryption are the same operation, and any byte range can be produced without the ones before it
+// - Large buffers are split into chunks that run across the thread pool, and each chunk feeds the engine
+//   several counter blocks per call so the block pipeline stays full
+// - Engines with a fused CTR loop (AES-NI) build the counters in registers and skip the keystream buffer
+
+#ifndef AES_CTR_H
+#define AES_CTR_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy
+
+#include "AESCore.h" //AESKeyContext
+#include "AESEngine.h" //the active engine
+#include "AESThreadPool.h" //splits large buffers across cores
+
+inline constexpr size_t ctrBatchBlocks = 64;//counter blocks handed to the engine per call, whole groups for the 8 and 16 block engines
+inline constexpr size_t ctrChunkBytes = 256 * 1024;//bytes per thread pool task, a multiple of 16
+
+inline uint64_t loadBigEndian64(const uint8_t* p) {
+    //reads 8 bytes as a big endian number
+    uint64_t value;
+    memcpy(&value, p, 8);
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    value = 0;
+    for(int i = 0; i < 8; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+#endif
+}
+
+inline void storeBigEndian64(uint8_t* p, uint64_t value) {
+    //writes a number out as 8 big endian bytes
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+    memcpy(p, &value, 8);
+#else
+    for(int i = 7; i >= 0; i--) {
+        p[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+#endif
+}
+
+inline void ctrCounterAt(const uint8_t iv[16], uint64_t blockOffset, uint8_t counter[16]) {
+    //counter = iv + blockOffset, carrying from the low 64 bits into the high 64 bits
+    uint64_t high = loadBigEndian64(iv);
+    uint64_t low = loadBigEndian64(iv + 8);
+
+    uint64_t sum = low + blockOffset;
+    high += (sum < low);
+
+    storeBigEndian64(counter, high);
+    storeBigEndian64(counter + 8, sum);
+}
+
+inline void ctrXorRange(const AESKeyContext& ctx, const uint8_t iv[16], uint64_t firstBlock, const uint8_t* in, uint8_t* out, size_t length) {
+    //XORs length bytes with the keystream starting at block firstBlock, on the calling thread
+    //length does not have to be a multiple of 16, the last keystream block is cut short
+
+    uint8_t start[16];
+    ctrCounterAt(iv, firstBlock, start);
+
+    CTRFunction fused = activeEngine().ctrBlocksFixed[(ctx.rounds - 10) / 2];
+
+    if(fused != nullptr) {
+        //the engine does the counters and the XOR itself, only a partial last block is left over
+        size_t whole = length / 16;
+
+        fused(ctx, start, in, out, whole);
+
+        in += 16 * whole;
+        out += 16 * whole;
+        length -= 16 * whole;
+    }
+
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    alignas(16) uint8_t counters[ctrBatchBlocks * 16];
+    alignas(16) uint8_t keystream[ctrBatchBlocks * 16];
+
+    uint64_t high = loadBigEndian64(start);
+    uint64_t low = loadBigEndian64(start + 8);
+
+    while(length > 0) {
+        size_t blocks = (length + 15) / 16;
+        if(blocks > ctrBatchBlocks) {
+            blocks = ctrBatchBlocks;
+        }
+
+        for(size_t i = 0; i < blocks; i++) {
+            storeBigEndian64(counters + 16 * i, high);
+            storeBigEndian64(counters + 16 * i + 8, low);
+
+            low++;
+            high += (low == 0);
+        }
+
+        encrypt(ctx, counters, keystream, blocks);
+
+        size_t bytes = blocks * 16 < length ? blocks * 16 : length;
+
+        xorBytes(out, in, keystream, bytes);
+
+        in += bytes;
+        out += bytes;
+        length -= bytes;
+    }
+}
+
+inline void ctrEncrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length, AESThreadPool* pool = &defaultThreadPool()) {
+    //encrypts length bytes in CTR mode starting from counter block iv. in and out may be the same buffer
+    //buffers bigger than one chunk are spread over pool, pass nullptr to stay on the calling thread
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::CTR, length);
+
+    if(pool == nullptr || pool->size() == 1 || length <= ctrChunkBytes) {
+        ctrXorRange(ctx, iv, 0, in, out, length);
+        return;
+    }
+
+    size_t chunks = (length + ctrChunkBytes - 1) / ctrChunkBytes;
+
+    pool->parallelFor(chunks, [&](size_t chunk) {
+        size_t offset = chunk * ctrChunkBytes;
+        size_t bytes = length - offset < ctrChunkBytes ? length - offset : ctrChunkBytes;
+
+        ctrXorRange(ctx, iv, offset / 16, in + offset, out + offset, bytes);
+    });
+}
+
+inline void ctrDecrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length, AESThreadPool* pool = &defaultThreadPool()) {
+    //CTR decryption is the same keystream XOR as encryption
+    ctrEncrypt(ctx, iv, in, out, length, pool);
+}
+
+#endif
@@ -0,0 +1,391 @@
+// AESCore.h
+// Packed byte-oriented core of the AES block cipher
+//
+// - The state is held as 16 packed bytes instead of a matrix of doubles
+// - Bytes are stored column by column, the same order they are read out of a message block,
+//   so the byte in row r and column c lives at index 4 * c + r
+// - Every step works on the state in place and none of them allocate
+// - The S-box and round constants are computed at compile time from their GF(2^8) definitions
+// - Decryption uses the equivalent inverse cipher from FIPS-197, so it has the same step order as encryption
+//   and its round keys are prepared once next to the encryption ones
+
+#ifndef AES_CORE_H
+#define AES_CORE_H
+
+#include <cstdint> //fixed width integer types for the state and keys
+#include <cstddef> //size_t
+#include <cstring> //memcpy for moving blocks in and out of the state, memset for secureZero
+
+#include "AESTrace.h" //per round state traces, compiled out by default
+
+constexpr uint8_t galois2x(uint8_t num) {
+    //computes multiplication by 2 under GF(2^8)
+    //the reduction is done with a mask instead of a branch so every byte takes the same path
+    return static_cast<uint8_t>((num << 1) ^ (0x1b & -(num >> 7)));
+}
+
+constexpr uint8_t galois3x(uint8_t num) {
+    //computes multiplication by 3 under GF(2^8)
+    return static_cast<uint8_t>(galois2x(num) ^ num);
+}
+
+constexpr uint8_t galoisMultiply(uint8_t a, uint8_t b) {
+    //computes a * b under GF(2^8) by shifting and adding, one bit of b at a time
+    uint8_t product = 0;
+
+    for(int i = 0; i < 8; i++) {
+        if(b & 1) {
+            product ^= a;
+        }
+        a = galois2x(a);
+        b >>= 1;
+    }
+
+    return product;
+}
+
+constexpr uint8_t galoisInverse(uint8_t num) {
+    //computes the multiplicative inverse under GF(2^8) as num^254, with 0 mapping to 0
+    uint8_t result = 1;
+    uint8_t power = num;
+
+    for(int exponent = 254; exponent > 0; exponent >>= 1) {
+        if(exponent & 1) {
+            result = galoisMultiply(result, power);
+        }
+        power = galoisMultiply(power, power);
+    }
+
+    return result;
+}
+
+constexpr uint8_t rotateLeft8(uint8_t byte, int bits) {
+    //rotates a byte left, bits must be between 1 and 7
+    return static_cast<uint8_t>((byte << bits) | (byte >> (8 - bits)));
+}
+
+struct AESByteTable {
+    //a 256 entry byte lookup table that can be built at compile time
+    uint8_t entries[256];
+};
+
+constexpr AESByteTable makeSBox() {
+    //the Rijndael S-box is the inverse under GF(2^8) followed by a fixed affine transform
+    AESByteTable table{};
+
+    for(int x = 0; x < 256; x++) {
+        uint8_t inv = galoisInverse(static_cast<uint8_t>(x));
+
+        table.entries[x] = static_cast<uint8_t>(inv ^ rotateLeft8(inv, 1) ^ rotateLeft8(inv, 2) ^ rotateLeft8(inv, 3) ^ rotateLeft8(inv, 4) ^ 0x63);
+    }
+
+    return table;
+}
+
+inline constexpr AESByteTable sBoxTable = makeSBox();
+
+inline constexpr const uint8_t (&sBox)[256] = sBoxTable.entries; //S-box: maps byte values from 0 to 255 to a new value under Rijndaels finite field
+// This and the mix columns function are based in galois theory with a polynomial interpretation
+
+static_assert(sBox[0x00] == 0x63 && sBox[0x01] == 0x7c && sBox[0x53] == 0xed && sBox[0xff] == 0x16, "S-box does not match FIPS-197");
+
+constexpr AESByteTable makeInverseSBox() {
+    //the inverse S-box undoes the S-box, so it is filled in by running the S-box backwards
+    AESByteTable table{};
+
+    for(int x = 0; x < 256; x++) {
+        table.entries[sBox[x]] = static_cast<uint8_t>(x);
+    }
+
+    return table;
+}
+
+inline constexpr AESByteTable invSBoxTable = makeInverseSBox();
+
+inline constexpr const uint8_t (&invSBox)[256] = invSBoxTable.entries; //inverse S-box used by decryption
+
+static_assert(invSBox[0x00] == 0x52 && invSBox[0x63] == 0x00 && invSBox[0x16] == 0xff, "inverse S-box does not match FIPS-197");
+
+struct AESRoundConstants {
+    //round constants for the key schedule, entry i is x^(i - 1) under GF(2^8) and entry 0 is unused
+    uint8_t entries[11];
+};
+
+constexpr AESRoundConstants makeRoundConstants() {
+    //each round constant is the previous one times 2, so 0x80 wraps around to 0x1b and then 0x36
+    AESRoundConstants rCon{};
+
+    rCon.entries[1] = 0x01;
+
+    for(int i = 2; i < 11; i++) {
+        rCon.entries[i] = galois2x(rCon.entries[i - 1]);
+    }
+
+    return rCon;
+}
+
+inline constexpr AESRoundConstants roundConstants = makeRoundConstants();
+
+template<int KeyBytes>
+struct AESKeySize {
+    //the parameters FIPS-197 fixes for each key length, known at compile time
+    static_assert(KeyBytes == 16 || KeyBytes == 24 || KeyBytes == 32, "AES keys are 16, 24, or 32 bytes");
+
+    static constexpr int Nk = KeyBytes / 4;//words in the key
+    static constexpr int Nr = Nk + 6;//rounds
+    static constexpr int words = 4 * (Nr + 1);//words in the expanded schedule
+};
+
+struct AESState {
+    //16 byte AES state, kept column major so a message block can be copied straight in
+
+    alignas(16) uint8_t bytes[16];
+
+    uint8_t& at(int row, int col) { return bytes[4 * col + row]; }
+    uint8_t at(int row, int col) const { return bytes[4 * col + row]; }
+};
+
+static_assert(sizeof(AESState) == 16, "a vector of states has to be a packed run of blocks");
+
+struct AESKeyContext {
+    //an expanded key, laid out as (rounds + 1) round keys of 16 bytes back to back
+    //filled in once by expandKey and then only read, so one context can be shared across threads
+
+    alignas(16) uint8_t roundKeys[15 * 16];//AES256 needs the most, with 15 round keys
+
+    alignas(16) uint8_t decryptRoundKeys[15 * 16];//round keys for the equivalent inverse cipher, in the order decryption uses them
+
+    int rounds = 0;//10, 12, or 14 depending on the key size
+
+    const uint8_t* roundKey(int round) const { return roundKeys + 16 * round; }
+    const uint8_t* decryptRoundKey(int round) const { return decryptRoundKeys + 16 * round; }
+};
+
+struct AESRecord {
+    //one message in a batch call, every record has its own IV but they all share one key
+    const uint8_t* iv;//16 bytes
+    const uint8_t* in;
+    size_t length;
+    uint8_t* out;//as long as in, or longer where the mode pads
+};
+
+inline void subBytes(AESState& state) {
+    //uses the Rjindael S-Box on our whole state
+
+    for(int i = 0; i < 16; i++) {
+        state.bytes[i] = sBox[state.bytes[i]];
+    }
+}
+
+inline void shiftRows(AESState& state) {
+    //shifts rows according to the aes schema
+    //
+    // a b c d
+    // e f g h
+    // i j k l
+    // m n o p
+    //
+    // becomes
+    //
+    // a b c d
+    // f g h e
+    // k l i j
+    // p m n o
+
+    uint8_t temp;
+
+    //row 1 moves left by one
+    temp = state.at(1, 0);
+    state.at(1, 0) = state.at(1, 1);
+    state.at(1, 1) = state.at(1, 2);
+    state.at(1, 2) = state.at(1, 3);
+    state.at(1, 3) = temp;
+
+    //row 2 moves left by two, which is two swaps
+    temp = state.at(2, 0);
+    state.at(2, 0) = state.at(2, 2);
+    state.at(2, 2) = temp;
+    temp = state.at(2, 1);
+    state.at(2, 1) = state.at(2, 3);
+    state.at(2, 3) = temp;
+
+    //row 3 moves left by three, which is right by one
+    temp = state.at(3, 3);
+    state.at(3, 3) = state.at(3, 2);
+    state.at(3, 2) = state.at(3, 1);
+    state.at(3, 1) = state.at(3, 0);
+    state.at(3, 0) = temp;
+}
+
+inline void mixColumns(AESState& state) {
+    //Utilizes a special kind of multiplication with polynomials defined under GF(2^8)
+    //each column is read into locals first so it can be overwritten in place
+
+    for(int i = 0; i < 4; i++) {
+        uint8_t* col = state.bytes + 4 * i;
+
+        uint8_t a0 = col[0];
+        uint8_t a1 = col[1];
+        uint8_t a2 = col[2];
+        uint8_t a3 = col[3];
+
+        col[0] = static_cast<uint8_t>(galois2x(a0) ^ galois3x(a1) ^ a2 ^ a3);
+        col[1] = static_cast<uint8_t>(a0 ^ galois2x(a1) ^ galois3x(a2) ^ a3);
+        col[2] = static_cast<uint8_t>(a0 ^ a1 ^ galois2x(a2) ^ galois3x(a3));
+        col[3] = static_cast<uint8_t>(galois3x(a0) ^ a1 ^ a2 ^ galois2x(a3));
+    }
+}
+
+inline void addRoundKey(AESState& state, const uint8_t roundKey[16]) {
+    //adds a 16 byte round key to our state
+    //round keys are laid out word by word, which lines up with the columns of the state
+
+    for(int i = 0; i < 16; i++) {
+        state.bytes[i] ^= roundKey[i];
+    }
+}
+
+inline void invSubBytes(AESState& state) {
+    //uses the inverse S-Box on our whole state
+
+    for(int i = 0; i < 16; i++) {
+        state.bytes[i] = invSBox[state.bytes[i]];
+    }
+}
+
+inline void invShiftRows(AESState& state) {
+    //undoes shiftRows, row r moves right by r
+
+    uint8_t temp;
+
+    //row 1 moves right by one
+    temp = state.at(1, 3);
+    state.at(1, 3) = state.at(1, 2);
+    state.at(1, 2) = state.at(1, 1);
+    state.at(1, 1) = state.at(1, 0);
+    state.at(1, 0) = temp;
+
+    //row 2 moves by two either way, which is the same two swaps
+    temp = state.at(2, 0);
+    state.at(2, 0) = state.at(2, 2);
+    state.at(2, 2) = temp;
+    temp = state.at(2, 1);
+    state.at(2, 1) = state.at(2, 3);
+    state.at(2, 3) = temp;
+
+    //row 3 moves right by three, which is left by one
+    temp = state.at(3, 0);
+    state.at(3, 0) = state.at(3, 1);
+    state.at(3, 1) = state.at(3, 2);
+    state.at(3, 2) = state.at(3, 3);
+    state.at(3, 3) = temp;
+}
+
+inline void invMixColumns(AESState& state) {
+    //undoes mixColumns without multiplying by 9, 11, 13, and 14
+    //the inverse matrix is the forward one times (4x^2 + 5), so each column gets 4 * (a0 ^ a2) and 4 * (a1 ^ a3)
+    //folded in first and then goes through the forward mixColumns
+
+    for(int i = 0; i < 4; i++) {
+        uint8_t* col = state.bytes + 4 * i;
+
+        uint8_t u = galois2x(galois2x(static_cast<uint8_t>(col[0] ^ col[2])));
+        uint8_t v = galois2x(galois2x(static_cast<uint8_t>(col[1] ^ col[3])));
+
+        col[0] ^= u;
+        col[1] ^= v;
+        col[2] ^= u;
+        col[3] ^= v;
+    }
+
+    mixColumns(state);
+}
+
+inline void xorBytes(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t length) {
+    //out = a ^ b, 8 bytes at a time where possible. out may be the same buffer as a or b
+    size_t i = 0;
+
+    for(; i + 8 <= length; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        x ^= y;
+        memcpy(out + i, &x, 8);
+    }
+
+    for(; i < length; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+inline void secureZero(void* data, size_t length) {
+    //clears key material in a way the compiler cannot drop as a store to memory that is about to be freed
+#if defined(__GNUC__)
+    memset(data, 0, length);
+    __asm__ __volatile__("" : : "r"(data) : "memory");//the compiler has to assume the zeros are read
+#else
+    volatile uint8_t* bytes = static_cast<volatile uint8_t*>(data);
+
+    for(size_t i = 0; i < length; i++) {
+        bytes[i] = 0;
+    }
+#endif
+}
+
+inline void encryptBlock(const AESKeyContext& ctx, const uint8_t in[16], uint8_t out[16]) {
+    //encrypts a single 16 byte block with an expanded key
+    //in and out may point to the same block
+
+    AESState state;
+
+    memcpy(state.bytes, in, 16);
+
+    addRoundKey(state, ctx.roundKey(0));
+    AES_TRACE_STATE(state.bytes, "encrypt, after the initial round key");
+
+    for(int round = 1; round < ctx.rounds; round++) {
+        subBytes(state);
+        shiftRows(state);
+        mixColumns(state);
+        addRoundKey(state, ctx.roundKey(round));
+        AES_TRACE_STATE(state.bytes, "encrypt, after round %d", round);
+    }
+
+    //the last round skips mix columns
+    subBytes(state);
+    shiftRows(state);
+    addRoundKey(state, ctx.roundKey(ctx.rounds));
+    AES_TRACE_STATE(state.bytes, "encrypt, after round %d", ctx.rounds);
+
+    memcpy(out, state.bytes, 16);
+}
+
+inline void decryptBlock(const AESKeyContext& ctx, const uint8_t in[16], uint8_t out[16]) {
+    //decrypts a single 16 byte block with the equivalent inverse cipher
+    //in and out may point to the same block
+
+    AESState state;
+
+    memcpy(state.bytes, in, 16);
+
+    addRoundKey(state, ctx.decryptRoundKey(0));
+    AES_TRACE_STATE(state.bytes, "decrypt, after the initial round key");
+
+    for(int round = 1; round < ctx.rounds; round++) {
+        invSubBytes(state);
+        invShiftRows(state);
+        invMixColumns(state);
+        addRoundKey(state, ctx.decryptRoundKey(round));
+        AES_TRACE_STATE(state.bytes, "decrypt, after round %d", round);
+    }
+
+    //the last round skips inverse mix columns
+    invSubBytes(state);
+    invShiftRows(state);
+    addRoundKey(state, ctx.decryptRoundKey(ctx.rounds));
+    AES_TRACE_STATE(state.bytes, "decrypt, after round %d", ctx.rounds);
+
+    memcpy(out, state.bytes, 16);
+}
+
+#endif
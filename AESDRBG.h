@@ -0,0 +1,281 @@
+// AESDRBG.h
+// CTR_DRBG random bytes (NIST SP 800-90A) built on the library's own AES256
+//
+// - The generator state is an AES256 key and a 16 byte counter V. Output is the encryption of V + 1, V + 2, ...,
+//   which is CTR keystream, so it goes through ctrXorRange and the engine's fused CTR loop
+// - After every request the key and V are replaced by the next 48 bytes of keystream, so a state captured later
+//   cannot be run backwards to earlier output
+// - Entropy comes from a caller supplied function, systemEntropy by default. The generator reseeds itself from it every
+//   reseedInterval requests, and after a fork so a child never repeats its parent's output
+// - bytes() serves small requests out of a buffer of one pre-generated request, drbgBufferBytes at a time,
+//   and wipes each byte as it is handed out. Requests at least that large skip the buffer and are generated in place
+// - threadDRBG is a generator per thread, so callers never share or lock state, and drbgRandomBytes is the shortcut to it
+// - The generator rekeys through the engine directly rather than prepareKey, so its internal keys are not counted
+//   in the aes_key_expansions metric, which stays a count of caller keys
+//
+// This is the variant without a derivation function, so the entropy function has to return full entropy bytes,
+// and additional input and personalization strings are at most drbgSeedBytes long
+
+#ifndef AES_DRBG_H
+#define AES_DRBG_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memset
+#include <atomic> //the fork generation
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h> //pthread_atfork
+#endif
+
+#include "AESCore.h" //AESKeyContext and secureZero
+#include "AESEngine.h" //the active engine's key expansion
+#include "AESCTR.h" //the keystream and counter arithmetic
+#include "AESRandom.h" //the operating system's generator as the default entropy source
+
+inline constexpr size_t drbgKeyBytes = 32;//AES256
+inline constexpr size_t drbgSeedBytes = drbgKeyBytes + 16;//seedlen, the key and V together
+inline constexpr size_t drbgMaxRequestBytes = 1 << 16;//largest single generate request, SP 800-90A allows 2^19 bits
+inline constexpr size_t drbgBufferBytes = 4096;//bytes generated at a time for small requests
+inline constexpr uint64_t drbgReseedInterval = 1 << 16;//generate requests between reseeds, SP 800-90A allows 2^48
+
+using AESEntropySource = bool (*)(void* context, uint8_t* out, size_t length);//fills out with full entropy bytes, false on failure
+
+inline bool systemEntropy(void*, uint8_t* out, size_t length) {
+    //the operating system's generator
+    randomBytes(out, length);
+    return true;
+}
+
+inline std::atomic<uint64_t>& drbgForkGeneration() {
+    //counts forks in this process, once a generator has been made. A generator that sees it move reseeds
+    static std::atomic<uint64_t> generation{0};
+
+#if defined(__unix__) || defined(__APPLE__)
+    static bool registered = pthread_atfork(nullptr, nullptr, [] { generation.fetch_add(1); }) == 0;
+    (void)registered;
+#endif
+
+    return generation;
+}
+
+class AESCTRDRBG {
+    //one CTR_DRBG instance, used from one thread at a time
+public:
+    explicit AESCTRDRBG(AESEntropySource source = systemEntropy, void* context = nullptr, uint64_t reseedInterval = drbgReseedInterval)
+        : source(source), sourceContext(context), reseedInterval(reseedInterval) {}
+
+    ~AESCTRDRBG() {
+        uninstantiate();
+    }
+
+    AESCTRDRBG(const AESCTRDRBG&) = delete;
+    AESCTRDRBG& operator=(const AESCTRDRBG&) = delete;
+
+    bool instantiate(const uint8_t* personalization = nullptr, size_t length = 0) {
+        //seeds from drbgSeedBytes of entropy XOR'ed with the personalization string, starting from an all zero key and V
+        //returns false if the string is too long or the entropy function fails, the generator is then left unseeded
+        uninstantiate();
+
+        uint8_t seed[drbgSeedBytes];
+        if(!seedMaterial(seed, personalization, length)) {
+            return false;
+        }
+
+        uint8_t zeroKey[drbgKeyBytes] = {};
+        rekey(zeroKey);
+
+        update(seed);
+        secureZero(seed, sizeof(seed));
+
+        reseedCounter = 1;
+        forkGeneration = drbgForkGeneration().load();
+        instantiated = true;
+
+        return true;
+    }
+
+    bool reseed(const uint8_t* additional = nullptr, size_t length = 0) {
+        //mixes fresh entropy and the additional input into the state, and drops anything still buffered
+        if(!instantiated) {
+            return instantiate(additional, length);
+        }
+
+        uint8_t seed[drbgSeedBytes];
+        if(!seedMaterial(seed, additional, length)) {
+            return false;
+        }
+
+        update(seed);
+        secureZero(seed, sizeof(seed));
+
+        secureZero(buffer, sizeof(buffer));
+        bufferUsed = drbgBufferBytes;
+
+        reseedCounter = 1;
+        forkGeneration = drbgForkGeneration().load();
+
+        return true;
+    }
+
+    bool generate(uint8_t* out, size_t length, const uint8_t* additional = nullptr, size_t additionalLength = 0) {
+        //fills out with length random bytes straight from the generator, one generate request per drbgMaxRequestBytes.
+        //Asking for nothing does nothing, the state only moves when there is output
+        //returns false if the additional input is too long or a reseed that was due fails, out is then not filled
+        if(additionalLength > drbgSeedBytes) {
+            return false;
+        }
+
+        while(length > 0) {
+            size_t bytes = length < drbgMaxRequestBytes ? length : drbgMaxRequestBytes;
+
+            if(!generateRequest(out, bytes, additional, additionalLength)) {
+                return false;
+            }
+
+            out += bytes;
+            length -= bytes;
+        }
+
+        return true;
+    }
+
+    bool bytes(uint8_t* out, size_t length) {
+        //fills out with length random bytes, small requests come out of the buffer
+        if(length >= drbgBufferBytes) {
+            return generate(out, length);
+        }
+
+        while(length > 0) {
+            if(bufferUsed == drbgBufferBytes || needsReseed()) {
+                if(!generate(buffer, drbgBufferBytes)) {
+                    return false;
+                }
+                bufferUsed = 0;
+            }
+
+            size_t take = drbgBufferBytes - bufferUsed < length ? drbgBufferBytes - bufferUsed : length;
+
+            memcpy(out, buffer + bufferUsed, take);
+            secureZero(buffer + bufferUsed, take);
+
+            bufferUsed += take;
+            out += take;
+            length -= take;
+        }
+
+        return true;
+    }
+
+    void uninstantiate() {
+        //wipes the whole state, the next request seeds it again
+        secureZero(&key, sizeof(key));
+        secureZero(v, sizeof(v));
+        secureZero(buffer, sizeof(buffer));
+
+        bufferUsed = drbgBufferBytes;
+        reseedCounter = 0;
+        instantiated = false;
+    }
+
+    bool isInstantiated() const { return instantiated; }
+
+private:
+    bool seedMaterial(uint8_t seed[drbgSeedBytes], const uint8_t* input, size_t length) {
+        //entropy XOR'ed with input padded out with zeros
+        if(length > drbgSeedBytes || !source(sourceContext, seed, drbgSeedBytes)) {
+            secureZero(seed, drbgSeedBytes);
+            return false;
+        }
+
+        if(length > 0) {
+            xorBytes(seed, seed, input, length);
+        }
+
+        return true;
+    }
+
+    bool needsReseed() const {
+        //too many requests since the last seed, or a fork since then, or never seeded
+        return !instantiated || reseedCounter > reseedInterval || forkGeneration != drbgForkGeneration().load(std::memory_order_relaxed);
+    }
+
+    void rekey(const uint8_t newKey[drbgKeyBytes]) {
+        //expands the generator's own key, which is internal state and not a key a caller asked for
+        activeEngine().expandKey(key, newKey, drbgKeyBytes);
+    }
+
+    void update(const uint8_t provided[drbgSeedBytes]) {
+        //CTR_DRBG_Update: the next drbgSeedBytes of keystream XOR'ed with provided become the new key and V
+        alignas(16) uint8_t next[drbgSeedBytes];
+        uint8_t start[16];
+
+        ctrCounterAt(v, 1, start);
+        memcpy(next, provided, drbgSeedBytes);
+        ctrXorRange(key, start, 0, next, next, drbgSeedBytes);
+
+        rekey(next);
+        memcpy(v, next + drbgKeyBytes, 16);
+
+        secureZero(next, sizeof(next));
+        secureZero(start, sizeof(start));
+    }
+
+    bool generateRequest(uint8_t* out, size_t length, const uint8_t* additional, size_t additionalLength) {
+        //one CTR_DRBG_Generate call of at most drbgMaxRequestBytes
+        uint8_t provided[drbgSeedBytes] = {};
+
+        if(needsReseed()) {
+            //the additional input goes into the reseed, and is not used again below
+            if(!reseed(additional, additionalLength)) {
+                return false;
+            }
+            additionalLength = 0;
+        }
+
+        if(additionalLength > 0) {
+            memcpy(provided, additional, additionalLength);
+            update(provided);
+        }
+
+        uint8_t start[16];
+        ctrCounterAt(v, 1, start);
+
+        memset(out, 0, length);
+        ctrXorRange(key, start, 0, out, out, length);
+
+        ctrCounterAt(v, (length + 15) / 16, v);
+        update(provided);
+
+        secureZero(provided, sizeof(provided));
+        reseedCounter++;
+
+        return true;
+    }
+
+    AESEntropySource source;
+    void* sourceContext;
+    uint64_t reseedInterval;
+
+    AESKeyContext key;
+    uint8_t v[16] = {};
+    uint64_t reseedCounter = 0;//requests since the last seed, plus one
+    uint64_t forkGeneration = 0;//drbgForkGeneration when last seeded
+    bool instantiated = false;
+
+    alignas(16) uint8_t buffer[drbgBufferBytes];//pre-generated output, bytes before bufferUsed have been handed out and wiped
+    size_t bufferUsed = drbgBufferBytes;
+};
+
+inline AESCTRDRBG& threadDRBG() {
+    //the calling thread's generator, seeded from systemEntropy on its first request
+    thread_local AESCTRDRBG drbg;
+    return drbg;
+}
+
+inline bool drbgRandomBytes(uint8_t* out, size_t length) {
+    //random bytes from the calling thread's generator, returns false only if the entropy source fails
+    return threadDRBG().bytes(out, length);
+}
+
+#endif
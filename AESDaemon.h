@@ -0,0 +1,766 @@
+// AESDaemon.h
+// A local encryption service on a Unix domain socket, so every process on a host can share one warm cipher
+//
+// - Clients send framed requests holding a key, an IV, and data, and get framed responses back in the order they were sent
+// - Expanded keys stay resident in an AESKeyCache, so each key is expanded once per daemon instead of once per process
+// - Every worker thread runs its own epoll loop over its own connections. They all watch the listening socket,
+//   and with EPOLLEXCLUSIVE only one of them is woken for each new connection. The woken worker accepts at most
+//   daemonAcceptBatch connections and deals them out round robin, so a burst of clients is spread over every worker
+// - The requests a worker reads in one pass of its loop are grouped by operation and key, and each group goes through
+//   one batch call (ctrEncryptRecords, cbcEncryptRecords, cbcDecryptRecords), so small requests that arrive together,
+//   from one client or many, share full engine batches
+// - Request and response buffers belong to the connection and the worker and are reused, so a warm daemon does not allocate
+// - daemonConnect and daemonRequest are a small blocking client for the same framing
+// - Linux only, AES_HAVE_DAEMON is 0 everywhere else
+//
+// Frames, with every integer little endian:
+//   request:  uint32 length of the rest, uint8 operation, uint8 key length, uint16 zero, uint32 id, key, 16 byte IV, data
+//   response: uint32 length of the rest, uint8 status, 3 zero bytes, uint32 id, data
+// The two zero bytes of a request are reserved, a request that sets them is answered with BadRequest.
+// The metrics operation has no key and no IV, and answers with metricsText
+//
+// The socket is created with mode 0600. Requests carry plaintext and keys, so only the daemon's own user can connect
+
+#ifndef AES_DAEMON_H
+#define AES_DAEMON_H
+
+#if defined(__linux__)
+#define AES_HAVE_DAEMON 1
+#else
+#define AES_HAVE_DAEMON 0
+#endif
+
+#if AES_HAVE_DAEMON
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memmove
+#include <algorithm> //sort for grouping requests
+#include <atomic> //the stop flag
+#include <memory> //connections and cached keys
+#include <mutex> //connections handed from one worker to another
+#include <string> //the metrics response
+#include <thread> //worker threads
+#include <unordered_map> //connections by descriptor
+#include <vector> //frames, requests, and records
+#include <errno.h> //EAGAIN and EINTR
+#include <sys/epoll.h> //the event loop
+#include <sys/eventfd.h> //waking the workers to stop
+#include <sys/socket.h> //Unix domain sockets
+#include <sys/stat.h> //chmod for the socket file
+#include <sys/un.h> //sockaddr_un
+#include <unistd.h> //read, write, close, and unlink
+
+#include "AESCore.h" //AESKeyContext and AESRecord
+#include "AESEngine.h" //the active engine
+#include "AESBatch.h" //the batch calls requests are grouped into
+#include "AESKeyCache.h" //resident expanded keys
+#include "AESMetrics.h" //the metrics operation
+
+inline constexpr size_t daemonHeaderBytes = 12;//length, operation or status, key length, zero, id
+inline constexpr size_t daemonMaxFrameBytes = 16 << 20;//largest frame accepted, the connection is dropped beyond it
+inline constexpr size_t daemonReadBytes = 64 * 1024;//bytes read from one connection per pass, so one busy client cannot starve the rest
+inline constexpr size_t daemonMaxPendingBytes = 4 << 20;//unsent response bytes after which a connection is not read from until it drains
+inline constexpr int daemonEvents = 64;//events taken per epoll_wait
+inline constexpr int daemonAcceptBatch = 16;//connections accepted per wakeup before a worker gets back to its own
+
+enum class AESDaemonOperation : uint8_t {
+    CTR = 1,//CTR encryption or decryption, the response is as long as the data
+    CBCEncrypt = 2,//CBC with PKCS#7 padding, the response is the padded ciphertext
+    CBCDecrypt = 3,//CBC decryption with the padding checked and removed
+    Metrics = 4//metricsText, no key, IV, or data
+};
+
+enum class AESDaemonStatus : uint8_t {
+    OK = 0,
+    BadRequest = 1,//unknown operation, bad key length, reserved bytes set, or data of the wrong length for the operation
+    BadPadding = 2//CBC decryption found malformed padding, no data comes back
+};
+
+inline uint32_t loadLittleEndian32(const uint8_t* p) {
+    //reads 4 bytes as a little endian number
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline void storeLittleEndian32(uint8_t* p, uint32_t value) {
+    //writes a number out as 4 little endian bytes
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+class AESDaemon {
+    //listens on one socket and serves it from a set of worker threads until stop is called
+public:
+    explicit AESDaemon(size_t keyCapacity = keyCacheCapacity) : keys(keyCapacity) {}
+
+    ~AESDaemon() {
+        //the socket file is removed with the socket
+        if(listenFd >= 0) {
+            close(listenFd);
+            unlink(socketPath.c_str());
+        }
+        if(stopFd >= 0) {
+            close(stopFd);
+        }
+    }
+
+    AESDaemon(const AESDaemon&) = delete;
+    AESDaemon& operator=(const AESDaemon&) = delete;
+
+    bool listen(const char* path) {
+        //creates the socket at path, replacing a stale socket file left there, returns false if it cannot
+        //a socket file something still answers on is left alone, and errno is then EADDRINUSE
+        sockaddr_un address{};
+        if(strlen(path) >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+
+        struct stat existing;
+        if(lstat(path, &existing) == 0) {
+            if(!S_ISSOCK(existing.st_mode)) {
+                errno = ENOTSOCK;
+                return false;//never delete something that is not a socket
+            }
+            if(!isStale(address)) {
+                return false;
+            }
+            unlink(path);
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if(listenFd < 0 || stopFd < 0) {
+            return false;
+        }
+
+        mode_t mask = umask(0077);//the socket is never reachable by other users, not even between bind and chmod
+        bool bound = bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        umask(mask);
+
+        if(!bound || chmod(path, 0600) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+
+        socketPath = path;
+        return true;
+    }
+
+    bool run(unsigned threads) {
+        //serves the socket from threads workers, the calling thread being one of them, until stop is called
+        //returns false if listen did not succeed or an epoll set cannot be made
+        if(listenFd < 0) {
+            return false;
+        }
+
+        threads = threads == 0 ? 1 : threads;
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        for(unsigned i = 0; i < threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+
+            if(!watch(*workers.back())) {
+                return false;
+            }
+        }
+
+        workerList.clear();
+        for(auto& worker : workers) {
+            workerList.push_back(worker.get());
+        }
+
+        std::vector<std::thread> extra;
+        for(unsigned i = 1; i < threads; i++) {
+            extra.emplace_back([this, worker = workers[i].get()] { serve(*worker); });
+        }
+
+        serve(*workers[0]);
+
+        for(auto& thread : extra) {
+            thread.join();
+        }
+
+        workerList.clear();
+        return true;
+    }
+
+    void stop() {
+        //makes every worker return, safe to call from a signal handler
+        stopping.store(true);
+
+        uint64_t one = 1;
+        ssize_t ignored = write(stopFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+private:
+    static bool isStale(const sockaddr_un& address) {
+        //only a socket nobody is listening on refuses a connection, anything else may belong to a running daemon
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(probe < 0) {
+            return false;
+        }
+
+        //a full backlog (EAGAIN) also means a daemon is there
+        int reason = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 ? EADDRINUSE : errno;
+        close(probe);
+
+        if(reason == ECONNREFUSED) {
+            return true;
+        }
+
+        errno = reason == EAGAIN ? EADDRINUSE : reason;
+        return false;
+    }
+
+    struct Connection {
+        int fd = -1;
+        std::vector<uint8_t> input;//bytes read and not yet answered
+        std::vector<uint8_t> output;//responses not yet written
+        size_t parsed = 0;//bytes of input taken as frames this pass
+        size_t written = 0;//bytes of output already sent
+        size_t passEnd = 0;//end of the responses written so far this pass
+        bool closing = false;//the peer hung up or sent a bad frame, closed once output is sent
+    };
+
+    struct Request {
+        Connection* connection;
+        AESDaemonOperation operation;
+        AESDaemonStatus status;
+        uint32_t id;
+        std::shared_ptr<const AESKeyContext> key;
+        size_t iv;//offset of the IV in input
+        size_t in;//offset of the data in input
+        size_t length;//bytes of data
+        size_t out;//offset of the response data in output
+        size_t outLength;//bytes of response data once processed
+    };
+
+    struct Worker {
+        int epoll = -1;
+        int wakeFd = -1;//signalled when another worker hands this one connections
+        std::mutex handoffMutex;
+        std::vector<int> handoff;//accepted by another worker and not yet taken in, guarded by handoffMutex
+        std::vector<int> adopting;//handoff swapped out, so the lock is not held while they are taken in
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        std::vector<Connection*> touched;//connections read from this pass
+        std::vector<Request> requests;
+        std::vector<size_t> order;//request indices sorted into groups
+        std::vector<AESRecord> records;
+        std::vector<size_t> plainLengths;
+        std::string metrics;
+
+        ~Worker() {
+            for(auto& entry : connections) {
+                close(entry.first);
+            }
+            for(int fd : handoff) {
+                close(fd);
+            }
+            if(wakeFd >= 0) {
+                close(wakeFd);
+            }
+            if(epoll >= 0) {
+                close(epoll);
+            }
+        }
+    };
+
+    bool watch(Worker& worker) {
+        //a worker's epoll set starts with the listening socket, the stop event, and its own wake event
+        worker.epoll = epoll_create1(EPOLL_CLOEXEC);
+        worker.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(worker.epoll < 0 || worker.wakeFd < 0) {
+            return false;
+        }
+
+        epoll_event listenEvent{};
+        listenEvent.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+        listenEvent.events |= EPOLLEXCLUSIVE;
+#endif
+        listenEvent.data.fd = listenFd;
+
+        epoll_event stopEvent{};
+        stopEvent.events = EPOLLIN;
+        stopEvent.data.fd = stopFd;
+
+        epoll_event wakeEvent{};
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.fd = worker.wakeFd;
+
+        return epoll_ctl(worker.epoll, EPOLL_CTL_ADD, listenFd, &listenEvent) == 0 &&
+               epoll_ctl(worker.epoll, EPOLL_CTL_ADD, stopFd, &stopEvent) == 0 &&
+               epoll_ctl(worker.epoll, EPOLL_CTL_ADD, worker.wakeFd, &wakeEvent) == 0;
+    }
+
+    void serve(Worker& worker) {
+        //one worker's event loop: read what is ready, answer it in batches, write what can be written
+        epoll_event events[daemonEvents];
+
+        while(!stopping.load()) {
+            int ready = epoll_wait(worker.epoll, events, daemonEvents, -1);
+
+            if(ready < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+
+            worker.touched.clear();
+
+            for(int e = 0; e < ready; e++) {
+                int fd = events[e].data.fd;
+
+                if(fd == stopFd) {
+                    return;
+                }
+
+                if(fd == listenFd) {
+                    acceptSome(worker);
+                    continue;
+                }
+
+                if(fd == worker.wakeFd) {
+                    adoptHandoff(worker);
+                    continue;
+                }
+
+                auto found = worker.connections.find(fd);
+                if(found == worker.connections.end()) {
+                    continue;
+                }
+
+                Connection& connection = *found->second;
+
+                //a connection read from is flushed once its requests are answered, flushing it here could close it under them
+                if(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readFrom(worker, connection);
+                }
+                else if(events[e].events & EPOLLOUT) {
+                    flush(worker, connection);
+                }
+            }
+
+            answer(worker);
+        }
+    }
+
+    void acceptSome(Worker& worker) {
+        //accepts up to daemonAcceptBatch waiting connections and deals them out to the workers in turn
+        //the listening socket stays ready while more are waiting, so the rest are picked up on a later pass
+        for(int i = 0; i < daemonAcceptBatch; i++) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0) {
+                return;
+            }
+
+            Worker& target = *workerList[nextWorker.fetch_add(1, std::memory_order_relaxed) % workerList.size()];
+
+            if(&target == &worker) {
+                adopt(worker, fd);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(target.handoffMutex);
+                target.handoff.push_back(fd);
+            }
+
+            uint64_t one = 1;
+            ssize_t ignored = write(target.wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    void adoptHandoff(Worker& worker) {
+        //takes in the connections other workers accepted for this one
+        uint64_t count;
+        ssize_t ignored = read(worker.wakeFd, &count, sizeof(count));
+        (void)ignored;
+
+        {
+            std::lock_guard<std::mutex> lock(worker.handoffMutex);
+            worker.adopting.swap(worker.handoff);
+        }
+
+        for(int fd : worker.adopting) {
+            adopt(worker, fd);
+        }
+        worker.adopting.clear();
+    }
+
+    void adopt(Worker& worker, int fd) {
+        //adds an accepted connection to this worker's epoll set
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+
+        if(epoll_ctl(worker.epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            return;
+        }
+
+        worker.connections.emplace(fd, std::move(connection));
+    }
+
+    void readFrom(Worker& worker, Connection& connection) {
+        //reads up to daemonReadBytes and takes out every whole frame as a request
+        size_t had = connection.input.size();
+        connection.input.resize(had + daemonReadBytes);
+
+        ssize_t got = read(connection.fd, connection.input.data() + had, daemonReadBytes);
+        connection.input.resize(had + (got > 0 ? static_cast<size_t>(got) : 0));
+
+        if(got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+            connection.closing = true;
+        }
+
+        worker.touched.push_back(&connection);
+        connection.passEnd = connection.output.size();
+
+        while(connection.input.size() - connection.parsed >= 4) {
+            const uint8_t* frame = connection.input.data() + connection.parsed;
+            size_t length = loadLittleEndian32(frame);
+
+            if(length < daemonHeaderBytes - 4 || length > daemonMaxFrameBytes) {
+                connection.closing = true;//there is no way to find the next frame
+                break;
+            }
+
+            if(connection.input.size() - connection.parsed < 4 + length) {
+                break;
+            }
+
+            worker.requests.push_back(parse(connection, connection.parsed, length));
+            connection.parsed += 4 + length;
+        }
+    }
+
+    Request parse(Connection& connection, size_t offset, size_t length) {
+        //checks one whole frame and looks up its key, a request that fails the checks is answered with BadRequest
+        const uint8_t* frame = connection.input.data() + offset;
+
+        Request request{};
+        request.connection = &connection;
+        request.operation = static_cast<AESDaemonOperation>(frame[4]);
+        request.status = AESDaemonStatus::BadRequest;
+        request.id = loadLittleEndian32(frame + 8);
+
+        size_t keyLength = frame[5];
+        size_t body = length - (daemonHeaderBytes - 4);
+
+        if(frame[6] != 0 || frame[7] != 0) {
+            return request;//reserved for later use, so nothing that sets it is mistaken for something it is not
+        }
+
+        if(request.operation == AESDaemonOperation::Metrics) {
+            request.status = keyLength == 0 && body == 0 ? AESDaemonStatus::OK : AESDaemonStatus::BadRequest;
+            return request;
+        }
+
+        bool known = request.operation == AESDaemonOperation::CTR || request.operation == AESDaemonOperation::CBCEncrypt ||
+                     request.operation == AESDaemonOperation::CBCDecrypt;
+
+        if(!known || !isValidKeyLength(static_cast<int>(keyLength)) || body < keyLength + 16) {
+            return request;
+        }
+
+        request.iv = offset + daemonHeaderBytes + keyLength;
+        request.in = request.iv + 16;
+        request.length = body - keyLength - 16;
+
+        if(request.operation == AESDaemonOperation::CBCDecrypt && (request.length == 0 || request.length % 16 != 0)) {
+            return request;
+        }
+
+        request.key = keys.get(frame + daemonHeaderBytes, keyLength);
+        request.status = AESDaemonStatus::OK;
+        return request;
+    }
+
+    size_t reservedLength(Worker& worker, const Request& request) {
+        //room the response data needs before the request is processed
+        if(request.status != AESDaemonStatus::OK) {
+            return 0;
+        }
+
+        switch(request.operation) {
+            case AESDaemonOperation::CBCEncrypt:
+                return pkcs7PaddedLength(request.length);
+            case AESDaemonOperation::Metrics:
+                if(worker.metrics.empty()) {
+                    worker.metrics = metricsText();
+                }
+                return worker.metrics.size();
+            default:
+                return request.length;
+        }
+    }
+
+    void answer(Worker& worker) {
+        //runs every request read this pass and queues the responses, then writes out what it can
+        std::vector<Request>& requests = worker.requests;
+
+        //room for every response is made first, so output does not move while the batches write into it
+        for(Request& request : requests) {
+            Connection& connection = *request.connection;
+            size_t start = connection.output.size();
+
+            request.outLength = reservedLength(worker, request);
+            connection.output.resize(start + daemonHeaderBytes + request.outLength);
+            request.out = start + daemonHeaderBytes;
+        }
+
+        worker.order.clear();
+        for(size_t r = 0; r < requests.size(); r++) {
+            if(requests[r].status == AESDaemonStatus::OK && requests[r].operation != AESDaemonOperation::Metrics) {
+                worker.order.push_back(r);
+            }
+        }
+
+        std::sort(worker.order.begin(), worker.order.end(), [&](size_t a, size_t b) {
+            if(requests[a].operation != requests[b].operation) {
+                return requests[a].operation < requests[b].operation;
+            }
+            return requests[a].key.get() < requests[b].key.get();
+        });
+
+        for(size_t first = 0; first < worker.order.size(); ) {
+            size_t last = first + 1;
+            while(last < worker.order.size() && requests[worker.order[last]].operation == requests[worker.order[first]].operation &&
+                  requests[worker.order[last]].key == requests[worker.order[first]].key) {
+                last++;
+            }
+
+            runGroup(worker, first, last);
+            first = last;
+        }
+
+        for(Request& request : requests) {
+            if(request.operation == AESDaemonOperation::Metrics && request.status == AESDaemonStatus::OK) {
+                memcpy(request.connection->output.data() + request.out, worker.metrics.data(), request.outLength);
+            }
+        }
+
+        //responses get their headers and are moved down over room that went unused. A connection's requests are
+        //in the order they arrived, so each one only ever moves towards the start of output
+        for(Request& request : requests) {
+            Connection& connection = *request.connection;
+            uint8_t* header = connection.output.data() + connection.passEnd;
+
+            memmove(header + daemonHeaderBytes, connection.output.data() + request.out, request.outLength);
+
+            storeLittleEndian32(header, static_cast<uint32_t>(daemonHeaderBytes - 4 + request.outLength));
+            header[4] = static_cast<uint8_t>(request.status);
+            header[5] = header[6] = header[7] = 0;
+            storeLittleEndian32(header + 8, request.id);
+
+            connection.passEnd += daemonHeaderBytes + request.outLength;
+        }
+
+        for(Connection* connection : worker.touched) {
+            connection->output.resize(connection->passEnd);
+            connection->input.erase(connection->input.begin(), connection->input.begin() + static_cast<std::ptrdiff_t>(connection->parsed));
+            connection->parsed = 0;
+        }
+
+        requests.clear();
+        worker.metrics.clear();
+
+        for(Connection* connection : worker.touched) {
+            flush(worker, *connection);
+        }
+    }
+
+    void runGroup(Worker& worker, size_t first, size_t last) {
+        //one batch call for requests order[first, last), which share an operation and a key
+        std::vector<Request>& requests = worker.requests;
+        const Request& lead = requests[worker.order[first]];
+        size_t count = last - first;
+
+        worker.records.resize(count);
+        for(size_t i = 0; i < count; i++) {
+            Request& request = requests[worker.order[first + i]];
+            Connection& connection = *request.connection;
+
+            worker.records[i] = {connection.input.data() + request.iv, connection.input.data() + request.in, request.length,
+                                 connection.output.data() + request.out};
+        }
+
+        switch(lead.operation) {
+            case AESDaemonOperation::CTR:
+                ctrEncryptRecords(*lead.key, worker.records.data(), count, nullptr);
+                break;
+            case AESDaemonOperation::CBCEncrypt:
+                cbcEncryptRecords(*lead.key, worker.records.data(), count, nullptr);
+                break;
+            case AESDaemonOperation::CBCDecrypt:
+                worker.plainLengths.resize(count);
+                cbcDecryptRecords(*lead.key, worker.records.data(), count, worker.plainLengths.data(), nullptr);
+
+                for(size_t i = 0; i < count; i++) {
+                    Request& request = requests[worker.order[first + i]];
+
+                    if(worker.plainLengths[i] == invalidRecordLength) {
+                        request.status = AESDaemonStatus::BadPadding;
+                        request.outLength = 0;
+                    }
+                    else {
+                        request.outLength = worker.plainLengths[i];
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void flush(Worker& worker, Connection& connection) {
+        //writes as much output as the socket takes, and watches for room or for input again depending on what is left
+        while(connection.written < connection.output.size()) {
+            ssize_t sent = send(connection.fd, connection.output.data() + connection.written, connection.output.size() - connection.written, MSG_NOSIGNAL);
+
+            if(sent < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                if(errno != EAGAIN) {
+                    connection.closing = true;
+                    connection.output.clear();
+                    connection.written = 0;
+                }
+                break;
+            }
+
+            connection.written += static_cast<size_t>(sent);
+        }
+
+        if(connection.written == connection.output.size()) {
+            connection.output.clear();
+            connection.written = 0;
+        }
+
+        if(connection.closing && connection.output.empty()) {
+            int fd = connection.fd;
+            epoll_ctl(worker.epoll, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            worker.connections.erase(fd);
+            return;
+        }
+
+        bool pending = !connection.output.empty();
+        bool pause = connection.output.size() - connection.written > daemonMaxPendingBytes || connection.closing;
+
+        epoll_event event{};
+        event.events = (pause ? 0u : static_cast<uint32_t>(EPOLLIN)) | (pending ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.fd = connection.fd;
+        epoll_ctl(worker.epoll, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+
+    AESKeyCache keys;
+    std::vector<Worker*> workerList;//every worker of the running daemon, in the order connections are dealt to them
+    std::atomic<size_t> nextWorker{0};//the worker the next accepted connection goes to
+    std::atomic<bool> stopping{false};
+    int listenFd = -1;
+    int stopFd = -1;
+    std::string socketPath;
+};
+
+inline int daemonConnect(const char* path) {
+    //a blocking connection to a daemon's socket, or -1
+    sockaddr_un address{};
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+inline bool daemonRequest(int fd, AESDaemonOperation operation, uint32_t id, const uint8_t* key, size_t keyLength, const uint8_t iv[16],
+                          const uint8_t* in, size_t length, std::vector<uint8_t>& out, AESDaemonStatus& status) {
+    //sends one request tagged with id and waits for its response, whose data replaces out
+    //returns false if the connection fails or the response carries a different id, otherwise status says how the daemon answered
+    size_t body = operation == AESDaemonOperation::Metrics ? 0 : keyLength + 16 + length;
+
+    uint8_t header[daemonHeaderBytes];
+    storeLittleEndian32(header, static_cast<uint32_t>(daemonHeaderBytes - 4 + body));
+    header[4] = static_cast<uint8_t>(operation);
+    header[5] = static_cast<uint8_t>(operation == AESDaemonOperation::Metrics ? 0 : keyLength);
+    header[6] = header[7] = 0;
+    storeLittleEndian32(header + 8, id);
+
+    auto sendAll = [&](const uint8_t* data, size_t bytes) {
+        while(bytes > 0) {
+            ssize_t sent = send(fd, data, bytes, MSG_NOSIGNAL);
+            if(sent <= 0) {
+                if(sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += sent;
+            bytes -= static_cast<size_t>(sent);
+        }
+        return true;
+    };
+
+    auto receiveAll = [&](uint8_t* data, size_t bytes) {
+        while(bytes > 0) {
+            ssize_t got = read(fd, data, bytes);
+            if(got <= 0) {
+                if(got < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += got;
+            bytes -= static_cast<size_t>(got);
+        }
+        return true;
+    };
+
+    if(!sendAll(header, sizeof(header)) || (body > 0 && (!sendAll(key, keyLength) || !sendAll(iv, 16) || !sendAll(in, length)))) {
+        return false;
+    }
+
+    uint8_t response[daemonHeaderBytes];
+    if(!receiveAll(response, sizeof(response))) {
+        return false;
+    }
+
+    size_t responseLength = loadLittleEndian32(response);
+    if(responseLength < daemonHeaderBytes - 4 || responseLength > daemonMaxFrameBytes || loadLittleEndian32(response + 8) != id) {
+        return false;
+    }
+
+    status = static_cast<AESDaemonStatus>(response[4]);
+    out.resize(responseLength - (daemonHeaderBytes - 4));
+
+    return receiveAll(out.data(), out.size());
+}
+
+#endif
+
+#endif
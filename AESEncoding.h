@@ -0,0 +1,545 @@
+// AESEncoding.h
+// Hex and Base64 text encodings for keys, IVs, and ciphertexts
+//
+// - Every encoder and decoder writes to a buffer the caller provides and never allocates
+// - Hex is lowercase on the way out and either case on the way in. Base64 is the standard alphabet from RFC 4648
+//   with = padding, and nothing in between, not even line breaks
+// - Bulk work runs 32 input bytes at a time with AVX2 or 16 at a time with SSSE3, whichever the CPU has,
+//   and the last few bytes go through the scalar code. Every version produces the same text
+// - Decoders check every character and return false on anything outside the alphabet.
+//   They may decode in place, out is never ahead of the text still to be read
+//
+// The vector Base64 code follows the pshufb based method of Wojciech Mula and Daniel Lemire
+
+#ifndef AES_ENCODING_H
+#define AES_ENCODING_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memmove for binary, which is passed through as is
+
+#include "AESCPU.h" //picks the AVX2 or SSSE3 versions, and AES_HAVE_AESNI for x86 builds with intrinsics
+
+enum class AESTextEncoding { Binary, Hex, Base64 };
+
+inline constexpr char hexDigits[] = "0123456789abcdef";
+inline constexpr char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+inline constexpr uint8_t invalidDigit = 0xff;//table entry for a character outside the alphabet
+
+struct AESDigitTable {
+    uint8_t values[256];
+};
+
+constexpr AESDigitTable makeHexTable() {
+    //the value of every hex digit in either case, invalidDigit for every other byte
+    AESDigitTable table = {};
+
+    for(int c = 0; c < 256; c++) {
+        table.values[c] = invalidDigit;
+    }
+    for(int i = 0; i < 10; i++) {
+        table.values['0' + i] = static_cast<uint8_t>(i);
+    }
+    for(int i = 0; i < 6; i++) {
+        table.values['a' + i] = static_cast<uint8_t>(10 + i);
+        table.values['A' + i] = static_cast<uint8_t>(10 + i);
+    }
+
+    return table;
+}
+
+constexpr AESDigitTable makeBase64Table() {
+    //the 6 bit value of every Base64 character, invalidDigit for every other byte including =
+    AESDigitTable table = {};
+
+    for(int c = 0; c < 256; c++) {
+        table.values[c] = invalidDigit;
+    }
+    for(int i = 0; i < 64; i++) {
+        table.values[static_cast<uint8_t>(base64Alphabet[i])] = static_cast<uint8_t>(i);
+    }
+
+    return table;
+}
+
+inline constexpr AESDigitTable hexTable = makeHexTable();
+inline constexpr AESDigitTable base64Table = makeBase64Table();
+
+constexpr size_t hexEncodedLength(size_t length) {
+    return 2 * length;
+}
+
+constexpr size_t base64EncodedLength(size_t length) {
+    return 4 * ((length + 2) / 3);
+}
+
+constexpr size_t base64DecodedMaxLength(size_t textLength) {
+    //room a decode of textLength characters needs, padding can make the result up to two bytes shorter
+    return 3 * (textLength / 4);
+}
+
+constexpr size_t encodedLength(AESTextEncoding encoding, size_t length) {
+    //characters encoding length bytes produces
+    return encoding == AESTextEncoding::Hex ? hexEncodedLength(length) : encoding == AESTextEncoding::Base64 ? base64EncodedLength(length) : length;
+}
+
+inline void hexEncodeScalar(const uint8_t* in, size_t length, char* out) {
+    //two digits per byte, high nibble first
+    for(size_t i = 0; i < length; i++) {
+        out[2 * i] = hexDigits[in[i] >> 4];
+        out[2 * i + 1] = hexDigits[in[i] & 0x0f];
+    }
+}
+
+inline bool hexDecodeScalar(const char* in, size_t textLength, uint8_t* out) {
+    //textLength must be even, returns false at the first character that is not a hex digit
+    for(size_t i = 0; i < textLength / 2; i++) {
+        uint8_t high = hexTable.values[static_cast<uint8_t>(in[2 * i])];
+        uint8_t low = hexTable.values[static_cast<uint8_t>(in[2 * i + 1])];
+
+        if(high == invalidDigit || low == invalidDigit) {
+            return false;
+        }
+
+        out[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+
+    return true;
+}
+
+inline void base64EncodeScalar(const uint8_t* in, size_t length, char* out) {
+    //four characters per three bytes, a short last group is padded with =
+    size_t i = 0;
+
+    for(; i + 3 <= length; i += 3) {
+        uint32_t group = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+
+        out[0] = base64Alphabet[group >> 18];
+        out[1] = base64Alphabet[(group >> 12) & 0x3f];
+        out[2] = base64Alphabet[(group >> 6) & 0x3f];
+        out[3] = base64Alphabet[group & 0x3f];
+        out += 4;
+    }
+
+    if(i < length) {
+        uint32_t group = uint32_t(in[i]) << 16;
+        if(i + 1 < length) {
+            group |= uint32_t(in[i + 1]) << 8;
+        }
+
+        out[0] = base64Alphabet[group >> 18];
+        out[1] = base64Alphabet[(group >> 12) & 0x3f];
+        out[2] = i + 1 < length ? base64Alphabet[(group >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+}
+
+inline bool base64DecodeScalar(const char* in, size_t textLength, uint8_t* out, size_t& outLength) {
+    //textLength must be a multiple of 4, and only the last group may hold padding
+    outLength = 0;
+
+    for(size_t i = 0; i < textLength; i += 4) {
+        bool lastGroup = i + 4 == textLength;
+        int padding = lastGroup && in[i + 3] == '=' ? (in[i + 2] == '=' ? 2 : 1) : 0;
+
+        uint32_t group = 0;
+
+        for(int k = 0; k < 4 - padding; k++) {
+            uint8_t value = base64Table.values[static_cast<uint8_t>(in[i + k])];
+            if(value == invalidDigit) {
+                return false;
+            }
+
+            group |= uint32_t(value) << (18 - 6 * k);
+        }
+
+        out[outLength++] = static_cast<uint8_t>(group >> 16);
+        if(padding < 2) {
+            out[outLength++] = static_cast<uint8_t>(group >> 8);
+        }
+        if(padding < 1) {
+            out[outLength++] = static_cast<uint8_t>(group);
+        }
+    }
+
+    return true;
+}
+
+#if AES_HAVE_AESNI
+
+#define AES_TARGET_SSSE3 __attribute__((target("ssse3,sse2")))
+#define AES_TARGET_AVX2 __attribute__((target("avx2,ssse3,sse2")))
+
+AES_TARGET_SSSE3 inline size_t hexEncodeSSSE3(const uint8_t* in, size_t length, char* out) {
+    //16 bytes to 32 digits per step, each nibble looked up in a register with pshufb. Returns the bytes done
+    const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hexDigits));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    size_t i = 0;
+
+    for(; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+        __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+
+    return i;
+}
+
+AES_TARGET_AVX2 inline size_t hexEncodeAVX2(const uint8_t* in, size_t length, char* out) {
+    //32 bytes to 64 digits per step. The unpacks work within each 128 bit half, so the halves are swapped back into order
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hexDigits)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    size_t i = 0;
+
+    for(; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+        __m256i high = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+        __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, nibble));
+
+        __m256i first = _mm256_unpacklo_epi8(high, low);//digits of bytes 0-7 and 16-23
+        __m256i second = _mm256_unpackhi_epi8(high, low);//digits of bytes 8-15 and 24-31
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+
+    return i;
+}
+
+AES_TARGET_SSSE3 inline __m128i hexValuesSSSE3(__m128i text, __m128i& invalid) {
+    //the value of 16 hex digits, and a mask of the lanes that were not digits
+    //digits and letters are found with one range check each, after folding letters to lowercase
+    __m128i digit = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(text, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+
+    __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(10), digit));
+    __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(6), letter));
+
+    invalid = _mm_or_si128(invalid, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+
+    return _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+AES_TARGET_SSSE3 inline size_t hexDecodeSSSE3(const char* in, size_t textLength, uint8_t* out) {
+    //32 digits to 16 bytes per step, pmaddubsw joins each pair of nibbles. Returns the digits done,
+    //stopping before any step that holds a character that is not a digit
+    const __m128i pair = _mm_set1_epi16(0x0110);//16 times the first digit plus the second
+
+    size_t i = 0;
+
+    for(; i + 32 <= textLength; i += 32) {
+        __m128i invalid = _mm_setzero_si128();
+
+        __m128i first = hexValuesSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), invalid);
+        __m128i second = hexValuesSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16)), invalid);
+
+        if(_mm_movemask_epi8(invalid) != 0) {
+            break;
+        }
+
+        __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(first, pair), _mm_maddubs_epi16(second, pair));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 2), bytes);
+    }
+
+    return i;
+}
+
+AES_TARGET_AVX2 inline __m256i hexValuesAVX2(__m256i text, __m256i& invalid) {
+    //hexValuesSSSE3 for 32 digits
+    __m256i digit = _mm256_sub_epi8(text, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(text, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+
+    __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(digit, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit));
+    __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(letter, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter));
+
+    invalid = _mm256_or_si256(invalid, _mm256_andnot_si256(_mm256_or_si256(isDigit, isLetter), _mm256_set1_epi8(-1)));
+
+    return _mm256_or_si256(_mm256_and_si256(isDigit, digit), _mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+AES_TARGET_AVX2 inline size_t hexDecodeAVX2(const char* in, size_t textLength, uint8_t* out) {
+    //64 digits to 32 bytes per step. The pack works within each 128 bit half, so the 64 bit quarters are put back in order
+    const __m256i pair = _mm256_set1_epi16(0x0110);
+
+    size_t i = 0;
+
+    for(; i + 64 <= textLength; i += 64) {
+        __m256i invalid = _mm256_setzero_si256();
+
+        __m256i first = hexValuesAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), invalid);
+        __m256i second = hexValuesAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32)), invalid);
+
+        if(_mm256_movemask_epi8(invalid) != 0) {
+            break;
+        }
+
+        __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(first, pair), _mm256_maddubs_epi16(second, pair));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 2), _mm256_permute4x64_epi64(bytes, 0xd8));
+    }
+
+    return i;
+}
+
+AES_TARGET_SSSE3 inline __m128i base64IndicesSSSE3(__m128i bytes) {
+    //splits the 12 bytes of each 16 byte lane's three byte groups, already spread one group per 32 bit word
+    //with the middle byte twice, into the four 6 bit indices of each group, one per byte
+    __m128i high = _mm_mulhi_epu16(_mm_and_si128(bytes, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i low = _mm_mullo_epi16(_mm_and_si128(bytes, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(high, low);
+}
+
+AES_TARGET_SSSE3 inline __m128i base64CharactersSSSE3(__m128i indices) {
+    //maps indices 0-63 to the alphabet by adding the offset of the range each one falls in:
+    //A-Z, a-z, 0-9, +, and / each get one entry of a 16 entry offset table picked with pshufb
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+AES_TARGET_SSSE3 inline size_t base64EncodeSSSE3(const uint8_t* in, size_t length, char* out) {
+    //12 bytes to 16 characters per step. Each step loads 16 bytes, so it stops while at least 16 are left.
+    //Returns the bytes done, always a multiple of 3
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+    size_t i = 0;
+
+    for(; i + 16 <= length; i += 12) {
+        __m128i bytes = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), spread);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 3 * 4), base64CharactersSSSE3(base64IndicesSSSE3(bytes)));
+    }
+
+    return i;
+}
+
+AES_TARGET_AVX2 inline size_t base64EncodeAVX2(const uint8_t* in, size_t length, char* out) {
+    //24 bytes to 32 characters per step, 12 bytes in each 128 bit half. The halves are loaded separately,
+    //so each step reads 28 bytes and stops while at least 28 are left
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    size_t i = 0;
+
+    for(; i + 28 <= length; i += 24) {
+        __m256i bytes = _mm256_set_m128i(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        bytes = _mm256_shuffle_epi8(bytes, spread);
+
+        __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i low = _mm256_mullo_epi16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(high, low);
+
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 3 * 4), _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+    }
+
+    return i;
+}
+
+AES_TARGET_SSSE3 inline size_t base64DecodeSSSE3(const char* in, size_t textLength, uint8_t* out) {
+    //16 characters to 12 bytes per step. The characters are checked with two pshufb lookups on their nibbles,
+    //turned into 6 bit values by adding an offset picked by their high nibble, then packed with pmaddubsw and pmaddwd.
+    //Each step stores 16 bytes, so it stops while 24 characters are left, which always decode to at least 16 bytes.
+    //Returns the characters done, stopping before a step with padding or a character outside the alphabet
+    const __m128i checkLow = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i checkHigh = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    size_t i = 0;
+
+    for(; i + 24 <= textLength; i += 16) {
+        __m128i text = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        __m128i high = _mm_and_si128(_mm_srli_epi32(text, 4), nibble);
+        __m128i low = _mm_and_si128(text, nibble);
+
+        __m128i check = _mm_and_si128(_mm_shuffle_epi8(checkLow, low), _mm_shuffle_epi8(checkHigh, high));
+        if(_mm_movemask_epi8(_mm_cmpgt_epi8(check, _mm_setzero_si128())) != 0) {
+            break;
+        }
+
+        __m128i slash = _mm_cmpeq_epi8(text, _mm_set1_epi8('/'));
+        __m128i values = _mm_add_epi8(text, _mm_shuffle_epi8(roll, _mm_add_epi8(slash, high)));
+
+        __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 4 * 3), _mm_shuffle_epi8(groups, gather));
+    }
+
+    return i;
+}
+
+AES_TARGET_AVX2 inline size_t base64DecodeAVX2(const char* in, size_t textLength, uint8_t* out) {
+    //base64DecodeSSSE3 for 32 characters to 24 bytes per step. Each half packs to 12 bytes in place,
+    //then the 32 bit words are moved together. Each step stores 32 bytes, so it stops while 44 characters are left
+    const __m256i checkLow = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i checkHigh = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i gather = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i words = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    size_t i = 0;
+
+    for(; i + 44 <= textLength; i += 32) {
+        __m256i text = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+        __m256i high = _mm256_and_si256(_mm256_srli_epi32(text, 4), nibble);
+        __m256i low = _mm256_and_si256(text, nibble);
+
+        __m256i check = _mm256_and_si256(_mm256_shuffle_epi8(checkLow, low), _mm256_shuffle_epi8(checkHigh, high));
+        if(_mm256_movemask_epi8(_mm256_cmpgt_epi8(check, _mm256_setzero_si256())) != 0) {
+            break;
+        }
+
+        __m256i slash = _mm256_cmpeq_epi8(text, _mm256_set1_epi8('/'));
+        __m256i values = _mm256_add_epi8(text, _mm256_shuffle_epi8(roll, _mm256_add_epi8(slash, high)));
+
+        __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(groups, gather), words);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 4 * 3), packed);
+    }
+
+    return i;
+}
+
+#endif
+
+inline size_t hexEncode(const uint8_t* in, size_t length, char* out) {
+    //writes the 2 * length digits of in to out, which must not overlap it, and returns how many that is
+    size_t done = 0;
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().avx2) {
+        done = hexEncodeAVX2(in, length, out);
+    }
+    else if(cpuFeatures().ssse3) {
+        done = hexEncodeSSSE3(in, length, out);
+    }
+#endif
+
+    hexEncodeScalar(in + done, length - done, out + 2 * done);
+    return hexEncodedLength(length);
+}
+
+inline bool hexDecode(const char* in, size_t textLength, uint8_t* out, size_t& outLength) {
+    //decodes textLength digits into textLength / 2 bytes of out, which may be in itself
+    //returns false if textLength is odd or any character is not a hex digit, out may be partly written
+    if(textLength % 2 != 0) {
+        return false;
+    }
+
+    size_t done = 0;
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().avx2) {
+        done = hexDecodeAVX2(in, textLength, out);
+    }
+    else if(cpuFeatures().ssse3) {
+        done = hexDecodeSSSE3(in, textLength, out);
+    }
+#endif
+
+    outLength = textLength / 2;
+    return hexDecodeScalar(in + done, textLength - done, out + done / 2);
+}
+
+inline size_t base64Encode(const uint8_t* in, size_t length, char* out) {
+    //writes the base64EncodedLength(length) characters of in to out, which must not overlap it, and returns how many that is
+    size_t done = 0;
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().avx2) {
+        done = base64EncodeAVX2(in, length, out);
+    }
+    else if(cpuFeatures().ssse3) {
+        done = base64EncodeSSSE3(in, length, out);
+    }
+#endif
+
+    base64EncodeScalar(in + done, length - done, out + done / 3 * 4);
+    return base64EncodedLength(length);
+}
+
+inline bool base64Decode(const char* in, size_t textLength, uint8_t* out, size_t& outLength) {
+    //decodes textLength characters into out, which needs base64DecodedMaxLength(textLength) bytes and may be in itself.
+    //outLength gets the decoded length
+    //returns false if textLength is not a multiple of 4, or there is a character outside the alphabet or misplaced padding
+    if(textLength % 4 != 0) {
+        return false;
+    }
+
+    size_t done = 0;
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().avx2) {
+        done = base64DecodeAVX2(in, textLength, out);
+    }
+    else if(cpuFeatures().ssse3) {
+        done = base64DecodeSSSE3(in, textLength, out);
+    }
+#endif
+
+    size_t tailLength = 0;
+    bool ok = base64DecodeScalar(in + done, textLength - done, out + done / 4 * 3, tailLength);
+
+    outLength = done / 4 * 3 + tailLength;
+    return ok;
+}
+
+inline size_t encodeText(AESTextEncoding encoding, const uint8_t* in, size_t length, char* out) {
+    //writes in to out in the given encoding, Binary copies it as is, and returns the characters written
+    switch(encoding) {
+        case AESTextEncoding::Hex:
+            return hexEncode(in, length, out);
+        case AESTextEncoding::Base64:
+            return base64Encode(in, length, out);
+        default:
+            memcpy(out, in, length);
+            return length;
+    }
+}
+
+inline bool decodeText(AESTextEncoding encoding, const char* in, size_t textLength, uint8_t* out, size_t& outLength) {
+    //decodes text written by encodeText, out may be in itself
+    switch(encoding) {
+        case AESTextEncoding::Hex:
+            return hexDecode(in, textLength, out, outLength);
+        case AESTextEncoding::Base64:
+            return base64Decode(in, textLength, out, outLength);
+        default:
+            memmove(out, in, textLength);
+            outLength = textLength;
+            return true;
+    }
+}
+
+#endif
@@ -2,101 +2,88 @@
 // Employs the AESEncryption Scheme for a given string input from the user
 //
 // - Integers are stored as unsigned 8 bit integers for the sake of memory and keeing values in mod 255
-// - For strings whos lengths are not a multiple of 16, it will padd the string to be a valid length by using 0's until it reaches a valid length
-// - Currently uses the ECB Chaining mode, meaning the string gets split up into blocks of 16 and the key is used individually on each block
+// - Messages are padded with PKCS#7, which adds 1 to 16 bytes that each hold the number of bytes added, so it can be undone exactly
+// - Typed messages use the CBC Chaining mode, each block is XOR'ed with the previous encrypted block before it is encrypted,
+//   and the first block with a random initialization vector from the AES CTR_DRBG generator in AESDRBG.h
+// - Each message is decrypted again after it is encrypted, to show the round trip
+// - Run with arguments to stream files or pipes through CTR mode instead of typing a message, see printUsage
+// - Run with --daemon SOCKET to serve encryption requests from other local processes, see AESDaemon.h
+// - Ciphertext is shown as hex blocks and as one Base64 string, and streams can be written as hex or Base64 text
+// - Build with -DAES_TRACE=1 to print the state after every round to stderr, see AESTrace.h
 // 
 // Next Steps:
-// - Look into different message padding methods, as Zero padding is very bare. Look into benefits of each
-// - Implement the option to select different chaining modes (CBC, CFB, OFB, CTR) and use initialization vectors
-// - Add decrpyter
-// - Add unit tests and look for edge cases
-// - Put output into strings of hex values
-// - Put output into different formats such as base 64
+// - Implement the option to select the remaining chaining modes (CFB, OFB)
 
 #include <iostream> //used for input and output from the user
 #include <string> //string objects and  methods used for getting bytes and info from input
-#include <iomanip>  //used for printing outputs in certain bases and manners
-#include <Eigen/Dense> //used to hold the matrices of information. You can find it here: https://eigen.tuxfamily.org/index.php?title=Main_Page and just put it in your include path
-#include <vector> //used to hold vectors of various object types (ints, vectors, matrices)
-#include <cmath> //used for pow when calculating the rounding constant
+#include <vector> //used to hold vectors of various object types (ints, vectors, states)
+#include <cstdio> //FILE streams for the streaming mode
+#include <csignal> //stopping the daemon on SIGINT and SIGTERM
+#include <cstdlib> //atoi for the daemon's thread count
+#include <thread> //hardware_concurrency for the daemon's default thread count
+#include <cerrno> //why the daemon socket could not be made
+#include <cstring> //strerror for the daemon socket and mapped files
+
+#include "AESCore.h" //packed 16 byte state, the S-box and the round steps that run on it
+#include "AESKeySchedule.h" //key expansion into a reusable key context
+#include "AESEngine.h" //picks the table or AES-NI engine for this CPU
+#include "AESStream.h" //CTR over files and pipes in bounded memory
+#include "AESMappedFile.h" //CTR straight between memory mapped files
+#include "AESDaemon.h" //the Unix domain socket service
+#include "AESCBC.h" //CBC chaining and PKCS#7 padding for typed messages
+#include "AESMetrics.h" //the --metrics report
+#include "AESEncoding.h" //hex and Base64 output
+#include "AESDRBG.h" //initialization vectors from the CTR_DRBG generator
 
 
 using namespace std;
-using namespace Eigen;
 
 
 
-void printVectorOfVectors(const vector<vector<uint8_t>>& vec) {
-    //prints each element of each vector in the vector of vectors in hexadecimal. Used in debugging
-    for (const auto& innerVec : vec) {
-        for (const auto& element : innerVec) {
-            cout << hex << setw(2) << setfill('0') << static_cast<int>(element) << " ";
-        }
-        cout << endl;
-    }
-}
+void printBlocksInHex(const vector<AESState>& blocks) {
+    //prints each block on its own line in hex, in the order the bytes come out of the cipher
+    char digits[32];
 
-void printMatrixInHex(Matrix4d ourMat) {
-    //prints out a matrix in hex. Used for state matrix debugging and correction
-    for(int k = 0; k < 4; k++) {
-        for(int j = 0; j < 4; j++) {
-            cout << hex << setw(2) << setfill('0') << static_cast<int>(ourMat(k, j)) << " ";
-        }
-        cout << endl;
+    for(const auto& block : blocks) {
+        hexEncode(block.bytes, 16, digits);
+        cout.write(digits, 32) << endl;
     }
 }
 
-void printVectorOfMatrices(const vector<Matrix4d>& ourMat) {
-    //prints out each matrix in a vector, used for printing out the final encrypted vector of matrices
-    for(const auto& mat: ourMat) {
-        printMatrixInHex(mat);
-        cout << endl;
-    }
-}
+void printBase64(const uint8_t* data, size_t length) {
+    //prints data as one line of Base64
+    string text(base64EncodedLength(length), '\0');
+    base64Encode(data, length, &text[0]);
 
-bool isValidKeyLength(int keyLength) {
-    // Returns a boolean on whether the given key length is valid for one of the AES Schema
-    return (keyLength == 16 || keyLength == 24 || keyLength == 32);
+    cout << text << endl;
 }
 
-string addZeroPadding(string initInput) {
+string addPKCS7Padding(const string& initInput) {
     // Adds padding onto the end of the string to make the information able to be put into blocks of size 16
-    if(initInput.length() % 16 == 0) {
-        return initInput; //returns the input if its a multiple of 16
-    }
+    // There is always at least one byte of padding, so a message that is already a multiple of 16 gets a whole extra block
 
-    int diff = 16 - (initInput.length() % 16);// finds how far the message length is from a multiple of 16
+    uint8_t lastBlock[16];
 
-    string messageCopy = initInput; //creates a copy of our given message
+    size_t whole = initInput.length() - (initInput.length() % 16);// the length of the blocks that are already full
 
-    for(int i = 0; messageCopy.length() < 16; i++) {
-        //This loop adds 0's onto the end of the string until it is the appropriate length
-        messageCopy += '0';
-    }
+    pkcs7PadBlock(reinterpret_cast<const uint8_t*>(initInput.data()) + whole, initInput.length() - whole, lastBlock);
 
-    return messageCopy;
+    return initInput.substr(0, whole) + string(reinterpret_cast<const char*>(lastBlock), 16);
 
 }
 
-Matrix4d stringToMatrix(string paddedMessage) {
-    //Takes a strings char ascii values and puts them in a matrix for the AES Schema
-
-    Matrix4d fourBlock;//initializes an empty 4x4 matrix;
-    
-    int ind = 0;//index variable to let us iterate over the string
-    
-    for(int i = 0; i < 4; i++) {
-        for(int j = 0; j < 4; j++) {           
-            fourBlock(j, i) = static_cast<uint8_t>(paddedMessage[ind]);//casts the ascii value to an 8 bit unsigned integer
-            ind++;
-        }
-    }
+AESState stringToMatrix(const string& paddedMessage, size_t offset) {
+    //Takes 16 of a strings char ascii values starting at offset and puts them in a state for the AES Schema
+    //The state is column major, so the bytes can be copied straight across
 
+    AESState fourBlock;//initializes an empty 16 byte state
+
+    memcpy(fourBlock.bytes, paddedMessage.data() + offset, 16);
 
     return fourBlock;
 }
 
-vector<uint8_t> stringToVector(string ourStr) {
+vector<uint8_t> stringToVector(const string& ourStr) {
     //Takes a string and put its ascii char values into a vector
     //Used to seperate our key for the creation of the key schedule
 
@@ -113,324 +100,264 @@ vector<uint8_t> stringToVector(string ourStr) {
 
 } 
 
-vector<uint8_t> keyGenShift(vector<uint8_t> ourVec, int s[], int round) {
-    //Every 4th key in the generation of a key schedule will undergo a transformation before being XOR'ed with key i - 4
-    //This involves a process of
-    //  shifting bytes
-    //  subbing bytes
-    //  and adding a round constant based on the round number
-
-    vector<uint8_t> v; //initialized the vector that will hold our transformed bytes
-
-    double rConD = pow(2.0, static_cast<double>(round - 1));//calculates the round constant
+void printUsage(const char* program) {
+    //describes the streaming mode arguments
+    cerr << "Usage: " << program << " (--encrypt | --decrypt) (--key KEY | --key-file PATH) [--in PATH] [--out PATH] [--mmap] [--format binary|hex|base64] [--metrics]" << endl;
+    cerr << "  Streams the input through AES in CTR mode. Input defaults to stdin and output to stdout" << endl;
+    cerr << "  --mmap maps both files into memory instead of streaming them, it needs --in and --out to be two different files and the binary format" << endl;
+    cerr << "  --key takes 16, 24, or 32 characters, --key-file reads a file holding 16, 24, or 32 raw bytes" << endl;
+    cerr << "  --format hex or base64 writes the counter block and the ciphertext as two lines of text, and --decrypt reads them back" << endl;
+    cerr << "  --metrics prints what was encrypted, by engine and mode, to stderr at the end in the Prometheus text format" << endl;
+    cerr << "  Encrypted output starts with the 16 byte initial counter block, which --decrypt reads back" << endl;
+    cerr << "  Run with no arguments to type messages in interactively" << endl;
+#if AES_HAVE_DAEMON
+    cerr << "Or: " << program << " --daemon SOCKET [--threads N]" << endl;
+    cerr << "  Serves CTR and CBC requests from other processes on the Unix domain socket SOCKET until interrupted" << endl;
+#endif
+}
 
-    uint8_t rCon = static_cast<uint8_t>(rConD);//puts the round constant into an unsigned 8 bit integer
+bool readKeyFile(const char* path, vector<uint8_t>& key) {
+    //reads a whole key file, returns false if it cannot be opened or is not a valid key length
+    FILE* file = fopen(path, "rb");
 
-    if(rConD == 256) {
-        rCon = 0x1b;// This is 0x80 * 2 under the galois field GF(2^8)
+    if(file == nullptr) {
+        return false;
     }
 
-    if(rConD == 512) {
-        rCon = 0x36;//This is 0x1b * 2 under the galois field GF(2^8)
-    }
+    uint8_t buffer[33];
+    size_t length = fread(buffer, 1, sizeof(buffer), file);
 
-    for(int i = 0; i < ourVec.size(); i++) {
-        v.push_back(ourVec[(i + 1) % ourVec.size()]);// this loop shifts everything in the vector left one
-    } 
+    fclose(file);
 
-    for(int j = 0; j < ourVec.size(); j++) {
-        v[j] = s[v[j]];//this puts each component of our vector through the Rjindael sBox
-    } 
- 
-    v[0] = v[0] ^ rCon;//XOR's our new vector with the round constant, resulting in our new vector 
-    
-    return v;
+    key.assign(buffer, buffer + length);
 
+    return isValidKeyLength(length);
 }
 
-vector<uint8_t> vectorXOR(vector<uint8_t> v1, vector<uint8_t> v2) {
-    //conducts element wise XOR on two vectors and returns the result
-    //mainly used for code cleanliness
-    
-    vector<uint8_t> v;
+int runStreamMode(int argc, char* argv[]) {
+    //encrypts or decrypts a file or pipe without holding it in memory, returns the exit status for main
 
-    for(int i = 0; i < v1.size(); i++) {
-        v.push_back(v1[i] ^ v2[i]);//XOR's respective elements of two vectors
-    }
+    bool encrypt = false;
+    bool decrypt = false;
+    vector<uint8_t> keyBytes;
+    const char* inPath = nullptr;
+    const char* outPath = nullptr;
+    bool mapped = false;
+    bool metrics = false;
+    AESTextEncoding encoding = AESTextEncoding::Binary;
 
-    return v;
-}
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
 
-vector<vector<uint8_t>> createKeys(vector<uint8_t> keyVec, int s[]) {
-    //creates a key schedule based on the initial key
-    //generates 44 keys for aes128
-    //generates 52 keys for aes192
-    //generates 60 keys for aes256
-    
-    vector<vector<uint8_t>> v;//initializes our vector to hold our key schedule
-
-    int size = keyVec.size();//gets the key size that will help us determine the encryption parameters
-
-    int max;//initializes a variable to count the amount of keys we will need
-
-    int Nk;//initializes a key count variable to get our initial key rounds
-
-    int round = 1;//round variable that increments the round associated with the key to calculate the proper round constant in keyGenShift
-
-    
-    switch (size) {
-        //switch statement to determine the key size parameters (for 128, 192, or 256)
-        case 16:
-            max = 44;
-            Nk = 4;
-            break;
-        case 24:
-            max = 52;
-            Nk = 6;
-            break;
-        case 32:
-            max = 60;
-            Nk = 8;
-            break;
-        default:
-            //should never be reached but will let know if so
-            cout << "False key size" << endl;
-            break;
-    }
-
-    //The below will initialize our first Nk round keys
-
-    vector<uint8_t> roundKeyVec;//temp vec variable to put key vectors into our round keys
-
-    for(int i = 0; i < (Nk * 4); i += 4) {
-
-        roundKeyVec.push_back(keyVec[i]);
-        roundKeyVec.push_back(keyVec[i+1]);
-        roundKeyVec.push_back(keyVec[i+2]);
-        roundKeyVec.push_back(keyVec[i+3]);
-
-        v.push_back(roundKeyVec);
+        if(arg == "--encrypt") {
+            encrypt = true;
+        }
+        else if(arg == "--decrypt") {
+            decrypt = true;
+        }
+        else if(arg == "--key" && hasValue) {
+            keyBytes = stringToVector(argv[++i]);
+        }
+        else if(arg == "--key-file" && hasValue) {
+            if(!readKeyFile(argv[++i], keyBytes)) {
+                cerr << "Could not read a 16, 24, or 32 byte key from " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if(arg == "--in" && hasValue) {
+            inPath = argv[++i];
+        }
+        else if(arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        }
+        else if(arg == "--mmap" && AES_HAVE_MMAP) {
+            mapped = true;
+        }
+        else if(arg == "--metrics") {
+            metrics = true;
+        }
+        else if(arg == "--format" && hasValue) {
+            string format = argv[++i];
 
-        roundKeyVec.clear();
+            if(format == "hex") {
+                encoding = AESTextEncoding::Hex;
+            }
+            else if(format == "base64") {
+                encoding = AESTextEncoding::Base64;
+            }
+            else if(format != "binary") {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
+    if(encrypt == decrypt || !isValidKeyLength(keyBytes.size())) {
+        printUsage(argv[0]);
+        return 1;
     }
 
-    vector<uint8_t> gVec = keyGenShift(v[v.size() - 1], s, round);// gVec is the variable that will hold any vector that goes through keyGen shift
+    if(mapped && (inPath == nullptr || outPath == nullptr || encoding != AESTextEncoding::Binary)) {
+        printUsage(argv[0]);
+        return 1;
+    }
 
+    AESKeyContext keyContext;
+    prepareKey(keyContext, keyBytes.data(), keyBytes.size());
 
-    if(max == 44) {
-        while(v.size() < max) {
-            //notes will notate for the first round and the rest should follow
-            v.push_back(vectorXOR(v[v.size() - 4], gVec)); //this does xor on w_0 and g(w_3) and creates w_4
-            v.push_back(vectorXOR(v[v.size() - 4], v[v.size() - 1])); //does xor on w1 and w4 creating w5
-            v.push_back(vectorXOR(v[v.size() - 4], v[v.size() - 1])); //does xor on w2 and w5 creating w6
-            v.push_back(vectorXOR(v[v.size() - 4], v[v.size() - 1])); //does xor on w3 and w6 creating w7
+#if AES_HAVE_MMAP
+    if(mapped) {
+        //the files are never copied through a buffer, the cipher reads and writes the mapped pages directly
+        AESMappedFileError error;
+        bool ok = encrypt ? ctrEncryptMappedFile(keyContext, inPath, outPath, &error) : ctrDecryptMappedFile(keyContext, inPath, outPath, &error);
 
-            round++; // increases round value
+        if(!ok) {
+            cerr << (encrypt ? "Could not encrypt " : "Could not decrypt ") << inPath << " into " << outPath << ": " << error.step;
+            if(error.error != 0) {
+                cerr << " (" << strerror(error.error) << ")";
+            }
+            cerr << endl;
+            return 1;
+        }
 
-            gVec = keyGenShift(v[v.size() - 1], s, round); // creates the next gvector to be used in generating the next word
-            
-            //wraps around to append w_4 XOR g(w_7)
+        if(metrics) {
+            cerr << metricsText();
         }
-    }
-    if(max == 52) {
-        while(v.size() < max) {
-            //notes will notate for the first round and the rest should follow
-            v.push_back(vectorXOR(v[v.size() - 6], gVec)); //this does xor on w_0 and g(w_5) and creates w_6
-            v.push_back(vectorXOR(v[v.size() - 6], v[v.size() - 1])); //does xor on w1 and w6 creating w7
-            v.push_back(vectorXOR(v[v.size() - 6], v[v.size() - 1])); //does xor on w2 and w7 creating w8
-            v.push_back(vectorXOR(v[v.size() - 6], v[v.size() - 1])); //does xor on w3 and w8 creating w9
-            v.push_back(vectorXOR(v[v.size() - 6], v[v.size() - 1])); //does xor on w4 and w9 creating w10
-            v.push_back(vectorXOR(v[v.size() - 6], v[v.size() - 1])); //does xor on w5 and w10 creating w11
 
-            round++; // increases round value
+        return 0;
+    }
+#endif
 
-            gVec = keyGenShift(v[v.size() - 1], s, round); // creates the next gvector to be used in generating the next word
-            
+    FILE* in = inPath ? fopen(inPath, "rb") : stdin;
+    if(in == nullptr) {
+        cerr << "Could not open " << inPath << " for reading" << endl;
+        return 1;
+    }
 
+    FILE* out = outPath ? fopen(outPath, "wb") : stdout;
+    if(out == nullptr) {
+        cerr << "Could not open " << outPath << " for writing" << endl;
+        if(in != stdin) {
+            fclose(in);
         }
+        return 1;
     }
-    if(max == 60) {
-        vector<uint8_t> tempVec;
-        vector<uint8_t> tempVec2;
-        //temp vector variables to handle the differences with AES256 usage of subBytes
-        while(v.size() < max) {
-            v.push_back(vectorXOR(v[v.size() - 8], gVec)); //this does xor on w_0 and g(w_7) and creates w_8
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w1 and w8 creating w9
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w2 and w9 creating w10
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w3 and w10 creating w11
-            tempVec2 = v[v.size() - 1];
-            for(int j = 0; j < 4; j++) {
-                tempVec.push_back(static_cast<uint8_t>(s[tempVec2[j]])); // creates the subByte vector on w11 
-            }
-            tempVec2.clear();
-            v.push_back(vectorXOR(v[v.size() - 8], tempVec)); //does xor on w4 and sub(w11) creating w12
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w3 and w12 creating w13
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w4 and w13 creating w14
-            v.push_back(vectorXOR(v[v.size() - 8], v[v.size() - 1])); //does xor on w5 and w14 creating w15
-
-            round++; // increases round value
 
-            tempVec.clear();
+    bool ok = encrypt ? ctrEncryptStream(keyContext, in, out, encoding) : ctrDecryptStream(keyContext, in, out, encoding);
 
-            gVec = keyGenShift(v[v.size() - 1], s, round); // creates the next gvector to be used in generating the next word
-        }
+    if(in != stdin) {
+        fclose(in);
+    }
+    if(out != stdout && fclose(out) != 0) {
+        ok = false;
     }
 
-    return v;
-    
-}
+    if(!ok) {
+        cerr << (encrypt ? "Encryption" : "Decryption") << " failed while reading, decoding, or writing" << endl;
+        return 1;
+    }
 
-int galois2x(int num) {
-    //computes multiplication by 2 under GF(2^8)
-    int value = num << 1;
-    if (num & 0x80) {
-        value ^= 0x1b;
+    if(metrics) {
+        cerr << metricsText();
     }
-    return (value);
-}
 
-int galois3x(int num) {
-    //computes multiplication by 3 under GF(2^8)
-    return (galois2x(num) ^ num);
+    return 0;
 }
 
-Matrix4d subBytes(Matrix4d ourMat, int s[]) {
-    //uses the Rjindael S-Box on our whole state matrix
+#if AES_HAVE_DAEMON
+AESDaemon* runningDaemon = nullptr;//for the signal handler
 
-    Matrix4d matCopy = ourMat;
-
-    for(int i = 0; i < 4; i++) {
-        for(int j = 0; j < 4; j++) {
-            matCopy(j, i) = s[static_cast<int>(matCopy(j, i))];
-        }
+void stopDaemon(int) {
+    //SIGINT and SIGTERM stop the daemon, which removes its socket on the way out
+    if(runningDaemon != nullptr) {
+        runningDaemon->stop();
     }
-
-    return matCopy;
-
 }
 
-Matrix4d shiftRows(Matrix4d ourMat) {
-    //shifts rows according to the aes schema
-    //
-    // a b c d
-    // e f g h
-    // i j k l
-    // m n o p
-    //
-    // becomes
-    //
-    // a b c d
-    // h e f g
-    // k l i j
-    // n o p m
-    
-    Matrix4d matCopy = ourMat;
-
-    matCopy.row(1) << ourMat(1, 1), ourMat(1, 2), ourMat(1, 3), ourMat(1, 0);
-    matCopy.row(2) << ourMat(2, 2), ourMat(2, 3), ourMat(2, 0), ourMat(2, 1);
-    matCopy.row(3) << ourMat(3, 3), ourMat(3, 0), ourMat(3, 1), ourMat(3, 2);
-    
-
-    return matCopy;
-}
+int runDaemonMode(int argc, char* argv[]) {
+    //serves requests on the socket named after --daemon until a signal stops it, returns the exit status for main
+    const char* socketPath = argv[2];
+    unsigned threads = thread::hardware_concurrency() ? thread::hardware_concurrency() : 1;
 
-Matrix4d mixColumns(Matrix4d ourMat) {
-    //Utilizes a special kind of multiplication with polynomials defined under GF(2^8)
-    Matrix4d matCopy = ourMat;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
 
-    for(int i = 0; i < 4; i++) {
-        for(int j = 0; j < 4; j++) {
-            if(j == 0) {
-                matCopy(j, i) = static_cast<uint8_t>(galois2x(static_cast<int>(ourMat(0, i))) ^ galois3x(static_cast<int>(ourMat(1, i))) ^ static_cast<int>(ourMat(2, i)) ^ static_cast<int>(ourMat(3, i)));
-            }
-            if(j == 1) {
-                matCopy(j, i) = static_cast<uint8_t>(static_cast<int>(ourMat(0, i)) ^ galois2x(static_cast<int>(ourMat(1, i))) ^ galois3x(static_cast<int>(ourMat(2, i))) ^ static_cast<int>(ourMat(3, i)));
-            }
-            if(j == 2) {
-                matCopy(j, i) = static_cast<uint8_t>(static_cast<int>(ourMat(0, i)) ^ static_cast<int>(ourMat(1, i)) ^ galois2x(static_cast<int>(ourMat(2, i))) ^ galois3x(static_cast<int>(ourMat(3, i))));
-            }
-            if(j == 3) {
-                matCopy(j, i) = static_cast<uint8_t>(galois3x(static_cast<int>(ourMat(0, i))) ^ static_cast<int>(ourMat(1, i)) ^ static_cast<int>(ourMat(2, i)) ^ galois2x(static_cast<int>(ourMat(3, i))));
-            }
+        if(arg == "--threads" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            threads = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
         }
     }
 
-    return matCopy;
-}
+    AESDaemon daemon;
 
-Matrix4d addRoundKey(Matrix4d ourMat, vector<vector<uint8_t>> keySection) {
-    //adds round key to our state matrix based on the selected key section
+    if(!daemon.listen(socketPath)) {
+        cerr << "Could not listen on " << socketPath << ": " << (errno == EADDRINUSE ? "already in use by a running daemon" : strerror(errno)) << endl;
+        return 1;
+    }
 
-    Matrix4d matCopy = ourMat;
+    runningDaemon = &daemon;
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
 
-    vector<uint8_t> currVec;
+    cerr << "Serving on " << socketPath << " with " << threads << " threads and the " << activeEngine().name << " engine" << endl;
 
-    for(int i = 0; i < 4; i++) {
-        currVec = keySection[i];
-        for(int j = 0; j < 4; j++) {
-            matCopy(j, i) = static_cast<int>(matCopy(j, i)) ^ currVec[j];
-        }
-    }
+    bool served = daemon.run(threads);
 
-    return matCopy;
+    //the handlers go before the daemon does, so a late signal cannot reach it
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    runningDaemon = nullptr;
 
+    return served ? 0 : 1;
 }
+#endif
 
-int main() {
+int main(int argc, char* argv[]) {
 
-    bool flag = true; //sets flag for repeated usage of the encrypter
+#if AES_HAVE_DAEMON
+    if(argc > 2 && string(argv[1]) == "--daemon") {
+        return runDaemonMode(argc, argv);
+    }
+#endif
+
+    if(argc > 1) {
+        return runStreamMode(argc, argv);//arguments select the streaming mode, otherwise messages are typed in
+    }
 
-    int s[256] =  
-    {0x63 ,0x7c ,0x77 ,0x7b ,0xf2 ,0x6b ,0x6f ,0xc5 ,0x30 ,0x01 ,0x67 ,0x2b ,0xfe ,0xd7 ,0xab ,0x76
-    ,0xca ,0x82 ,0xc9 ,0x7d ,0xfa ,0x59 ,0x47 ,0xf0 ,0xad ,0xd4 ,0xa2 ,0xaf ,0x9c ,0xa4 ,0x72 ,0xc0
-    ,0xb7 ,0xfd ,0x93 ,0x26 ,0x36 ,0x3f ,0xf7 ,0xcc ,0x34 ,0xa5 ,0xe5 ,0xf1 ,0x71 ,0xd8 ,0x31 ,0x15
-    ,0x04 ,0xc7 ,0x23 ,0xc3 ,0x18 ,0x96 ,0x05 ,0x9a ,0x07 ,0x12 ,0x80 ,0xe2 ,0xeb ,0x27 ,0xb2 ,0x75
-    ,0x09 ,0x83 ,0x2c ,0x1a ,0x1b ,0x6e ,0x5a ,0xa0 ,0x52 ,0x3b ,0xd6 ,0xb3 ,0x29 ,0xe3 ,0x2f ,0x84
-    ,0x53 ,0xd1 ,0x00 ,0xed ,0x20 ,0xfc ,0xb1 ,0x5b ,0x6a ,0xcb ,0xbe ,0x39 ,0x4a ,0x4c ,0x58 ,0xcf
-    ,0xd0 ,0xef ,0xaa ,0xfb ,0x43 ,0x4d ,0x33 ,0x85 ,0x45 ,0xf9 ,0x02 ,0x7f ,0x50 ,0x3c ,0x9f ,0xa8
-    ,0x51 ,0xa3 ,0x40 ,0x8f ,0x92 ,0x9d ,0x38 ,0xf5 ,0xbc ,0xb6 ,0xda ,0x21 ,0x10 ,0xff ,0xf3 ,0xd2
-    ,0xcd ,0x0c ,0x13 ,0xec ,0x5f ,0x97 ,0x44 ,0x17 ,0xc4 ,0xa7 ,0x7e ,0x3d ,0x64 ,0x5d ,0x19 ,0x73
-    ,0x60 ,0x81 ,0x4f ,0xdc ,0x22 ,0x2a ,0x90 ,0x88 ,0x46 ,0xee ,0xb8 ,0x14 ,0xde ,0x5e ,0x0b ,0xdb
-    ,0xe0 ,0x32 ,0x3a ,0x0a ,0x49 ,0x06 ,0x24 ,0x5c ,0xc2 ,0xd3 ,0xac ,0x62 ,0x91 ,0x95 ,0xe4 ,0x79
-    ,0xe7 ,0xc8 ,0x37 ,0x6d ,0x8d ,0xd5 ,0x4e ,0xa9 ,0x6c ,0x56 ,0xf4 ,0xea ,0x65 ,0x7a ,0xae ,0x08
-    ,0xba ,0x78 ,0x25 ,0x2e ,0x1c ,0xa6 ,0xb4 ,0xc6 ,0xe8 ,0xdd ,0x74 ,0x1f ,0x4b ,0xbd ,0x8b ,0x8a
-    ,0x70 ,0x3e ,0xb5 ,0x66 ,0x48 ,0x03 ,0xf6 ,0x0e ,0x61 ,0x35 ,0x57 ,0xb9 ,0x86 ,0xc1 ,0x1d ,0x9e
-    ,0xe1 ,0xf8 ,0x98 ,0x11 ,0x69 ,0xd9 ,0x8e ,0x94 ,0x9b ,0x1e ,0x87 ,0xe9 ,0xce ,0x55 ,0x28 ,0xdf
-    ,0x8c ,0xa1 ,0x89 ,0x0d ,0xbf ,0xe6 ,0x42 ,0x68 ,0x41 ,0x99 ,0x2d ,0x0f ,0xb0 ,0x54 ,0xbb ,0x16}; //S-box: maps bute values from 0 to 255 to a new value under Rijndaels finite field
-    // This and the shift columns function are based in galois theory with a polynomial interpretation
+    bool flag = true; //sets flag for repeated usage of the encrypter
 
     string key; //initializes our key variable
 
     string message; //initializes our message variable
 
-    string paddedMessage;
-
-    int front; //These front and back variables let us grab parts of our key 4 bytes at a time
-    int back; //to use in the addRoundKey function
-
-    int rounds; //initializes our round count variable for determining how many loops aes will do
+    string paddedMessage; //the message after PKCS#7 padding, always a multiple of 16 long
 
-    Matrix4d state; //initializes our matrix that our message will be stored and mixed in
+    uint8_t iv[16]; //initialization vector for CBC, new for every message
 
     vector<uint8_t> inputVec; //initializes the vector that will turn our key into bytes
 
-    vector<vector<uint8_t>> keyVec; //initializes the vector that will hold all of our keys during the key generation process
+    AESKeyContext keyContext; //holds the expanded key schedule, round key r is keyContext.roundKey(r)
 
-    vector<vector<uint8_t>> keySection; //initializes the vector that will hold the keys used in addRoundKey
+    string expandedKey; //the key that keyContext was last expanded from, so a repeated key is not expanded again
 
-    vector<Matrix4d> matVec; //matrix to hold all of the 16 byte blocks of our initial string
+    vector<AESState> matVec; //vector to hold all of the 16 byte blocks of our initial string
 
-    vector<Matrix4d> encVec; //matrix to hold all of our encrypted matrices
+    vector<AESState> encVec; //vector to hold all of our encrypted states
+
+    vector<AESState> decVec; //vector to hold the states decrypted back out of encVec
 
     string cont; //cont variable to see if people want to continue
 
     while(flag) {
 
-        front = 0;//Resets front to 0 upon looping
-        back = 3;//Resets back to 3 upon looping
-        //These let us index back to the first 4 parts of our key
-
         cout << "Input Message: " << endl;
 
         getline(cin, message);//Prompts user to input message as a string
@@ -449,18 +376,15 @@ int main() {
         }
 
         switch (key.length()) {
-            //This switch statement sets the number of rounds
+            //This switch statement reports which AES variant the key selects
             case 16:
                 cout << "Starting AES128" << endl;
-                rounds = 10;
                 break;
             case 24:
                 cout << "Starting AES192" << endl;
-                rounds = 12;
                 break;
             case 32:
                 cout << "Starting AES256" << endl;
-                rounds = 14;
                 break;
             default:
                 cout << "Invalid Key Length" << endl;
@@ -470,100 +394,70 @@ int main() {
         //Message: Two One Nine Two
         //Key: Thats my Kung Fu
 
-        for(int k = 0; k < (message.length() / 16); k++) {
-            matVec.push_back(stringToMatrix(message.substr(16 * k, 16)));// adds the blocks in 16 byte chunks into the vector of matrices
-        }
-
-        inputVec = stringToVector(key);//prepares our inital key vector to create our key schedule
+        paddedMessage = addPKCS7Padding(message);
 
-        keyVec = createKeys(inputVec, s);//creates the key schedule
-
-        for(int i = front; i <= back; i++) {
-            keySection.push_back(keyVec[i]);//creates our first vector to be used in addRoundKey
+        for(size_t k = 0; k < (paddedMessage.length() / 16); k++) {
+            matVec.push_back(stringToMatrix(paddedMessage, 16 * k));// adds the blocks in 16 byte chunks into the vector of states
         }
 
-        for(int j = 0; j < matVec.size(); j++){
-
-            state = matVec[j];;
-
-            for(int i = 0; i < (rounds - 1); i++) {
+        if(key != expandedKey) {
+            inputVec = stringToVector(key);//prepares our inital key vector to create our key schedule
 
-                cout << "Starting round number " << dec << (front/4) + 1 << endl;
+            prepareKey(keyContext, inputVec.data(), inputVec.size());//creates the key schedule once for this key
 
-                state = addRoundKey(state, keySection);//adds the keys for the current round   
-                
-                front += 4;
-                back += 4;
-                //these are incremented by 4 to grab the next key section
-
-                keySection.clear();//clears the key section to replace with new keys
-
-
-                for(int j = front; j <= back; j++) {
-                    keySection.push_back(keyVec[j]);//fills new key section with new keys
-                }
-
-                state = subBytes(state, s);//subs the bytes in the state matrix based on the Rigndael S-box
+            expandedKey = key;
+        }
 
-                state = shiftRows(state);//shifts the rows in the state matrix
+        encVec = matVec;//the blocks are encrypted in place in encVec
 
-                state = mixColumns(state);//mixes the columns in the state matrix
+        cout << "Encrypting with the " << activeEngine().name << " engine" << endl;
 
-            }
-
-            cout << "Starting round number " << dec << (front/4) + 1 << endl;
+        if(!drbgRandomBytes(iv, 16)) {
+            cout << "Could not generate an initialization vector" << endl;
+            return 1;
+        }
 
-            state = addRoundKey(state, keySection);//adds second to final round key
-                
-            front += 4;
-            back += 4;
-            //front and back are incremented
+        uint8_t chain[16];
+        memcpy(chain, iv, 16);
 
-            keySection.clear();
+        cbcEncryptBlocks(keyContext, chain, encVec.data()->bytes, encVec.data()->bytes, encVec.size());//chains every block through the engine, the states are packed back to back
 
-            for(int j = front; j <= back; j++) {
-                keySection.push_back(keyVec[j]);//final key section is prepared
-            }
+        cout << "Initialization Vector: " << endl;
 
-            state = subBytes(state, s);//final sub bytes
+        char ivDigits[32];
+        hexEncode(iv, 16, ivDigits);
+        cout.write(ivDigits, 32) << endl;
 
-            state = shiftRows(state);//final row shift
+        cout << "Encrypted Message in blocks: " << endl;
 
-            cout << "Adding last round key" << endl;
+        printBlocksInHex(encVec);
 
-            state = addRoundKey(state, keySection);//adds final round key
+        cout << "Encrypted Message in Base 64: " << endl;
 
-            encVec.push_back(state);
+        printBase64(encVec.data()->bytes, 16 * encVec.size());
 
-            front = 0;
-            back = 3;
+        decVec.resize(encVec.size());
 
-            keySection.clear();
+        size_t plainLength = 0;
 
-            for(int i = front; i <= back; i++) {
-                keySection.push_back(keyVec[i]);//creates our first vector to be used in addRoundKey for the next block
-            }
+        //decrypts every block at once with the inverse round keys prepared with the key, then strips the padding
+        if(cbcDecrypt(keyContext, iv, encVec.data()->bytes, 16 * encVec.size(), decVec.data()->bytes, plainLength)) {
+            cout << "Decrypted Message: " << endl;
 
+            cout << string(reinterpret_cast<const char*>(decVec.data()->bytes), plainLength) << endl;
+        }
+        else {
+            cout << "Decrypted Message has bad padding" << endl;
         }
-
-        cout << "Encrypted Message in blocks: " << endl;
-
-        printVectorOfMatrices(encVec);
-
-        encVec.clear();
-
-        cout << "printing encVec post clear" << endl;
-        
-        printVectorOfMatrices(encVec);
 
         cout << "Would you like to encrypt again? (answer 'yes' or 'no')" << endl;
 
         getline(cin, cont);
 
         if(cont == "yes" || cont == "Yes") {
-            keySection.clear(); //Clears the key section for the next run through
             matVec.clear(); //clears the string to matrix vector
             encVec.clear(); //clears the encrypted matrix vector
+            decVec.clear(); //clears the decrypted matrix vector
             continue;
         }
         else {
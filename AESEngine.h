@@ -0,0 +1,515 @@
+// AESEngine.h
+// Picks the fastest AES engine the current CPU can run
+//
+// - An engine is a named set of functions that encrypt and decrypt runs of blocks and expand keys
+// - Every engine produces the same bytes, and every engine reads the same AESKeyContext,
+//   so a context prepared by one engine works with any other
+// - On first use every engine this CPU can run is checked against FIPS-197 known answers, the ones that pass
+//   are timed for a moment, and the fastest is bound as the active engine
+// - The choice is cached in a small file, ~/.aes-engine or whatever AES_ENGINE_CACHE names, along with the CPU
+//   it was made on, so later runs on the same machine skip the timing. The cached engine is still self tested
+// - The bitsliced engine never indexes memory with secret data. Setting the AES_ENGINE environment variable to
+//   an engine name overrides the choice, for example AES_ENGINE=bitsliced, and useEngine switches it from code
+//
+// Callers normally just use prepareKey, encryptBlocks, and decryptBlocks, which go through the active engine
+
+#ifndef AES_ENGINE_H
+#define AES_ENGINE_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstdlib> //getenv for the AES_ENGINE override
+#include <cstring> //strcmp for engine names, memcmp for the self test
+#include <cstdio> //the tuning cache file
+#include <atomic> //the active engine can be swapped at run time
+#include <chrono> //timing engines while tuning
+
+#include "AESCore.h" //AESKeyContext and the reference encryptBlock
+#include "AESKeySchedule.h" //software expandKey
+#include "AESTables.h" //table engine
+#include "AESNI.h" //hardware engine
+#include "AESBitsliced.h" //constant time engine
+#include "AESCPU.h" //CPUID feature detection
+#include "AESMetrics.h" //key expansion counts, and the mode counters every mode header reaches through here
+
+using BlockFunction = void (*)(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks);
+using KeyFunction = bool (*)(AESKeyContext& ctx, const uint8_t* key, size_t keyLength);
+using CTRFunction = void (*)(const AESKeyContext& ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks);
+
+struct AESEngine {
+    const char* name;//short name used when reporting which engine is running
+    BlockFunction encryptBlocks;//encrypts a run of independent blocks, for any key size
+    BlockFunction decryptBlocks;//decrypts a run of independent blocks, for any key size
+    KeyFunction expandKey;//fills a key context, returns false for a bad key length
+    bool (*isSupported)();//whether this machine can run the engine
+    BlockFunction encryptBlocksFixed[3];//the same as encryptBlocks, instantiated for AES128, AES192, and AES256
+    BlockFunction decryptBlocksFixed[3];//the same as decryptBlocks, per key size
+    CTRFunction ctrBlocksFixed[3];//fused CTR keystream and XOR per key size, or nullptr if the engine has none
+};
+
+inline void encryptBlocksReference(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //runs blocks one at a time through the step by step encryptBlock
+    for(size_t i = 0; i < blocks; i++) {
+        encryptBlock(ctx, in + 16 * i, out + 16 * i);
+    }
+}
+
+inline void decryptBlocksReference(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //runs blocks one at a time through the step by step decryptBlock
+    for(size_t i = 0; i < blocks; i++) {
+        decryptBlock(ctx, in + 16 * i, out + 16 * i);
+    }
+}
+
+inline bool alwaysSupported() {
+    return true;
+}
+
+inline bool hardwareSupported() {
+    return AES_HAVE_AESNI && cpuFeatures().aesni;
+}
+
+inline bool bitslicedSupported() {
+    return AES_HAVE_BITSLICED;
+}
+
+inline const AESEngine referenceEngine = {"reference", encryptBlocksReference, decryptBlocksReference, expandKey, alwaysSupported,
+    {encryptBlocksReference, encryptBlocksReference, encryptBlocksReference},
+    {decryptBlocksReference, decryptBlocksReference, decryptBlocksReference},
+    {nullptr, nullptr, nullptr}};
+
+inline const AESEngine tableEngine = {"table", encryptBlocksTable, decryptBlocksTable, expandKey, alwaysSupported,
+    {encryptBlocksTableRounds<10>, encryptBlocksTableRounds<12>, encryptBlocksTableRounds<14>},
+    {decryptBlocksTableRounds<10>, decryptBlocksTableRounds<12>, decryptBlocksTableRounds<14>},
+    {nullptr, nullptr, nullptr}};
+
+#if AES_HAVE_AESNI
+inline const AESEngine hardwareEngine = {"aesni", encryptBlocksHardware, decryptBlocksHardware, expandKeyHardware, hardwareSupported,
+    {encryptBlocksHardwareRounds<10>, encryptBlocksHardwareRounds<12>, encryptBlocksHardwareRounds<14>},
+    {decryptBlocksHardwareRounds<10>, decryptBlocksHardwareRounds<12>, decryptBlocksHardwareRounds<14>},
+    {ctrBlocksHardwareRounds<10>, ctrBlocksHardwareRounds<12>, ctrBlocksHardwareRounds<14>}};
+#else
+inline const AESEngine hardwareEngine = {"aesni", encryptBlocksTable, decryptBlocksTable, expandKey, hardwareSupported,
+    {encryptBlocksTableRounds<10>, encryptBlocksTableRounds<12>, encryptBlocksTableRounds<14>},
+    {decryptBlocksTableRounds<10>, decryptBlocksTableRounds<12>, decryptBlocksTableRounds<14>},
+    {nullptr, nullptr, nullptr}};//never selected, isSupported is always false
+#endif
+
+#if AES_HAVE_BITSLICED
+inline const AESEngine bitslicedEngine = {"bitsliced", encryptBlocksBitsliced, decryptBlocksBitsliced, expandKeyConstantTime, bitslicedSupported,
+    {encryptBlocksBitslicedRounds<10>, encryptBlocksBitslicedRounds<12>, encryptBlocksBitslicedRounds<14>},
+    {decryptBlocksBitslicedRounds<10>, decryptBlocksBitslicedRounds<12>, decryptBlocksBitslicedRounds<14>},
+    {nullptr, nullptr, nullptr}};
+#else
+inline const AESEngine bitslicedEngine = {"bitsliced", encryptBlocksTable, decryptBlocksTable, expandKey, bitslicedSupported,
+    {encryptBlocksTableRounds<10>, encryptBlocksTableRounds<12>, encryptBlocksTableRounds<14>},
+    {decryptBlocksTableRounds<10>, decryptBlocksTableRounds<12>, decryptBlocksTableRounds<14>},
+    {nullptr, nullptr, nullptr}};//never selected, isSupported is always false
+#endif
+
+inline const AESEngine* const allEngines[] = {&hardwareEngine, &bitslicedEngine, &tableEngine, &referenceEngine};
+
+inline const AESEngine* findEngine(const char* name) {
+    //looks an engine up by name, returns nullptr if there is none by that name or this machine cannot run it
+    for(const AESEngine* engine : allEngines) {
+        if(strcmp(engine->name, name) == 0) {
+            return engine->isSupported() ? engine : nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+inline constexpr size_t selfTestBlocks = 19;//blocks per self test call, a full 16 block group, a full 8 block group, and a tail
+inline constexpr size_t tuneBlocks = 256;//blocks per timed call while tuning
+inline constexpr int tuneMicroseconds = 2000;//time spent timing each engine
+inline constexpr size_t engineCachePathBytes = 4096;//longest cache file path
+
+struct AESKnownAnswer {
+    uint8_t key[32];
+    size_t keyLength;
+    uint8_t plain[16];
+    uint8_t cipher[16];
+};
+
+inline const AESKnownAnswer knownAnswers[] = {
+    //FIPS-197 appendix C.1, C.2, and C.3
+    {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f}, 16,
+        {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+        {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+    {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17}, 24,
+        {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+        {0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0, 0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91}},
+    {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f}, 32,
+        {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+        {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89}},
+    //"Two One Nine Two" under the key "Thats my Kung Fu", the example typed into AESEncryption's main
+    {{'T', 'h', 'a', 't', 's', ' ', 'm', 'y', ' ', 'K', 'u', 'n', 'g', ' ', 'F', 'u'}, 16,
+        {'T', 'w', 'o', ' ', 'O', 'n', 'e', ' ', 'N', 'i', 'n', 'e', ' ', 'T', 'w', 'o'},
+        {0x29, 0xc3, 0x50, 0x5f, 0x57, 0x14, 0x20, 0xf6, 0x40, 0x22, 0x99, 0xb3, 0x1a, 0x02, 0xd7, 0x3a}}
+};
+
+inline bool selfTestEngine(const AESEngine& engine) {
+    //checks an engine against the known answers: its key expansion, its generic and fixed size block functions
+    //in both directions, and its fused CTR function if it has one. Runs of selfTestBlocks blocks go through
+    //every wide path and the tail code. Returns false if the engine cannot run here or gets anything wrong
+    if(!engine.isSupported()) {
+        return false;
+    }
+
+    alignas(16) uint8_t plain[selfTestBlocks * 16];
+    alignas(16) uint8_t cipher[selfTestBlocks * 16];
+    alignas(16) uint8_t result[selfTestBlocks * 16];
+
+    for(const AESKnownAnswer& answer : knownAnswers) {
+        AESKeyContext ctx;
+        if(!engine.expandKey(ctx, answer.key, answer.keyLength)) {
+            return false;
+        }
+
+        int size = (ctx.rounds - 10) / 2;
+
+        for(size_t i = 0; i < selfTestBlocks; i++) {
+            memcpy(plain + 16 * i, answer.plain, 16);
+            memcpy(cipher + 16 * i, answer.cipher, 16);
+        }
+
+        BlockFunction encrypts[2] = {engine.encryptBlocks, engine.encryptBlocksFixed[size]};
+        BlockFunction decrypts[2] = {engine.decryptBlocks, engine.decryptBlocksFixed[size]};
+
+        for(int f = 0; f < 2; f++) {
+            encrypts[f](ctx, plain, result, selfTestBlocks);
+            if(memcmp(result, cipher, sizeof(result)) != 0) {
+                return false;
+            }
+
+            decrypts[f](ctx, cipher, result, selfTestBlocks);
+            if(memcmp(result, plain, sizeof(result)) != 0) {
+                return false;
+            }
+        }
+
+        CTRFunction ctr = engine.ctrBlocksFixed[size];
+        if(ctr == nullptr) {
+            continue;
+        }
+
+        //counters start just short of a carry out of the low byte, and the keystream is checked against
+        //the block function that has just passed
+        uint8_t counter[16];
+        memcpy(counter, answer.plain, 16);
+        counter[15] = 0xf8;
+
+        uint8_t expectedCounter[16];
+        memcpy(expectedCounter, counter, 16);
+
+        for(size_t i = 0; i < selfTestBlocks; i++) {
+            memcpy(cipher + 16 * i, expectedCounter, 16);
+
+            for(int k = 15; k >= 0; k--) {
+                if(++expectedCounter[k] != 0) {
+                    break;
+                }
+            }
+        }
+
+        engine.encryptBlocksFixed[size](ctx, cipher, cipher, selfTestBlocks);
+        xorBytes(cipher, cipher, plain, sizeof(cipher));
+
+        ctr(ctx, counter, plain, result, selfTestBlocks);
+
+        if(memcmp(result, cipher, sizeof(result)) != 0 || memcmp(counter, expectedCounter, 16) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline double measureEngine(const AESEngine& engine) {
+    //bytes per second the engine encrypts with an AES128 key, timed for about tuneMicroseconds
+    AESKeyContext ctx;
+    engine.expandKey(ctx, knownAnswers[0].key, 16);
+
+    alignas(16) uint8_t buffer[tuneBlocks * 16] = {};
+    BlockFunction encrypt = engine.encryptBlocksFixed[0];
+
+    encrypt(ctx, buffer, buffer, tuneBlocks);//brings the code and tables into cache before the clock starts
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    size_t calls = 0;
+
+    do {
+        encrypt(ctx, buffer, buffer, tuneBlocks);
+        calls++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while(elapsed < std::chrono::microseconds(tuneMicroseconds));
+
+    return static_cast<double>(calls * tuneBlocks * 16) / std::chrono::duration<double>(elapsed).count();
+}
+
+inline const AESEngine& tuneEngines() {
+    //the fastest engine that passes its self test on this machine
+    //the reference engine is the fallback if none pass, it is the one that follows FIPS-197 step by step
+    const AESEngine* best = nullptr;
+    double bestSpeed = 0;
+
+    for(const AESEngine* engine : allEngines) {
+        if(!selfTestEngine(*engine)) {
+            continue;
+        }
+
+        double speed = measureEngine(*engine);
+
+        if(speed > bestSpeed) {
+            best = engine;
+            bestSpeed = speed;
+        }
+    }
+
+    return best != nullptr ? *best : referenceEngine;
+}
+
+inline uint32_t engineCacheFeatures() {
+    //the CPU features and compiled in engines a cached choice depends on, packed into bits
+    const CPUFeatures& features = cpuFeatures();
+
+    return (features.aesni ? 1u : 0u) | (features.pclmul ? 2u : 0u) | (features.ssse3 ? 4u : 0u) | (features.sse41 ? 8u : 0u)
+        | (features.avx2 ? 16u : 0u) | (AES_HAVE_AESNI ? 32u : 0u) | (AES_HAVE_BITSLICED ? 64u : 0u);
+}
+
+inline bool engineCachePath(char* path, size_t size) {
+    //where the tuned choice is kept: AES_ENGINE_CACHE if it is set, otherwise .aes-engine in the home directory
+    //returns false if there is nowhere to keep it, setting AES_ENGINE_CACHE to an empty string turns the cache off
+    const char* configured = getenv("AES_ENGINE_CACHE");
+    if(configured != nullptr) {
+        return configured[0] != '\0' && snprintf(path, size, "%s", configured) < static_cast<int>(size);
+    }
+
+    const char* home = getenv("HOME");
+    if(home == nullptr || home[0] == '\0') {
+        return false;
+    }
+
+    return snprintf(path, size, "%s/.aes-engine", home) < static_cast<int>(size);
+}
+
+inline const AESEngine* loadTunedEngine(const char* path) {
+    //the engine cached at path, or nullptr if there is none, it was tuned on a different CPU or build, or it fails its self test
+    FILE* file = fopen(path, "r");
+    if(file == nullptr) {
+        return nullptr;
+    }
+
+    char name[32];
+    unsigned int signature = 0;
+    unsigned int features = 0;
+
+    int fields = fscanf(file, "%31s %x %x", name, &signature, &features);
+    fclose(file);
+
+    if(fields != 3 || signature != cpuFeatures().signature || features != engineCacheFeatures()) {
+        return nullptr;
+    }
+
+    const AESEngine* engine = findEngine(name);
+
+    return engine != nullptr && selfTestEngine(*engine) ? engine : nullptr;
+}
+
+inline void saveTunedEngine(const char* path, const AESEngine& engine) {
+    //caches a tuned choice at path as one line: the engine name, the CPU signature, and engineCacheFeatures
+    //it is written to a temporary file and renamed into place, so a process starting meanwhile never reads half a line.
+    //Failing to write it only means the next process tunes again
+    char temporary[engineCachePathBytes + 8];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE* file = fopen(temporary, "w");
+    if(file == nullptr) {
+        return;
+    }
+
+    bool ok = fprintf(file, "%s %08x %02x\n", engine.name, cpuFeatures().signature, engineCacheFeatures()) > 0;
+
+    if(fclose(file) != 0 || !ok || rename(temporary, path) != 0) {
+        remove(temporary);
+    }
+}
+
+inline const AESEngine& selectEngine() {
+    //the engine this process starts with: the one AES_ENGINE names, else the one cached by an earlier run on this CPU,
+    //else the fastest one that passes its self test, which is then cached for the next run.
+    //An engine that fails its self test is never picked, whichever way it was asked for
+    //An AES_ENGINE that cannot be honoured is reported on stderr, so a typo never quietly drops the engine asked for
+    const char* requested = getenv("AES_ENGINE");
+    if(requested != nullptr) {
+        const AESEngine* engine = findEngine(requested);
+
+        if(engine != nullptr && selfTestEngine(*engine)) {
+            return *engine;
+        }
+
+        bool known = false;
+        for(const AESEngine* candidate : allEngines) {
+            known = known || strcmp(candidate->name, requested) == 0;
+        }
+
+        const char* reason = !known ? "is not an engine" : engine == nullptr ? "is not supported on this CPU" : "failed its self test";
+        fprintf(stderr, "AES_ENGINE=%s %s, choosing another engine\n", requested, reason);
+    }
+
+    char path[engineCachePathBytes];
+    bool cached = engineCachePath(path, sizeof(path));
+
+    if(cached) {
+        if(const AESEngine* engine = loadTunedEngine(path)) {
+            return *engine;
+        }
+    }
+
+    const AESEngine& engine = tuneEngines();
+
+    if(cached) {
+        saveTunedEngine(path, engine);
+    }
+
+    return engine;
+}
+
+inline std::atomic<const AESEngine*>& activeEngineSlot() {
+    //the engine modes dispatch to, chosen by selectEngine on first use and changed only by useEngine
+    static std::atomic<const AESEngine*> engine{&selectEngine()};
+    return engine;
+}
+
+inline const AESEngine& activeEngine() {
+    //the engine picked for this process
+    return *activeEngineSlot().load(std::memory_order_acquire);
+}
+
+inline bool useEngine(const AESEngine& engine) {
+    //makes engine the active one, for benchmarks and tuning that compare engines in one process
+    //every engine reads the same contexts and writes the same bytes, so switching while other threads are encrypting is safe
+    //returns false and changes nothing if this machine cannot run engine
+    if(!engine.isSupported()) {
+        return false;
+    }
+
+    activeEngineSlot().store(&engine, std::memory_order_release);
+    return true;
+}
+
+inline bool prepareKey(AESKeyContext& ctx, const uint8_t* key, size_t keyLength) {
+    //expands a key with the active engine
+    const AESEngine& engine = activeEngine();
+
+    if(!engine.expandKey(ctx, key, keyLength)) {
+        return false;
+    }
+
+    recordKeyExpansions(engine.name, 1);
+    return true;
+}
+
+inline bool prepareKeys(AESKeyContext* contexts, const uint8_t* keys, size_t keyLength, size_t count) {
+    //expands count keys of keyLength bytes stored back to back, the bulk version of prepareKey
+    //returns false and leaves contexts untouched if keyLength is not 16, 24, or 32
+    if(!isValidKeyLength(static_cast<int>(keyLength))) {
+        return false;
+    }
+
+    recordKeyExpansions(activeEngine().name, count);
+
+#if AES_HAVE_AESNI
+    if(&activeEngine() == &hardwareEngine && cpuFeatures().ssse3) {
+        return expandKeysHardware(contexts, keys, keyLength, count);
+    }
+#endif
+
+    for(size_t i = 0; i < count; i++) {
+        activeEngine().expandKey(contexts[i], keys + keyLength * i, keyLength);
+    }
+
+    return true;
+}
+
+inline void encryptBlocks(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //encrypts a run of independent 16 byte blocks with the active engine, in and out may be the same buffer
+    activeEngine().encryptBlocks(ctx, in, out, blocks);
+}
+
+inline void decryptBlocks(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //decrypts a run of independent 16 byte blocks with the active engine, in and out may be the same buffer
+    activeEngine().decryptBlocks(ctx, in, out, blocks);
+}
+
+inline BlockFunction blockFunctionFor(size_t keyLength, const AESEngine& engine = activeEngine()) {
+    //returns the engine's instantiation for one key size, or nullptr if the length is not 16, 24, or 32
+    //callers that always use the same key size can look this up once and skip the per call dispatch
+    switch(keyLength) {
+        case 16:
+            return engine.encryptBlocksFixed[0];
+        case 24:
+            return engine.encryptBlocksFixed[1];
+        case 32:
+            return engine.encryptBlocksFixed[2];
+        default:
+            return nullptr;
+    }
+}
+
+inline BlockFunction activeBlockFunction(const AESKeyContext& ctx) {
+    //the active engine's instantiation for the key size ctx was expanded with
+    //modes look this up once per call and then feed it blocks without any further dispatch
+    return activeEngine().encryptBlocksFixed[(ctx.rounds - 10) / 2];
+}
+
+inline BlockFunction activeDecryptBlockFunction(const AESKeyContext& ctx) {
+    //the decryption counterpart of activeBlockFunction
+    return activeEngine().decryptBlocksFixed[(ctx.rounds - 10) / 2];
+}
+
+template<int KeyBytes>
+class AESCipher {
+    //an AES cipher whose key size is fixed at compile time
+    //services that only ever use one key size can hold one of these, and every round count and bound is a constant
+public:
+    static constexpr int Nk = AESKeySize<KeyBytes>::Nk;
+    static constexpr int Nr = AESKeySize<KeyBytes>::Nr;
+
+    explicit AESCipher(const uint8_t key[KeyBytes]) {
+        //expands the key once with the active engine and binds that engine's instantiations for this key size,
+        //so a cipher made here runs whatever engine selectEngine or useEngine settled on
+        const AESEngine& engine = activeEngine();
+
+        engine.expandKey(ctx, key, KeyBytes);
+        encryptFunction = engine.encryptBlocksFixed[(Nr - 10) / 2];
+        decryptFunction = engine.decryptBlocksFixed[(Nr - 10) / 2];
+    }
+
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t blocks) const {
+        //encrypts a run of independent 16 byte blocks, in and out may be the same buffer
+        encryptFunction(ctx, in, out, blocks);
+    }
+
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t blocks) const {
+        //decrypts a run of independent 16 byte blocks, in and out may be the same buffer
+        decryptFunction(ctx, in, out, blocks);
+    }
+
+    const AESKeyContext& context() const { return ctx; }
+
+private:
+    AESKeyContext ctx;
+    BlockFunction encryptFunction = encryptBlocksTableRounds<Nr>;
+    BlockFunction decryptFunction = decryptBlocksTableRounds<Nr>;
+};
+
+using AES128 = AESCipher<16>;
+using AES192 = AESCipher<24>;
+using AES256 = AESCipher<32>;
+
+#endif
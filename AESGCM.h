@@ -0,0 +1,341 @@
+// AESGCM.h
+// AES in Galois/counter mode (GCM), authenticated encryption with associated data
+//
+// - Data is encrypted with a 32 bit counter CTR keystream and authenticated with GHASH over the
+//   associated data, the ciphertext, and their lengths, as in NIST SP 800-38D
+// - Everything is one pass over the data. With AES-NI and PCLMULQDQ a fused loop encrypts eight counter blocks
+//   per iteration and hashes the previous eight ciphertext blocks between its AES rounds, so the two overlap
+// - Other engines work through the data 64 blocks at a time, hashing each batch while it is still in cache
+// - 12 byte IVs are used as they are, any other length is hashed into the first counter block first
+//
+// - gcmEncrypt and gcmDecrypt refuse an empty IV and anything past the SP 800-38D length limits, so the 32 bit
+//   counter never wraps around to j0 and reuses the block that masks the tag
+//
+// A key and IV pair must never encrypt two different messages, doing so reveals the GHASH key
+
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memset
+
+#include "AESCore.h" //AESKeyContext and xorBytes
+#include "AESEngine.h" //the active engine
+#include "AESGHASH.h" //table and PCLMULQDQ GHASH
+
+inline constexpr size_t gcmBatchBlocks = 64;//blocks encrypted and hashed together when the loop is not fused
+inline constexpr uint64_t gcmMaxDataBytes = (1ull << 36) - 32;//2^39 - 256 bits, the most the 32 bit counter covers without reaching j0
+inline constexpr uint64_t gcmMaxInputBytes = 1ull << 61;//associated data and IVs must be shorter, their bit lengths fill 64 bits
+
+struct AESGCMContext {
+    //an expanded key with its GHASH tables, filled in once by gcmSetKey and then only read
+    AESKeyContext key;
+    GHASHKey ghash;
+};
+
+#if AES_HAVE_AESNI
+
+#define AES_TARGET_GCM __attribute__((target("aes,pclmul,ssse3,sse2")))
+
+template<int Nr>
+AES_TARGET_GCM inline void gcmBlocksHardwareRounds(const AESGCMContext& gcm, const uint8_t j0[16], uint32_t& counter, const uint8_t* in, uint8_t* out, size_t blocks, uint8_t state[16], bool decrypt) {
+    //encrypts or decrypts whole blocks starting from counter and hashes the ciphertext into state, leaving counter past the last block
+    //the inputs of each group are loaded before anything is stored, so in and out may be the same buffer
+
+    const AESKeyContext& ctx = gcm.key;
+
+    __m128i rk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        rk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(ctx.roundKey(round)));
+    }
+
+    __m128i powers[8];
+
+#pragma GCC unroll 8
+    for(int i = 0; i < 8; i++) {
+        powers[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(gcm.ghash.powers[i]));
+    }
+
+    //the counter block is the first 12 bytes of j0 with a big endian 32 bit counter in the last 4
+    uint8_t baseBytes[16];
+    memcpy(baseBytes, j0, 12);
+    memset(baseBytes + 12, 0, 4);
+    __m128i base = _mm_loadu_si128(reinterpret_cast<const __m128i*>(baseBytes));
+
+    auto counterBlock = [&](uint32_t value) {
+        return _mm_or_si128(base, _mm_slli_si128(_mm_cvtsi32_si128(static_cast<int>(__builtin_bswap32(value))), 12));
+    };
+
+    __m128i x = ghashByteSwap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)));
+
+    //the hash of each group is spread over the AES rounds of the group after it, one block per round,
+    //so the multiplier and the AES unit work side by side instead of taking turns
+    __m128i pending[8];
+    bool hasPending = false;
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i b[8];
+        __m128i data[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            b[j] = _mm_xor_si128(counterBlock(counter + static_cast<uint32_t>(j)), rk[0]);
+            data[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j)));
+        }
+        counter += 8;
+
+        __m128i low = _mm_setzero_si128();
+        __m128i middle = _mm_setzero_si128();
+        __m128i high = _mm_setzero_si128();
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                b[j] = _mm_aesenc_si128(b[j], rk[round]);
+            }
+
+            if(hasPending && round <= 8) {
+                //round r hashes pending block r - 1, Nr is at least 10 so all eight fit
+                __m128i block = round == 1 ? _mm_xor_si128(x, pending[0]) : pending[round - 1];
+                ghashMultiplyAccumulate(block, powers[8 - round], low, middle, high);
+            }
+        }
+
+        if(hasPending) {
+            x = ghashReduce(low, middle, high);
+        }
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            __m128i result = _mm_xor_si128(data[j], _mm_aesenclast_si128(b[j], rk[Nr]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), result);
+
+            pending[j] = ghashByteSwap(decrypt ? data[j] : result);//GHASH always covers the ciphertext
+        }
+
+        hasPending = true;
+    }
+
+    if(hasPending) {
+        x = ghashEightHardware(powers, x, pending);
+    }
+
+    for(; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(counterBlock(counter), rk[0]);
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i));
+        counter++;
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+            b = _mm_aesenc_si128(b, rk[round]);
+        }
+
+        __m128i result = _mm_xor_si128(data, _mm_aesenclast_si128(b, rk[Nr]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), result);
+
+        x = ghashMultiply(_mm_xor_si128(x, ghashByteSwap(decrypt ? data : result)), powers[0]);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), ghashByteSwap(x));
+}
+
+inline void gcmBlocksHardware(const AESGCMContext& gcm, const uint8_t j0[16], uint32_t& counter, const uint8_t* in, uint8_t* out, size_t blocks, uint8_t state[16], bool decrypt) {
+    //picks the instantiation for the key size once per call
+    switch(gcm.key.rounds) {
+        case 10:
+            gcmBlocksHardwareRounds<10>(gcm, j0, counter, in, out, blocks, state, decrypt);
+            break;
+        case 12:
+            gcmBlocksHardwareRounds<12>(gcm, j0, counter, in, out, blocks, state, decrypt);
+            break;
+        case 14:
+            gcmBlocksHardwareRounds<14>(gcm, j0, counter, in, out, blocks, state, decrypt);
+            break;
+    }
+}
+
+#endif
+
+inline bool gcmSetKey(AESGCMContext& gcm, const uint8_t* key, size_t keyLength) {
+    //expands key and builds its GHASH tables, returns false if the key is not 16, 24, or 32 bytes
+    if(!prepareKey(gcm.key, key, keyLength)) {
+        return false;
+    }
+
+    uint8_t h[16] = {};
+    encryptBlocks(gcm.key, h, h, 1);//the GHASH key is the encryption of the zero block
+
+    ghashInit(gcm.ghash, h);
+
+    return true;
+}
+
+inline bool gcmWithinLimits(size_t ivLength, size_t aadLength, size_t length) {
+    //whether a message may go through GCM at all: a non empty IV, and data and associated data inside the SP 800-38D limits
+    return ivLength > 0 && static_cast<uint64_t>(ivLength) < gcmMaxInputBytes
+        && static_cast<uint64_t>(aadLength) < gcmMaxInputBytes
+        && static_cast<uint64_t>(length) <= gcmMaxDataBytes;
+}
+
+inline void gcmInitialCounter(const AESGCMContext& gcm, const uint8_t* iv, size_t ivLength, uint8_t j0[16]) {
+    //the first counter block. Its encryption masks the tag, and the data starts at the one after it
+    if(ivLength == 12) {
+        memcpy(j0, iv, 12);
+        j0[12] = 0;
+        j0[13] = 0;
+        j0[14] = 0;
+        j0[15] = 1;
+        return;
+    }
+
+    uint8_t lengths[16] = {};
+    storeBigEndian64(lengths + 8, static_cast<uint64_t>(ivLength) * 8);
+
+    memset(j0, 0, 16);
+    ghashPadded(gcm.ghash, j0, iv, ivLength);
+    ghashBlocks(gcm.ghash, j0, lengths, 1);
+}
+
+inline void gcmCounterBlock(const uint8_t j0[16], uint32_t counter, uint8_t block[16]) {
+    //j0 with its last 4 bytes replaced by counter, big endian
+    memcpy(block, j0, 12);
+    block[12] = static_cast<uint8_t>(counter >> 24);
+    block[13] = static_cast<uint8_t>(counter >> 16);
+    block[14] = static_cast<uint8_t>(counter >> 8);
+    block[15] = static_cast<uint8_t>(counter);
+}
+
+inline void gcmCrypt(const AESGCMContext& gcm, const uint8_t j0[16], const uint8_t* in, uint8_t* out, size_t length, uint8_t state[16], bool decrypt) {
+    //runs the data through the keystream and hashes the ciphertext into state, in and out may be the same buffer
+
+    uint32_t counter = static_cast<uint32_t>(j0[12]) << 24 | static_cast<uint32_t>(j0[13]) << 16 | static_cast<uint32_t>(j0[14]) << 8 | j0[15];
+    counter++;//the data starts one past j0, and only the last 32 bits count up
+
+#if AES_HAVE_AESNI
+    if(gcm.ghash.hardware && &activeEngine() == &hardwareEngine) {//decided per message so useEngine applies to existing keys
+        size_t whole = length / 16;
+        gcmBlocksHardware(gcm, j0, counter, in, out, whole, state, decrypt);
+
+        in += 16 * whole;
+        out += 16 * whole;
+        length -= 16 * whole;
+    }
+#endif
+
+    BlockFunction encrypt = activeBlockFunction(gcm.key);
+
+    alignas(16) uint8_t keystream[gcmBatchBlocks * 16];
+
+    while(length > 0) {
+        size_t blocks = (length + 15) / 16;
+        if(blocks > gcmBatchBlocks) {
+            blocks = gcmBatchBlocks;
+        }
+
+        for(size_t i = 0; i < blocks; i++) {
+            gcmCounterBlock(j0, counter++, keystream + 16 * i);
+        }
+
+        encrypt(gcm.key, keystream, keystream, blocks);
+
+        size_t bytes = blocks * 16 < length ? blocks * 16 : length;
+
+        //the hash always covers the ciphertext, which is the input when decrypting and the output when encrypting
+        if(decrypt) {
+            ghashPadded(gcm.ghash, state, in, bytes);
+        }
+
+        xorBytes(out, in, keystream, bytes);
+
+        if(!decrypt) {
+            ghashPadded(gcm.ghash, state, out, bytes);
+        }
+
+        in += bytes;
+        out += bytes;
+        length -= bytes;
+    }
+}
+
+inline void gcmTag(const AESGCMContext& gcm, const uint8_t j0[16], uint8_t state[16], size_t aadLength, size_t length, uint8_t tag[16]) {
+    //finishes GHASH with the bit lengths of the associated data and ciphertext, then masks it with the encryption of j0
+    uint8_t lengths[16];
+    storeBigEndian64(lengths, static_cast<uint64_t>(aadLength) * 8);
+    storeBigEndian64(lengths + 8, static_cast<uint64_t>(length) * 8);
+
+    ghashBlocks(gcm.ghash, state, lengths, 1);
+
+    uint8_t mask[16];
+    encryptBlocks(gcm.key, j0, mask, 1);
+
+    xorBytes(tag, state, mask, 16);
+}
+
+inline bool gcmEncrypt(const AESGCMContext& gcm, const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* in, uint8_t* out, size_t length, uint8_t tag[16]) {
+    //encrypts length bytes and writes the 16 byte tag covering aad and the ciphertext, in and out may be the same buffer
+    //returns false without touching out or tag if gcmWithinLimits refuses the lengths
+    if(!gcmWithinLimits(ivLength, aadLength, length)) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::GCMEncrypt, length);
+
+    uint8_t j0[16];
+    gcmInitialCounter(gcm, iv, ivLength, j0);
+
+    uint8_t state[16] = {};
+
+    ghashPadded(gcm.ghash, state, aad, aadLength);
+
+    gcmCrypt(gcm, j0, in, out, length, state, false);
+
+    gcmTag(gcm, j0, state, aadLength, length, tag);
+
+    return true;
+}
+
+inline bool gcmDecrypt(const AESGCMContext& gcm, const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* in, uint8_t* out, size_t length, const uint8_t* tag, size_t tagLength = 16) {
+    //decrypts length bytes and checks the tag, which may be cut down to 12 to 16 bytes
+    //returns false if the tag does not match, and then out is zeroed so unauthenticated plaintext never escapes,
+    //or if the tag length or gcmWithinLimits refuses the call, and then out is left alone
+    if(tagLength < 12 || tagLength > 16 || !gcmWithinLimits(ivLength, aadLength, length)) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::GCMDecrypt, length);
+
+    uint8_t j0[16];
+    gcmInitialCounter(gcm, iv, ivLength, j0);
+
+    uint8_t state[16] = {};
+
+    ghashPadded(gcm.ghash, state, aad, aadLength);
+
+    gcmCrypt(gcm, j0, in, out, length, state, true);
+
+    uint8_t expected[16];
+    gcmTag(gcm, j0, state, aadLength, length, expected);
+
+    //every byte is compared whatever the first difference, so the time taken does not say where it is
+    uint8_t difference = 0;
+    for(size_t i = 0; i < tagLength; i++) {
+        difference |= static_cast<uint8_t>(expected[i] ^ tag[i]);
+    }
+
+    if(difference != 0) {
+        if(length > 0) {
+            memset(out, 0, length);//out may be null when there is no data
+        }
+        return false;
+    }
+
+    return true;
+}
+
+#endif
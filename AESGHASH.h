@@ -0,0 +1,283 @@
+// AESGHASH.h
+// GHASH, the universal hash that authenticates GCM
+//
+// - GHASH multiplies by a key dependent value H in GF(2^128), one 16 byte block at a time
+// - The software version uses Shoup's 8 bit tables: 256 multiples of H are built once per key, so a block takes
+//   16 table lookups and shifts. The shifted out byte is folded back in with a 256 entry table built at compile time
+// - The hardware version uses PCLMULQDQ and multiplies eight blocks by H^8 ... H^1 before a single reduction,
+//   so the reduction cost is shared across the group
+//
+// GCM numbers bits from the most significant bit of byte 0, so x^0 is the top bit and multiplying by x is a right shift.
+// The software tables keep each value as two 64 bit halves, high holding bytes 0 to 7.
+// The table version looks up memory with data dependent indexes, use the hardware version where timing matters
+
+#ifndef AES_GHASH_H
+#define AES_GHASH_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy
+
+#include "AESCTR.h" //loadBigEndian64 and storeBigEndian64
+#include "AESCPU.h" //whether PCLMULQDQ is available
+#include "AESNI.h" //AES_HAVE_AESNI, which marks x86 GCC and clang builds
+
+struct GHASHReductionTable {
+    //entry d is what the byte d shifted off the bottom of a value adds back to its top 16 bits
+    uint16_t entries[256];
+};
+
+constexpr GHASHReductionTable makeGHASHReductionTable() {
+    //shifts d right through 8 single bit steps, each step folding a dropped bit back in as 0xe1 at the top
+    GHASHReductionTable table{};
+
+    for(int d = 0; d < 256; d++) {
+        uint32_t top = 0;//the top 16 bits as they build up, bit 15 is x^0
+        uint32_t low = static_cast<uint32_t>(d);//the byte being shifted out, bit 0 is x^127
+
+        for(int step = 0; step < 8; step++) {
+            uint32_t dropped = low & 1;
+            low >>= 1;
+            top >>= 1;
+            if(dropped) {
+                top ^= 0xe100;
+            }
+        }
+
+        table.entries[d] = static_cast<uint16_t>(top);
+    }
+
+    return table;
+}
+
+inline constexpr GHASHReductionTable ghashReduction = makeGHASHReductionTable();
+
+struct GHASHKey {
+    //the per key state for both GHASH versions, filled in once by ghashInit
+    uint64_t tableHigh[256];//tableHigh[b], tableLow[b] is the byte b times H, with the top bit of b as x^0
+    uint64_t tableLow[256];
+
+    alignas(16) uint8_t powers[8][16];//H^1 to H^8, byte reversed for PCLMULQDQ
+
+    bool hardware = false;//use PCLMULQDQ
+};
+
+#if AES_HAVE_AESNI
+
+#define AES_TARGET_PCLMUL __attribute__((target("pclmul,ssse3,sse2")))
+
+AES_TARGET_PCLMUL inline __m128i ghashByteSwap(__m128i x) {
+    //PCLMULQDQ works on the bit order of an integer, so blocks are byte reversed on the way in and out
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+AES_TARGET_PCLMUL inline void ghashMultiplyAccumulate(__m128i a, __m128i b, __m128i& low, __m128i& middle, __m128i& high) {
+    //adds the unreduced 256 bit product a * b into low, middle, and high
+    low = _mm_xor_si128(low, _mm_clmulepi64_si128(a, b, 0x00));
+    high = _mm_xor_si128(high, _mm_clmulepi64_si128(a, b, 0x11));
+    middle = _mm_xor_si128(middle, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01), _mm_clmulepi64_si128(a, b, 0x10)));
+}
+
+AES_TARGET_PCLMUL inline __m128i ghashReduce(__m128i low, __m128i middle, __m128i high) {
+    //turns an unreduced product back into a field element
+    //GCM's bit order makes a byte reversed product come out one bit short, so it is shifted left by one first,
+    //then the top half is folded down with x^128 = x^7 + x^2 + x + 1
+
+    low = _mm_xor_si128(low, _mm_slli_si128(middle, 8));
+    high = _mm_xor_si128(high, _mm_srli_si128(middle, 8));
+
+    __m128i lowCarry = _mm_srli_epi32(low, 31);
+    __m128i highCarry = _mm_srli_epi32(high, 31);
+    low = _mm_slli_epi32(low, 1);
+    high = _mm_slli_epi32(high, 1);
+
+    __m128i across = _mm_srli_si128(lowCarry, 12);
+    highCarry = _mm_slli_si128(highCarry, 4);
+    lowCarry = _mm_slli_si128(lowCarry, 4);
+    low = _mm_or_si128(low, lowCarry);
+    high = _mm_or_si128(high, highCarry);
+    high = _mm_or_si128(high, across);
+
+    __m128i a = _mm_slli_epi32(low, 31);
+    __m128i b = _mm_slli_epi32(low, 30);
+    __m128i c = _mm_slli_epi32(low, 25);
+    a = _mm_xor_si128(a, _mm_xor_si128(b, c));
+    b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    low = _mm_xor_si128(low, a);
+
+    __m128i d = _mm_srli_epi32(low, 1);
+    __m128i e = _mm_srli_epi32(low, 2);
+    __m128i f = _mm_srli_epi32(low, 7);
+    d = _mm_xor_si128(d, _mm_xor_si128(e, _mm_xor_si128(f, b)));
+    low = _mm_xor_si128(low, d);
+
+    return _mm_xor_si128(high, low);
+}
+
+AES_TARGET_PCLMUL inline __m128i ghashMultiply(__m128i a, __m128i b) {
+    //a * b for byte reversed field elements
+    __m128i low = _mm_setzero_si128();
+    __m128i middle = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+
+    ghashMultiplyAccumulate(a, b, low, middle, high);
+
+    return ghashReduce(low, middle, high);
+}
+
+AES_TARGET_PCLMUL inline void ghashPowersHardware(GHASHKey& key, const uint8_t h[16]) {
+    //fills key.powers with H^1 to H^8
+    __m128i hr = ghashByteSwap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)));
+    __m128i power = hr;
+
+    for(int i = 0; i < 8; i++) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(key.powers[i]), power);
+        power = ghashMultiply(power, hr);
+    }
+}
+
+AES_TARGET_PCLMUL inline __m128i ghashEightHardware(const __m128i powers[8], __m128i x, const __m128i data[8]) {
+    //absorbs eight byte reversed blocks into x as (x ^ d0) * H^8 ^ d1 * H^7 ^ ... ^ d7 * H, with one reduction
+    __m128i low = _mm_setzero_si128();
+    __m128i middle = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+
+    ghashMultiplyAccumulate(_mm_xor_si128(x, data[0]), powers[7], low, middle, high);
+
+#pragma GCC unroll 8
+    for(int j = 1; j < 8; j++) {
+        ghashMultiplyAccumulate(data[j], powers[7 - j], low, middle, high);
+    }
+
+    return ghashReduce(low, middle, high);
+}
+
+AES_TARGET_PCLMUL inline void ghashBlocksHardware(const GHASHKey& key, uint8_t state[16], const uint8_t* data, size_t blocks) {
+    //absorbs whole blocks into state with PCLMULQDQ
+    __m128i powers[8];
+    for(int i = 0; i < 8; i++) {
+        powers[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(key.powers[i]));
+    }
+
+    __m128i x = ghashByteSwap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)));
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i d[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            d[j] = ghashByteSwap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * (i + j))));
+        }
+
+        x = ghashEightHardware(powers, x, d);
+    }
+
+    for(; i < blocks; i++) {
+        __m128i d = ghashByteSwap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)));
+        x = ghashMultiply(_mm_xor_si128(x, d), powers[0]);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), ghashByteSwap(x));
+}
+
+#endif
+
+inline void ghashInit(GHASHKey& key, const uint8_t h[16]) {
+    //builds the multiples of H for the tables, and the powers of H when PCLMULQDQ is available
+
+    uint64_t high = loadBigEndian64(h);
+    uint64_t low = loadBigEndian64(h + 8);
+
+    //0x80 is x^0, so it holds H itself, and each lower bit is the one above it times x
+    key.tableHigh[0] = 0;
+    key.tableLow[0] = 0;
+    key.tableHigh[0x80] = high;
+    key.tableLow[0x80] = low;
+
+    for(int bit = 0x40; bit > 0; bit >>= 1) {
+        uint64_t dropped = low & 1;
+        low = (high << 63) | (low >> 1);
+        high = (high >> 1) ^ (0xe100000000000000ull & (0 - dropped));
+
+        key.tableHigh[bit] = high;
+        key.tableLow[bit] = low;
+    }
+
+    //every other byte is a sum of single bit bytes
+    for(int bit = 2; bit < 256; bit <<= 1) {
+        for(int rest = 1; rest < bit; rest++) {
+            key.tableHigh[bit + rest] = key.tableHigh[bit] ^ key.tableHigh[rest];
+            key.tableLow[bit + rest] = key.tableLow[bit] ^ key.tableLow[rest];
+        }
+    }
+
+    key.hardware = false;
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().pclmul && cpuFeatures().ssse3) {
+        ghashPowersHardware(key, h);
+        key.hardware = true;
+    }
+#endif
+}
+
+inline void ghashBlocksTable(const GHASHKey& key, uint8_t state[16], const uint8_t* data, size_t blocks) {
+    //absorbs whole blocks into state with the 8 bit tables
+    //the product is built from the last byte to the first, multiplying by x^8 between bytes
+
+    uint64_t stateHigh = loadBigEndian64(state);
+    uint64_t stateLow = loadBigEndian64(state + 8);
+
+    for(size_t i = 0; i < blocks; i++) {
+        uint8_t x[16];
+        storeBigEndian64(x, stateHigh ^ loadBigEndian64(data + 16 * i));
+        storeBigEndian64(x + 8, stateLow ^ loadBigEndian64(data + 16 * i + 8));
+
+        uint64_t high = key.tableHigh[x[15]];
+        uint64_t low = key.tableLow[x[15]];
+
+        for(int b = 14; b >= 0; b--) {
+            uint8_t dropped = static_cast<uint8_t>(low);
+            low = (high << 56) | (low >> 8);
+            high = (high >> 8) ^ (static_cast<uint64_t>(ghashReduction.entries[dropped]) << 48);
+
+            high ^= key.tableHigh[x[b]];
+            low ^= key.tableLow[x[b]];
+        }
+
+        stateHigh = high;
+        stateLow = low;
+    }
+
+    storeBigEndian64(state, stateHigh);
+    storeBigEndian64(state + 8, stateLow);
+}
+
+inline void ghashBlocks(const GHASHKey& key, uint8_t state[16], const uint8_t* data, size_t blocks) {
+    //absorbs whole blocks into state with whichever version the key was set up for
+#if AES_HAVE_AESNI
+    if(key.hardware) {
+        ghashBlocksHardware(key, state, data, blocks);
+        return;
+    }
+#endif
+    ghashBlocksTable(key, state, data, blocks);
+}
+
+inline void ghashPadded(const GHASHKey& key, uint8_t state[16], const uint8_t* data, size_t length) {
+    //absorbs length bytes, with a partial last block padded out with zeros
+    size_t whole = length / 16;
+
+    ghashBlocks(key, state, data, whole);
+
+    if(length % 16 != 0) {
+        uint8_t last[16] = {};
+        memcpy(last, data + 16 * whole, length % 16);
+        ghashBlocks(key, state, last, 1);
+    }
+}
+
+#endif
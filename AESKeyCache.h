@@ -0,0 +1,260 @@
+// AESKeyCache.h
+// A bounded, thread safe cache of expanded keys, for flows where every tenant or record has its own key
+//
+// - Keys are looked up by a 64 bit hash seeded per cache from the operating system's generator, so outside input
+//   cannot aim for collisions. A hit still compares the whole key before it is trusted
+// - Entries live in shards, each with its own lock and its own least recently used list, so threads looking up
+//   different keys rarely wait on each other. A full shard evicts its least recently used entry
+// - Contexts are handed out as shared pointers, an evicted context stays valid until its last user lets go of it
+//   and its round keys are wiped when it is freed. They live in locked memory from lockedKeyPool, so they never reach swap
+// - Keys are expanded outside the shard lock, and getMany expands all of its misses in one prepareKeys call
+//
+// The cache keeps copies of the raw keys it holds, and wipes them on eviction and when it is destroyed
+
+#ifndef AES_KEY_CACHE_H
+#define AES_KEY_CACHE_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memcmp
+#include <atomic> //hit and miss counters
+#include <iterator> //prev for the oldest entry
+#include <list> //least recently used order within a shard
+#include <memory> //shared ownership of handed out contexts
+#include <mutex> //one lock per shard
+#include <unordered_map> //hash to entry lookup
+#include <vector> //the shards
+
+#include "AESCore.h" //AESKeyContext and secureZero
+#include "AESEngine.h" //prepareKey and prepareKeys
+#include "AESRandom.h" //the hash seed
+#include "AESMemory.h" //locked memory for the contexts and scratch space for bulk lookups
+
+inline constexpr size_t keyCacheCapacity = 4096;//default number of expanded keys kept
+inline constexpr size_t keyCacheShards = 16;//independently locked parts of the cache
+inline constexpr size_t keyCacheExpandChunk = 32;//misses getMany expands per prepareKeys call, a multiple of keyLanesHardware
+
+class AESKeyCache {
+    //expanded keys by hash of the key, with least recently used eviction
+public:
+    explicit AESKeyCache(size_t capacity = keyCacheCapacity) : shards(keyCacheShards) {
+        shardCapacity = (capacity + keyCacheShards - 1) / keyCacheShards;
+        if(shardCapacity == 0) {
+            shardCapacity = 1;
+        }
+
+        randomBytes(reinterpret_cast<uint8_t*>(&seed), sizeof(seed));
+    }
+
+    ~AESKeyCache() {
+        clear();
+    }
+
+    AESKeyCache(const AESKeyCache&) = delete;
+    AESKeyCache& operator=(const AESKeyCache&) = delete;
+
+    std::shared_ptr<const AESKeyContext> get(const uint8_t* key, size_t keyLength) {
+        //the expanded context for key, expanding and caching it on a miss
+        //returns nullptr if the key is not 16, 24, or 32 bytes
+        if(!isValidKeyLength(static_cast<int>(keyLength))) {
+            return nullptr;
+        }
+
+        uint64_t hash = hashKey(key, keyLength);
+
+        if(auto context = find(hash, key, keyLength)) {
+            return context;
+        }
+
+        std::shared_ptr<AESKeyContext> context = makeContext();
+        prepareKey(*context, key, keyLength);
+
+        return insert(hash, key, keyLength, std::move(context));
+    }
+
+    bool getMany(const uint8_t* keys, size_t keyLength, size_t count, std::shared_ptr<const AESKeyContext>* out) {
+        //looks up count keys of keyLength bytes stored back to back, and fills out[i] with the context for key i
+        //all the misses are expanded together by prepareKeys, so a cold batch pays for the bulk expansion only once
+        //returns false and leaves out untouched if the key length is not 16, 24, or 32 bytes
+        if(!isValidKeyLength(static_cast<int>(keyLength))) {
+            return false;
+        }
+
+        AESArenaScope scratch;
+        size_t* missing = scratch.allocate<size_t>(count);
+        uint64_t* hashes = scratch.allocate<uint64_t>(count);
+        size_t missingCount = 0;
+
+        for(size_t i = 0; i < count; i++) {
+            hashes[i] = hashKey(keys + keyLength * i, keyLength);
+            out[i] = find(hashes[i], keys + keyLength * i, keyLength);
+
+            if(out[i] == nullptr) {
+                missing[missingCount++] = i;
+            }
+        }
+
+        if(missingCount == 0) {
+            return true;
+        }
+
+        //misses are expanded keyCacheExpandChunk at a time into a buffer on the stack, then copied into their own contexts
+        alignas(16) uint8_t missingKeys[keyCacheExpandChunk * 32];
+        AESKeyContext expanded[keyCacheExpandChunk];
+
+        for(size_t first = 0; first < missingCount; first += keyCacheExpandChunk) {
+            size_t chunk = missingCount - first < keyCacheExpandChunk ? missingCount - first : keyCacheExpandChunk;
+
+            for(size_t m = 0; m < chunk; m++) {
+                memcpy(missingKeys + keyLength * m, keys + keyLength * missing[first + m], keyLength);
+            }
+
+            prepareKeys(expanded, missingKeys, keyLength, chunk);
+
+            for(size_t m = 0; m < chunk; m++) {
+                size_t i = missing[first + m];
+
+                std::shared_ptr<AESKeyContext> context = makeContext();
+                *context = expanded[m];
+
+                out[i] = insert(hashes[i], keys + keyLength * i, keyLength, std::move(context));
+            }
+        }
+
+        secureZero(missingKeys, sizeof(missingKeys));
+        secureZero(expanded, sizeof(expanded));
+
+        return true;
+    }
+
+    void clear() {
+        //drops every entry, contexts still held by callers stay valid
+        for(auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            for(auto& entry : shard.entries) {
+                secureZero(entry.key, sizeof(entry.key));
+            }
+
+            shard.entries.clear();
+            shard.index.clear();
+        }
+    }
+
+    size_t size() {
+        //number of keys currently cached
+        size_t total = 0;
+
+        for(auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.entries.size();
+        }
+
+        return total;
+    }
+
+    size_t capacity() const { return shardCapacity * keyCacheShards; }
+    uint64_t hits() const { return hitCount.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return missCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint8_t key[32];
+        size_t keyLength;
+        std::shared_ptr<const AESKeyContext> context;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> entries;//most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    static std::shared_ptr<AESKeyContext> makeContext() {
+        //a context in locked memory whose round keys are wiped when the last pointer to it goes away
+        return makeLockedKeyContext();
+    }
+
+    uint64_t hashKey(const uint8_t* key, size_t keyLength) const {
+        //multiply and shift mixing over the key's 8 byte words, starting from the per cache seed
+        uint64_t hash = seed ^ keyLength;
+
+        for(size_t i = 0; i < keyLength; i += 8) {
+            uint64_t word;
+            memcpy(&word, key + i, 8);
+
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 29;
+        }
+
+        return hash;
+    }
+
+    Shard& shardFor(uint64_t hash) {
+        return shards[(hash >> 32) % keyCacheShards];
+    }
+
+    std::shared_ptr<const AESKeyContext> find(uint64_t hash, const uint8_t* key, size_t keyLength) {
+        //the cached context for key, moved to the front of its shard, or nullptr
+        Shard& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto found = shard.index.find(hash);
+
+        if(found == shard.index.end() || found->second->keyLength != keyLength || memcmp(found->second->key, key, keyLength) != 0) {
+            missCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+        hitCount.fetch_add(1, std::memory_order_relaxed);
+
+        return found->second->context;
+    }
+
+    std::shared_ptr<const AESKeyContext> insert(uint64_t hash, const uint8_t* key, size_t keyLength, std::shared_ptr<const AESKeyContext> context) {
+        //adds a freshly expanded context and returns the one now cached for key
+        //another thread may have added the same key since the lookup missed, then its context wins.
+        //A different key with the same hash is replaced
+        Shard& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto found = shard.index.find(hash);
+
+        if(found != shard.index.end()) {
+            Entry& entry = *found->second;
+
+            if(entry.keyLength == keyLength && memcmp(entry.key, key, keyLength) == 0) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+                return entry.context;
+            }
+
+            erase(shard, found->second);
+        }
+
+        if(shard.entries.size() >= shardCapacity) {
+            erase(shard, std::prev(shard.entries.end()));
+        }
+
+        shard.entries.push_front(Entry{hash, {}, keyLength, std::move(context)});
+        memcpy(shard.entries.front().key, key, keyLength);
+        shard.index[hash] = shard.entries.begin();
+
+        return shard.entries.front().context;
+    }
+
+    static void erase(Shard& shard, std::list<Entry>::iterator entry) {
+        secureZero(entry->key, sizeof(entry->key));
+        shard.index.erase(entry->hash);
+        shard.entries.erase(entry);
+    }
+
+    std::vector<Shard> shards;
+    size_t shardCapacity = 1;
+    uint64_t seed = 0;
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+};
+
+#endif
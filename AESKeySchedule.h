@@ -0,0 +1,149 @@
+// AESKeySchedule.h
+// Expands an AES key into its round keys
+//
+// - The schedule is built word by word, the same way it is described in FIPS-197
+// - Each key size has its own instantiation of expandKeyFixed, so Nk, Nr, and every loop bound are compile time constants
+// - The decryption round keys are derived right after the encryption ones, so neither is ever recomputed per block
+// - The S-box step is a template parameter, so the bitsliced engine can expand keys without table lookups
+// - AESKeyContext holds the finished schedule flat and aligned, so a key only has to be expanded once
+//   and can then be shared by any number of messages and threads
+
+#ifndef AES_KEY_SCHEDULE_H
+#define AES_KEY_SCHEDULE_H
+
+#include <cstdint> //fixed width integer types for key bytes
+#include <cstddef> //size_t
+#include <cstring> //memcpy for copying the key into the context
+#include <vector> //the word by word key schedule returned by createKeys
+
+#include "AESCore.h" //AESKeyContext, AESKeySize, the S-box and round constants
+
+inline bool isValidKeyLength(int keyLength) {
+    // Returns a boolean on whether the given key length is valid for one of the AES Schema
+    return (keyLength == 16 || keyLength == 24 || keyLength == 32);
+}
+
+inline void subWordTable(uint8_t word[4]) {
+    //subs each byte of a word through the S-box table
+    word[0] = sBox[word[0]];
+    word[1] = sBox[word[1]];
+    word[2] = sBox[word[2]];
+    word[3] = sBox[word[3]];
+}
+
+using SubWordFunction = void (*)(uint8_t word[4]);
+
+template<SubWordFunction subWord = subWordTable>
+inline void keyGenShift(uint8_t word[4], int round) {
+    //Every Nk-th word in the generation of a key schedule will undergo a transformation before being XOR'ed with word i - Nk
+    //This involves a process of
+    //  shifting bytes
+    //  subbing bytes
+    //  and adding a round constant based on the round number
+    //The word is transformed in place
+
+    uint8_t first = word[0];
+
+    word[0] = word[1];//shifts left one
+    word[1] = word[2];
+    word[2] = word[3];
+    word[3] = first;
+
+    subWord(word);
+
+    word[0] ^= roundConstants.entries[round];
+}
+
+inline void prepareDecryptKeys(AESKeyContext& ctx) {
+    //fills ctx.decryptRoundKeys for the equivalent inverse cipher from the finished encryption round keys
+    //they are the encryption keys in reverse, with inverse mix columns applied to every one but the first and last
+
+    memcpy(ctx.decryptRoundKeys, ctx.roundKey(ctx.rounds), 16);
+    memcpy(ctx.decryptRoundKeys + 16 * ctx.rounds, ctx.roundKey(0), 16);
+
+    for(int round = 1; round < ctx.rounds; round++) {
+        AESState key;
+
+        memcpy(key.bytes, ctx.roundKey(ctx.rounds - round), 16);
+        invMixColumns(key);
+        memcpy(ctx.decryptRoundKeys + 16 * round, key.bytes, 16);
+    }
+}
+
+template<int KeyBytes, SubWordFunction subWord = subWordTable>
+inline void expandKeyFixed(AESKeyContext& ctx, const uint8_t* key) {
+    //expands a key of a size known at compile time into ctx
+    //word i of the schedule lands at byte 4 * i of ctx.roundKeys
+
+    constexpr int Nk = AESKeySize<KeyBytes>::Nk;
+    constexpr int words = AESKeySize<KeyBytes>::words;
+
+    uint8_t* w = ctx.roundKeys;
+
+    memcpy(w, key, KeyBytes);//the first Nk words are the key itself
+
+    for(int i = Nk; i < words; i++) {
+        uint8_t temp[4] = {w[4 * i - 4], w[4 * i - 3], w[4 * i - 2], w[4 * i - 1]};
+
+        if(i % Nk == 0) {
+            keyGenShift<subWord>(temp, i / Nk);
+        }
+        else if constexpr(Nk > 6) {
+            if(i % Nk == 4) {
+                //AES256 also subs the middle word of every group, without the shift or round constant
+                subWord(temp);
+            }
+        }
+
+        w[4 * i] = w[4 * (i - Nk)] ^ temp[0];
+        w[4 * i + 1] = w[4 * (i - Nk) + 1] ^ temp[1];
+        w[4 * i + 2] = w[4 * (i - Nk) + 2] ^ temp[2];
+        w[4 * i + 3] = w[4 * (i - Nk) + 3] ^ temp[3];
+    }
+
+    ctx.rounds = AESKeySize<KeyBytes>::Nr;
+
+    prepareDecryptKeys(ctx);
+}
+
+inline bool expandKey(AESKeyContext& ctx, const uint8_t* key, size_t keyLength) {
+    //expands key into ctx, picking the instantiation for its length
+    //returns false and leaves ctx untouched if the key is not 16, 24, or 32 bytes
+    switch(keyLength) {
+        case 16:
+            expandKeyFixed<16>(ctx, key);
+            return true;
+        case 24:
+            expandKeyFixed<24>(ctx, key);
+            return true;
+        case 32:
+            expandKeyFixed<32>(ctx, key);
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline std::vector<std::vector<uint8_t>> createKeys(const std::vector<uint8_t>& keyVec) {
+    //creates a key schedule based on the initial key, as a vector of 4 byte words
+    //generates 44 keys for aes128
+    //generates 52 keys for aes192
+    //generates 60 keys for aes256
+    //returns an empty schedule if the key is not a valid length
+
+    std::vector<std::vector<uint8_t>> v;//initializes our vector to hold our key schedule
+
+    AESKeyContext ctx;
+
+    if(!expandKey(ctx, keyVec.data(), keyVec.size())) {
+        return v;
+    }
+
+    for(int i = 0; i < 4 * (ctx.rounds + 1); i++) {
+        v.emplace_back(ctx.roundKeys + 4 * i, ctx.roundKeys + 4 * i + 4);
+    }
+
+    return v;
+}
+
+#endif
@@ -0,0 +1,210 @@
+// AESMappedFile.h
+// Encrypts files on local disk through memory maps, with no copies in between
+//
+// - The input is mapped read only and the output is created at its final size and mapped read/write,
+//   so the cipher reads plaintext straight out of the page cache and writes ciphertext straight into it
+// - The mapped buffers go through ctrEncrypt, so large files are spread across the thread pool the same as in memory buffers
+// - Output files use the same format as the streaming mode, the 16 byte initial counter block followed by the ciphertext
+// - A failure is described by an AESMappedFileError, the step that failed and the errno it failed with,
+//   so a caller can say whether the input was missing, too short, or the system refused a map or a resize
+// - Only built on POSIX systems, AES_HAVE_MMAP is 0 everywhere else and callers should use the streaming mode
+
+#ifndef AES_MAPPED_FILE_H
+#define AES_MAPPED_FILE_H
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AES_HAVE_MMAP 1
+#else
+#define AES_HAVE_MMAP 0
+#endif
+
+#if AES_HAVE_MMAP
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cerrno> //why a system call failed
+#include <fcntl.h> //open
+#include <sys/mman.h> //mmap, madvise, msync
+#include <sys/stat.h> //fstat for the file size and identity
+#include <unistd.h> //close, ftruncate
+
+#include "AESCore.h" //AESKeyContext
+#include "AESCTR.h" //CTR over the mapped buffers
+#include "AESDRBG.h" //fresh initial counter blocks
+
+struct AESMappedFileError {
+    const char* step = nullptr;//what could not be done, or nullptr if nothing failed
+    int error = 0;//errno from the system call that failed, 0 if the failure was not a system call's
+};
+
+class AESMappedFile {
+    //one whole file mapped into memory, unmapped and closed when it goes out of scope
+public:
+    AESMappedFile() = default;
+
+    ~AESMappedFile() {
+        close();
+    }
+
+    AESMappedFile(const AESMappedFile&) = delete;
+    AESMappedFile& operator=(const AESMappedFile&) = delete;
+
+    bool openRead(const char* path) {
+        //maps an existing file read only, returns false if it cannot be opened or mapped, and failure says which
+        fd = ::open(path, O_RDONLY);
+        if(fd < 0) {
+            return fail("cannot open the input");
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) != 0) {
+            return fail("cannot read the size of the input");
+        }
+
+        identity = info;
+
+        return map(static_cast<size_t>(info.st_size), PROT_READ) || fail("cannot map the input");
+    }
+
+    bool create(const char* path, size_t size, const AESMappedFile* notSameAs = nullptr) {
+        //creates or truncates a file to size bytes and maps it read/write
+        //fails without touching the file if it is the same file as notSameAs, so an input is never truncated under its own mapping
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if(fd < 0) {
+            return fail("cannot create the output");
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) != 0) {
+            return fail("cannot read the size of the output");
+        }
+
+        if(notSameAs != nullptr && info.st_dev == notSameAs->identity.st_dev && info.st_ino == notSameAs->identity.st_ino) {
+            return fail("the input and output are the same file", 0);
+        }
+
+        identity = info;
+
+        if(ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            return fail("cannot resize the output");
+        }
+
+        return map(size, PROT_READ | PROT_WRITE) || fail("cannot map the output");
+    }
+
+    bool sync() {
+        //flushes written pages back to the file
+        return mapping == nullptr || msync(mapping, length, MS_SYNC) == 0 || fail("cannot write the output back to disk");
+    }
+
+    void close() {
+        if(mapping != nullptr) {
+            munmap(mapping, length);
+            mapping = nullptr;
+        }
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        length = 0;
+    }
+
+    uint8_t* data() { return mapping; }
+    const uint8_t* data() const { return mapping; }
+    size_t size() const { return length; }
+    const AESMappedFileError& failure() const { return lastFailure; }
+
+private:
+    bool fail(const char* step, int error = errno) {
+        //records the step that failed along with errno as it stands, always returns false
+        lastFailure.step = step;
+        lastFailure.error = error;
+        return false;
+    }
+
+    bool map(size_t size, int protection) {
+        //empty files cannot be mapped, they are left as a null mapping of length 0
+        length = size;
+
+        if(size == 0) {
+            return true;
+        }
+
+        void* address = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if(address == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+
+        mapping = static_cast<uint8_t*>(address);
+
+        madvise(mapping, length, MADV_SEQUENTIAL);//the cipher walks the file front to back, so the kernel can read ahead
+
+        return true;
+    }
+
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    size_t length = 0;
+    struct stat identity {};
+    AESMappedFileError lastFailure;
+};
+
+inline bool mappedFileFailed(AESMappedFileError* error, const AESMappedFileError& failure) {
+    //hands a failure to the caller if it asked for one, always returns false
+    if(error != nullptr) {
+        *error = failure;
+    }
+    return false;
+}
+
+inline bool ctrEncryptMappedFile(const AESKeyContext& ctx, const char* inPath, const char* outPath, AESMappedFileError* error = nullptr) {
+    //encrypts inPath into outPath under a fresh initial counter block, written at the start of outPath
+    //returns false if either file cannot be mapped or they are the same file, and fills in error with why
+    AESMappedFile in;
+    AESMappedFile out;
+
+    if(!in.openRead(inPath)) {
+        return mappedFileFailed(error, in.failure());
+    }
+
+    if(!out.create(outPath, in.size() + 16, &in)) {
+        return mappedFileFailed(error, out.failure());
+    }
+
+    if(!drbgRandomBytes(out.data(), 16)) {
+        return mappedFileFailed(error, {"cannot get a random initial counter block", 0});
+    }
+
+    ctrEncrypt(ctx, out.data(), in.data(), out.data() + 16, in.size());
+
+    return out.sync() || mappedFileFailed(error, out.failure());
+}
+
+inline bool ctrDecryptMappedFile(const AESKeyContext& ctx, const char* inPath, const char* outPath, AESMappedFileError* error = nullptr) {
+    //decrypts a file written by ctrEncryptMappedFile or ctrEncryptStream
+    //returns false if either file cannot be mapped, they are the same file, or the input is too short to hold the counter block,
+    //and fills in error with why
+    AESMappedFile in;
+    AESMappedFile out;
+
+    if(!in.openRead(inPath)) {
+        return mappedFileFailed(error, in.failure());
+    }
+
+    if(in.size() < 16) {
+        return mappedFileFailed(error, {"the input is shorter than the 16 byte initial counter block", 0});
+    }
+
+    if(!out.create(outPath, in.size() - 16, &in)) {
+        return mappedFileFailed(error, out.failure());
+    }
+
+    ctrDecrypt(ctx, in.data(), in.data() + 16, out.data(), out.size());
+
+    return out.sync() || mappedFileFailed(error, out.failure());
+}
+
+#endif
+
+#endif
@@ -0,0 +1,329 @@
+// AESMemory.h
+// Scratch memory for the modes and locked memory for expanded keys, so steady state calls stay off the heap
+//
+// - AESArena is a bump allocator with one instance per thread. An AESArenaScope marks where the arena was and hands
+//   everything taken after it back when it ends, so scratch space costs a pointer bump and nothing is freed one by one
+// - Blocks the arena grows into are kept for the next call, so once a thread has seen its largest call
+//   it never allocates again
+// - AESLockedPool hands out fixed size slots carved from pages locked into RAM with mlock and left out of core dumps,
+//   so expanded keys are never written to swap or to a crash dump. Slots are wiped when they are given back,
+//   and the free list runs through the free slots themselves, so taking and returning a slot never allocates
+// - lockedKeyPool and makeLockedKeyContext put whole shared key contexts, reference counts included, into locked slots
+//
+// If the locked memory limit (RLIMIT_MEMLOCK) runs out, the pool keeps working with pages that are not locked and
+// lockedBytes stops growing. On systems without mmap the pages come from the heap and are never locked
+
+#ifndef AES_MEMORY_H
+#define AES_MEMORY_H
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AES_HAVE_MLOCK 1
+#else
+#define AES_HAVE_MLOCK 0
+#endif
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t and ptrdiff_t
+#include <cstring> //memset
+#include <memory> //allocate_shared for locked key contexts
+#include <mutex> //protects the pool's free list
+#include <new> //operator new for arena blocks and the heap fallback
+#include <type_traits> //the arena only holds trivially destructible types
+#include <vector> //arena blocks and pool chunks
+
+#if AES_HAVE_MLOCK
+#include <sys/mman.h> //mmap, mlock, and madvise
+#endif
+
+#include "AESCore.h" //AESKeyContext and secureZero
+
+inline constexpr size_t arenaBlockBytes = 64 * 1024;//smallest block an arena grows by
+inline constexpr size_t arenaAlignment = 64;//default alignment of arena allocations, one cache line
+inline constexpr size_t lockedChunkBytes = 64 * 1024;//bytes the locked pool maps at a time, a multiple of the page size
+inline constexpr size_t lockedKeySlotBytes = 640;//a key context plus the shared pointer bookkeeping allocate_shared puts in front of it
+
+class AESArena {
+    //scratch memory for one thread, given back in stack order through AESArenaScope
+public:
+    struct Mark {
+        size_t block;
+        size_t used;
+    };
+
+    AESArena() = default;
+
+    ~AESArena() {
+        for(auto& block : blocks) {
+            ::operator delete(block.data);
+        }
+    }
+
+    AESArena(const AESArena&) = delete;
+    AESArena& operator=(const AESArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = arenaAlignment) {
+        //bytes of uninitialized memory aligned to alignment, a power of two, valid until the arena is rewound past it
+        //moves on to the next kept block, or adds a new one, when the current block is out of room
+        while(true) {
+            if(current < blocks.size()) {
+                Block& block = blocks[current];
+                uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+                size_t start = static_cast<size_t>(((base + used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base);
+
+                if(start + bytes <= block.size) {
+                    used = start + bytes;
+                    return block.data + start;
+                }
+
+                if(current + 1 < blocks.size() && blocks[current + 1].size >= bytes + alignment) {
+                    current++;
+                    used = 0;
+                    continue;
+                }
+            }
+
+            grow(bytes + alignment);
+        }
+    }
+
+    Mark mark() const { return {current, used}; }
+
+    void rewind(Mark mark) {
+        //gives back everything allocated since mark was taken
+        current = mark.block;
+        used = mark.used;
+    }
+
+    size_t reservedBytes() const {
+        //bytes held in blocks, used or not
+        size_t total = 0;
+        for(const auto& block : blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+
+    void grow(size_t bytes) {
+        //puts a block of at least bytes right after the current one, the blocks after it are kept for later
+        size_t size = bytes < arenaBlockBytes ? arenaBlockBytes : bytes;
+        uint8_t* data = static_cast<uint8_t*>(::operator new(size));
+
+        size_t next = current < blocks.size() ? current + 1 : blocks.size();
+        blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(next), Block{data, size});
+
+        current = next;
+        used = 0;
+    }
+
+    std::vector<Block> blocks;
+    size_t current = 0;//block allocations come from
+    size_t used = 0;//bytes of the current block in use
+};
+
+inline AESArena& threadArena() {
+    //the calling thread's arena, its blocks are freed when the thread exits
+    thread_local AESArena arena;
+    return arena;
+}
+
+class AESArenaScope {
+    //takes scratch space from an arena and gives all of it back when the scope ends
+public:
+    explicit AESArenaScope(AESArena& arena = threadArena()) : arena(arena), start(arena.mark()) {}
+
+    ~AESArenaScope() {
+        arena.rewind(start);
+    }
+
+    AESArenaScope(const AESArenaScope&) = delete;
+    AESArenaScope& operator=(const AESArenaScope&) = delete;
+
+    template<class T>
+    T* allocate(size_t count) {
+        //room for count objects of T, left uninitialized, so only types that need no destructor
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed one object at a time");
+
+        size_t alignment = alignof(T) > arenaAlignment ? alignof(T) : arenaAlignment;
+        return static_cast<T*>(arena.allocate(sizeof(T) * count, alignment));
+    }
+
+private:
+    AESArena& arena;
+    AESArena::Mark start;
+};
+
+class AESLockedPool {
+    //fixed size slots in locked, non dumpable pages, wiped when they are released
+public:
+    explicit AESLockedPool(size_t slotBytes) : slotBytes((slotBytes + arenaAlignment - 1) / arenaAlignment * arenaAlignment) {}
+
+    ~AESLockedPool() {
+        //every slot should have been released by now, the pages are wiped whole anyway before they are unmapped
+        for(auto& chunk : chunks) {
+            secureZero(chunk.data, lockedChunkBytes);
+            freeChunk(chunk);
+        }
+    }
+
+    AESLockedPool(const AESLockedPool&) = delete;
+    AESLockedPool& operator=(const AESLockedPool&) = delete;
+
+    size_t slotSize() const { return slotBytes; }
+
+    void* allocate() {
+        //one zeroed slot of slotSize bytes, aligned to 64
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        if(freeList == nullptr) {
+            grow();
+        }
+
+        FreeSlot* slot = freeList;
+        freeList = slot->next;
+        slot->next = nullptr;//the rest of the slot was wiped when it was released or is fresh from the system
+
+        return slot;
+    }
+
+    void release(void* slot) {
+        //wipes a slot and puts it back on the free list
+        secureZero(slot, slotBytes);
+
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        FreeSlot* freed = static_cast<FreeSlot*>(slot);
+        freed->next = freeList;
+        freeList = freed;
+    }
+
+    size_t lockedBytes() {
+        //bytes of the pool actually locked into RAM
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        size_t total = 0;
+        for(const auto& chunk : chunks) {
+            total += chunk.locked ? lockedChunkBytes : 0;
+        }
+        return total;
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Chunk {
+        uint8_t* data;
+        bool locked;
+        bool mapped;
+    };
+
+    void grow() {
+        //maps and locks one more chunk and threads its slots onto the free list
+        Chunk chunk{nullptr, false, false};
+
+#if AES_HAVE_MLOCK
+        void* pages = mmap(nullptr, lockedChunkBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(pages != MAP_FAILED) {
+            chunk.data = static_cast<uint8_t*>(pages);
+            chunk.mapped = true;
+            chunk.locked = mlock(pages, lockedChunkBytes) == 0;
+#ifdef MADV_DONTDUMP
+            madvise(pages, lockedChunkBytes, MADV_DONTDUMP);
+#endif
+        }
+#endif
+
+        if(chunk.data == nullptr) {
+            chunk.data = static_cast<uint8_t*>(::operator new(lockedChunkBytes, std::align_val_t(arenaAlignment)));
+            memset(chunk.data, 0, lockedChunkBytes);
+        }
+
+        chunks.push_back(chunk);
+
+        for(size_t offset = lockedChunkBytes / slotBytes * slotBytes; offset >= slotBytes; offset -= slotBytes) {
+            FreeSlot* slot = reinterpret_cast<FreeSlot*>(chunk.data + offset - slotBytes);
+            slot->next = freeList;
+            freeList = slot;
+        }
+    }
+
+    static void freeChunk(const Chunk& chunk) {
+#if AES_HAVE_MLOCK
+        if(chunk.mapped) {
+            if(chunk.locked) {
+                munlock(chunk.data, lockedChunkBytes);
+            }
+            munmap(chunk.data, lockedChunkBytes);
+            return;
+        }
+#endif
+        ::operator delete(chunk.data, std::align_val_t(arenaAlignment));
+    }
+
+    size_t slotBytes;
+    std::mutex poolMutex;
+    FreeSlot* freeList = nullptr;
+    std::vector<Chunk> chunks;
+};
+
+inline AESLockedPool& lockedKeyPool() {
+    //shared pool of key sized slots, created on first use and never destroyed,
+    //so contexts that outlive it in other static objects still have somewhere to go back to
+    static AESLockedPool* pool = new AESLockedPool(lockedKeySlotBytes);
+    return *pool;
+}
+
+template<class T>
+struct AESLockedAllocator {
+    //allocator over lockedKeyPool, for allocate_shared of key material
+    //anything that does not fit in a slot comes from the heap instead, and is still wiped when it is freed
+    using value_type = T;
+
+    AESLockedAllocator() = default;
+
+    template<class U>
+    AESLockedAllocator(const AESLockedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        size_t bytes = sizeof(T) * count;
+
+        if(bytes <= lockedKeyPool().slotSize() && alignof(T) <= arenaAlignment) {
+            return static_cast<T*>(lockedKeyPool().allocate());
+        }
+
+        return static_cast<T*>(::operator new(bytes, std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* data, size_t count) {
+        size_t bytes = sizeof(T) * count;
+
+        if(bytes <= lockedKeyPool().slotSize() && alignof(T) <= arenaAlignment) {
+            lockedKeyPool().release(data);
+            return;
+        }
+
+        secureZero(data, bytes);
+        ::operator delete(data, std::align_val_t(alignof(T)));
+    }
+
+    template<class U>
+    bool operator==(const AESLockedAllocator<U>&) const { return true; }
+
+    template<class U>
+    bool operator!=(const AESLockedAllocator<U>&) const { return false; }
+};
+
+inline std::shared_ptr<AESKeyContext> makeLockedKeyContext() {
+    //an empty key context living in a locked slot together with its reference counts, wiped when the last pointer goes
+    return std::allocate_shared<AESKeyContext>(AESLockedAllocator<AESKeyContext>());
+}
+
+#endif
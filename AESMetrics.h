@@ -0,0 +1,389 @@
+// AESMetrics.h
+// Counters for what the library has encrypted, readable at run time without a debugger
+//
+// - Every mode entry point counts its calls, bytes, and blocks, split by the engine that ran it and by the mode
+// - Key expansions are counted per engine
+// - One call in metricsLatencySampleEvery on each thread is timed, and its latency goes into a histogram with
+//   power of two nanosecond buckets
+// - Counters are relaxed atomics, striped metricsStripes ways by thread so cores rarely write the same cache line.
+//   A call that is not timed costs a few uncontended atomic adds
+// - metricsText renders everything in the Prometheus text format, so a service can hand it to a scraper as is
+// - setMetricsEnabled turns counting off at run time, and building with -DAES_METRICS=0 removes it completely
+//
+// Engines are told apart by their name pointer, so this file does not need to know about the engines themselves
+
+#ifndef AES_METRICS_H
+#define AES_METRICS_H
+
+#ifndef AES_METRICS
+#define AES_METRICS 1
+#endif
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <string> //the rendered metrics
+
+#if AES_METRICS
+#include <cstring> //strcmp for engine names
+#include <cstdio> //snprintf for the rendered metrics
+#include <atomic> //the counters
+#include <chrono> //latency samples
+#endif
+
+enum class AESMetricsMode {
+    CTR,
+    CBCEncrypt,
+    CBCDecrypt,
+    CBCMulti,
+    GCMEncrypt,
+    GCMDecrypt,
+    XTSEncrypt,
+    XTSDecrypt,
+    CTRRecords,
+    CBCDecryptRecords,
+    OFB,
+    CFBEncrypt,
+    CFBDecrypt,
+    Count
+};
+
+inline constexpr size_t metricsModes = static_cast<size_t>(AESMetricsMode::Count);
+inline constexpr size_t metricsEngineSlots = 8;//distinct engine names that can be counted
+inline constexpr size_t metricsStripes = 8;//copies of each counter, threads are spread over them
+inline constexpr size_t metricsLatencyBuckets = 32;//bucket i holds latencies under 2^(i + 1) ns, the last one everything longer
+inline constexpr uint64_t metricsLatencySampleEvery = 16;//calls per thread for each one that is timed
+
+inline const char* metricsModeName(AESMetricsMode mode) {
+    //the label a mode is reported under
+    static const char* const names[metricsModes] = {
+        "ctr", "cbc-encrypt", "cbc-decrypt", "cbc-multi", "gcm-encrypt", "gcm-decrypt",
+        "xts-encrypt", "xts-decrypt", "ctr-records", "cbc-decrypt-records",
+        "ofb", "cfb-encrypt", "cfb-decrypt"
+    };
+
+    return names[static_cast<size_t>(mode)];
+}
+
+struct AESMetricsTotals {
+    uint64_t operations = 0;//calls into the mode
+    uint64_t bytes = 0;//bytes passed in
+    uint64_t blocks = 0;//blocks those bytes fill, counting a short last block
+    uint64_t latencySamples = 0;//calls that were timed
+    uint64_t latencyNanoseconds = 0;//total time of the timed calls
+    uint64_t latencyBuckets[metricsLatencyBuckets] = {};//timed calls by bucket, not cumulative
+};
+
+#if AES_METRICS
+
+struct alignas(64) AESMetricsCounters {
+    std::atomic<uint64_t> operations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> blocks;
+    std::atomic<uint64_t> latencySamples;
+    std::atomic<uint64_t> latencyNanoseconds;
+    std::atomic<uint64_t> latencyBuckets[metricsLatencyBuckets];
+};
+
+struct AESMetricsTable {
+    std::atomic<const char*> engines[metricsEngineSlots];
+    AESMetricsCounters counters[metricsEngineSlots][metricsModes][metricsStripes];
+    std::atomic<uint64_t> keyExpansions[metricsEngineSlots][metricsStripes];
+    std::atomic<bool> disabled;
+    std::atomic<size_t> nextStripe;
+};
+
+//every member starts at zero and none has a constructor, so the table is ready before main
+//and the hot path reads it without a guard variable
+inline AESMetricsTable metricsTableStorage;
+
+inline AESMetricsTable& metricsTable() {
+    //the process wide counters
+    return metricsTableStorage;
+}
+
+struct AESMetricsThread {
+    size_t stripe;//one more than the copy of the counters this thread adds to, 0 until it counts something
+    uint64_t calls;//calls seen, for picking the ones to time
+};
+
+inline AESMetricsThread& metricsThread() {
+    //this thread's stripe, handed out round robin as threads first count something
+    //the thread local is plain data, so it needs no per thread constructor call either
+    thread_local AESMetricsThread thread;
+
+    if(thread.stripe == 0) {
+        thread.stripe = metricsTable().nextStripe.fetch_add(1, std::memory_order_relaxed) % metricsStripes + 1;
+    }
+
+    return thread;
+}
+
+inline bool metricsEnabled() {
+    return !metricsTable().disabled.load(std::memory_order_relaxed);
+}
+
+inline void setMetricsEnabled(bool enabled) {
+    //turns counting on or off for the whole process, counts taken so far are kept
+    metricsTable().disabled.store(!enabled, std::memory_order_relaxed);
+}
+
+inline int metricsEngineSlot(const char* engineName, bool add) {
+    //the slot engineName counts into, claiming a free one if add is set
+    //returns -1 if the engine has no slot, or every slot is taken
+    AESMetricsTable& table = metricsTable();
+
+    for(size_t i = 0; i < metricsEngineSlots; i++) {
+        const char* name = table.engines[i].load(std::memory_order_acquire);
+
+        if(name == nullptr) {
+            if(!add) {
+                return -1;
+            }
+
+            if(table.engines[i].compare_exchange_strong(name, engineName, std::memory_order_acq_rel)) {
+                return static_cast<int>(i);
+            }
+        }
+
+        //a different pointer to the same name shares the slot
+        if(name == engineName || strcmp(name, engineName) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1;
+}
+
+inline size_t metricsLatencyBucket(uint64_t nanoseconds) {
+    //the bucket for a latency, the position of its highest set bit
+    size_t bucket = 0;
+
+    while(nanoseconds > 1 && bucket < metricsLatencyBuckets - 1) {
+        nanoseconds >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+class AESMetricsScope {
+    //counts one call into a mode, and times it if this thread is due a sample
+public:
+    AESMetricsScope(const char* engineName, AESMetricsMode mode, uint64_t bytes) {
+        if(!metricsEnabled()) {
+            return;
+        }
+
+        int slot = metricsEngineSlot(engineName, true);
+        if(slot < 0) {
+            return;
+        }
+
+        AESMetricsThread& thread = metricsThread();
+        counters = &metricsTable().counters[slot][static_cast<size_t>(mode)][thread.stripe - 1];
+
+        counters->operations.fetch_add(1, std::memory_order_relaxed);
+        counters->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        counters->blocks.fetch_add((bytes + 15) / 16, std::memory_order_relaxed);
+
+        if(++thread.calls % metricsLatencySampleEvery == 0) {
+            sampled = true;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~AESMetricsScope() {
+        if(!sampled) {
+            return;
+        }
+
+        uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        counters->latencySamples.fetch_add(1, std::memory_order_relaxed);
+        counters->latencyNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        counters->latencyBuckets[metricsLatencyBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    AESMetricsScope(const AESMetricsScope&) = delete;
+    AESMetricsScope& operator=(const AESMetricsScope&) = delete;
+
+private:
+    AESMetricsCounters* counters = nullptr;
+    bool sampled = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+inline void recordKeyExpansions(const char* engineName, uint64_t count) {
+    //counts count keys expanded by an engine
+    if(!metricsEnabled()) {
+        return;
+    }
+
+    int slot = metricsEngineSlot(engineName, true);
+    if(slot < 0) {
+        return;
+    }
+
+    metricsTable().keyExpansions[slot][metricsThread().stripe - 1].fetch_add(count, std::memory_order_relaxed);
+}
+
+inline AESMetricsTotals metricsTotals(const char* engineName, AESMetricsMode mode) {
+    //everything counted for one engine and mode, summed over the stripes
+    AESMetricsTotals totals;
+
+    int slot = metricsEngineSlot(engineName, false);
+    if(slot < 0) {
+        return totals;
+    }
+
+    for(const AESMetricsCounters& stripe : metricsTable().counters[slot][static_cast<size_t>(mode)]) {
+        totals.operations += stripe.operations.load(std::memory_order_relaxed);
+        totals.bytes += stripe.bytes.load(std::memory_order_relaxed);
+        totals.blocks += stripe.blocks.load(std::memory_order_relaxed);
+        totals.latencySamples += stripe.latencySamples.load(std::memory_order_relaxed);
+        totals.latencyNanoseconds += stripe.latencyNanoseconds.load(std::memory_order_relaxed);
+
+        for(size_t b = 0; b < metricsLatencyBuckets; b++) {
+            totals.latencyBuckets[b] += stripe.latencyBuckets[b].load(std::memory_order_relaxed);
+        }
+    }
+
+    return totals;
+}
+
+inline uint64_t metricsKeyExpansions(const char* engineName) {
+    //keys expanded by one engine
+    int slot = metricsEngineSlot(engineName, false);
+    if(slot < 0) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+
+    for(const auto& stripe : metricsTable().keyExpansions[slot]) {
+        total += stripe.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+inline std::string metricsText() {
+    //every counter in the Prometheus text exposition format, labelled by engine and mode
+    //modes an engine never ran are left out
+    AESMetricsTable& table = metricsTable();
+    std::string text;
+    char line[256];
+
+    auto append = [&](const char* format, auto... args) {
+        snprintf(line, sizeof(line), format, args...);
+        text += line;
+    };
+
+    text += "# HELP aes_key_expansions_total Keys expanded.\n# TYPE aes_key_expansions_total counter\n";
+
+    for(size_t slot = 0; slot < metricsEngineSlots; slot++) {
+        const char* engine = table.engines[slot].load(std::memory_order_acquire);
+
+        if(engine != nullptr) {
+            append("aes_key_expansions_total{engine=\"%s\"} %llu\n", engine, static_cast<unsigned long long>(metricsKeyExpansions(engine)));
+        }
+    }
+
+    const char* counterNames[3] = {"aes_operations_total", "aes_bytes_total", "aes_blocks_total"};
+    const char* counterHelp[3] = {"Calls into a mode.", "Bytes passed to a mode.", "Blocks passed to a mode."};
+
+    for(int counter = 0; counter < 3; counter++) {
+        append("# HELP %s %s\n# TYPE %s counter\n", counterNames[counter], counterHelp[counter], counterNames[counter]);
+
+        for(size_t slot = 0; slot < metricsEngineSlots; slot++) {
+            const char* engine = table.engines[slot].load(std::memory_order_acquire);
+
+            for(size_t m = 0; engine != nullptr && m < metricsModes; m++) {
+                AESMetricsTotals totals = metricsTotals(engine, static_cast<AESMetricsMode>(m));
+
+                if(totals.operations == 0) {
+                    continue;
+                }
+
+                uint64_t value = counter == 0 ? totals.operations : counter == 1 ? totals.bytes : totals.blocks;
+                append("%s{engine=\"%s\",mode=\"%s\"} %llu\n", counterNames[counter], engine, metricsModeName(static_cast<AESMetricsMode>(m)), static_cast<unsigned long long>(value));
+            }
+        }
+    }
+
+    text += "# HELP aes_latency_seconds Latency of sampled calls into a mode.\n# TYPE aes_latency_seconds histogram\n";
+
+    for(size_t slot = 0; slot < metricsEngineSlots; slot++) {
+        const char* engine = table.engines[slot].load(std::memory_order_acquire);
+
+        for(size_t m = 0; engine != nullptr && m < metricsModes; m++) {
+            AESMetricsTotals totals = metricsTotals(engine, static_cast<AESMetricsMode>(m));
+
+            if(totals.latencySamples == 0) {
+                continue;
+            }
+
+            const char* mode = metricsModeName(static_cast<AESMetricsMode>(m));
+            uint64_t cumulative = 0;
+
+            for(size_t b = 0; b + 1 < metricsLatencyBuckets; b++) {
+                cumulative += totals.latencyBuckets[b];
+                append("aes_latency_seconds_bucket{engine=\"%s\",mode=\"%s\",le=\"%.9g\"} %llu\n", engine, mode, static_cast<double>(uint64_t(2) << b) * 1e-9, static_cast<unsigned long long>(cumulative));
+            }
+
+            append("aes_latency_seconds_bucket{engine=\"%s\",mode=\"%s\",le=\"+Inf\"} %llu\n", engine, mode, static_cast<unsigned long long>(totals.latencySamples));
+            append("aes_latency_seconds_sum{engine=\"%s\",mode=\"%s\"} %.9f\n", engine, mode, static_cast<double>(totals.latencyNanoseconds) * 1e-9);
+            append("aes_latency_seconds_count{engine=\"%s\",mode=\"%s\"} %llu\n", engine, mode, static_cast<unsigned long long>(totals.latencySamples));
+        }
+    }
+
+    return text;
+}
+
+inline void resetMetrics() {
+    //zeroes every counter, engines keep their slots
+    AESMetricsTable& table = metricsTable();
+
+    for(auto& engine : table.counters) {
+        for(auto& mode : engine) {
+            for(AESMetricsCounters& stripe : mode) {
+                stripe.operations.store(0, std::memory_order_relaxed);
+                stripe.bytes.store(0, std::memory_order_relaxed);
+                stripe.blocks.store(0, std::memory_order_relaxed);
+                stripe.latencySamples.store(0, std::memory_order_relaxed);
+                stripe.latencyNanoseconds.store(0, std::memory_order_relaxed);
+
+                for(auto& bucket : stripe.latencyBuckets) {
+                    bucket.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    for(auto& engine : table.keyExpansions) {
+        for(auto& stripe : engine) {
+            stripe.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+#else
+
+//with AES_METRICS off the same calls compile to nothing, so callers need no #if of their own
+
+class AESMetricsScope {
+public:
+    AESMetricsScope(const char*, AESMetricsMode, uint64_t) {}
+};
+
+inline bool metricsEnabled() { return false; }
+inline void setMetricsEnabled(bool) {}
+inline void recordKeyExpansions(const char*, uint64_t) {}
+inline AESMetricsTotals metricsTotals(const char*, AESMetricsMode) { return AESMetricsTotals(); }
+inline uint64_t metricsKeyExpansions(const char*) { return 0; }
+inline std::string metricsText() { return std::string(); }
+inline void resetMetrics() {}
+
+#endif
+
+#endif
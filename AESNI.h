@@ -0,0 +1,478 @@
+// AESNI.h
+// Hardware AES engine using the x86 AES-NI instructions
+//
+// - Each round is a single aesenc, and the last round is aesenclast
+// - Runs of blocks are interleaved eight at a time, which covers the latency of aesenc on current cores
+// - CTR has its own fused loop that builds counters in registers and XORs the data as each block finishes
+// - Decryption is aesdec and aesdeclast with the equivalent inverse round keys, which aesimc derives once per key
+// - Key expansion uses aeskeygenassist and writes the same round key bytes as expandKey,
+//   so a context expanded either way can be used by every engine
+// - Many keys at once go through expandKeysHardware, which runs eight AES128 or AES256 schedules side by side
+// - The functions are compiled for AES-NI with a target attribute instead of a global -maes flag,
+//   so the rest of the program still runs on machines without it. Only call them when cpuFeatures().aesni is set
+//
+// On compilers or CPUs without AES-NI this header defines nothing and AES_HAVE_AESNI stays 0
+
+#ifndef AES_NI_H
+#define AES_NI_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+
+#include <cstring> //memcpy
+
+#include "AESCore.h" //AESKeyContext
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AES_HAVE_AESNI 1
+#else
+#define AES_HAVE_AESNI 0
+#endif
+
+#if AES_HAVE_AESNI
+
+#include <immintrin.h> //AES-NI and SSE intrinsics
+
+#define AES_TARGET_AESNI __attribute__((target("aes,sse2")))
+#define AES_TARGET_AESNI_SSSE3 __attribute__((target("aes,ssse3,sse2")))
+
+AES_TARGET_AESNI inline __m128i keyAssist128(__m128i key, __m128i assist) {
+    //finishes one AES128 round key from the previous one and the aeskeygenassist output
+    //each word is XOR'ed with every word before it, then with g() of the last word of the previous key
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 8));
+    return _mm_xor_si128(key, assist);
+}
+
+AES_TARGET_AESNI inline __m128i keyAssist256(__m128i key, __m128i previous) {
+    //finishes the odd AES256 round keys, which use sub word without the rotate or round constant
+    __m128i assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(previous, 0x00), 0xaa);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 8));
+    return _mm_xor_si128(key, assist);
+}
+
+AES_TARGET_AESNI inline uint32_t subWordHardware(uint32_t word) {
+    //runs the S-box over the 4 bytes of a word using aeskeygenassist
+    //word is broadcast so it sits in dword 1, and dword 0 of the result is SubWord(dword 1)
+    __m128i v = _mm_shuffle_epi32(_mm_cvtsi32_si128(static_cast<int>(word)), 0x00);
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_aeskeygenassist_si128(v, 0x00)));
+}
+
+AES_TARGET_AESNI inline void expandKey128Hardware(AESKeyContext& ctx, const uint8_t* key) {
+    //AES128 schedule, one whole round key per step
+    __m128i* rk = reinterpret_cast<__m128i*>(ctx.roundKeys);
+
+    rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    rk[1] = keyAssist128(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+    rk[2] = keyAssist128(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+    rk[3] = keyAssist128(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+    rk[4] = keyAssist128(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+    rk[5] = keyAssist128(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+    rk[6] = keyAssist128(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+    rk[7] = keyAssist128(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+    rk[8] = keyAssist128(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+    rk[9] = keyAssist128(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+    rk[10] = keyAssist128(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+
+    ctx.rounds = 10;
+}
+
+AES_TARGET_AESNI inline void expandKey192Hardware(AESKeyContext& ctx, const uint8_t* key) {
+    //AES192 round keys do not line up with its 6 word steps, so this goes a word at a time
+    //and only uses the hardware for the S-box
+    uint32_t w[52];
+
+    for(int i = 0; i < 6; i++) {
+        w[i] = static_cast<uint32_t>(key[4 * i]) | static_cast<uint32_t>(key[4 * i + 1]) << 8
+             | static_cast<uint32_t>(key[4 * i + 2]) << 16 | static_cast<uint32_t>(key[4 * i + 3]) << 24;
+    }
+
+    for(int i = 6; i < 52; i++) {
+        uint32_t temp = w[i - 1];
+
+        if(i % 6 == 0) {
+            temp = subWordHardware(temp);
+            temp = ((temp >> 8) | (temp << 24)) ^ roundConstants.entries[i / 6];//rotate word, then the round constant goes into the first byte
+        }
+
+        w[i] = w[i - 6] ^ temp;
+    }
+
+    for(int i = 0; i < 52; i++) {
+        ctx.roundKeys[4 * i] = static_cast<uint8_t>(w[i]);
+        ctx.roundKeys[4 * i + 1] = static_cast<uint8_t>(w[i] >> 8);
+        ctx.roundKeys[4 * i + 2] = static_cast<uint8_t>(w[i] >> 16);
+        ctx.roundKeys[4 * i + 3] = static_cast<uint8_t>(w[i] >> 24);
+    }
+
+    ctx.rounds = 12;
+}
+
+AES_TARGET_AESNI inline void expandKey256Hardware(AESKeyContext& ctx, const uint8_t* key) {
+    //AES256 schedule, alternating a full g() step and a sub word only step
+    __m128i* rk = reinterpret_cast<__m128i*>(ctx.roundKeys);
+
+    rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    rk[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 16));
+    rk[2] = keyAssist128(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01));
+    rk[3] = keyAssist256(rk[1], rk[2]);
+    rk[4] = keyAssist128(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02));
+    rk[5] = keyAssist256(rk[3], rk[4]);
+    rk[6] = keyAssist128(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04));
+    rk[7] = keyAssist256(rk[5], rk[6]);
+    rk[8] = keyAssist128(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08));
+    rk[9] = keyAssist256(rk[7], rk[8]);
+    rk[10] = keyAssist128(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10));
+    rk[11] = keyAssist256(rk[9], rk[10]);
+    rk[12] = keyAssist128(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20));
+    rk[13] = keyAssist256(rk[11], rk[12]);
+    rk[14] = keyAssist128(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+
+    ctx.rounds = 14;
+}
+
+AES_TARGET_AESNI inline void prepareDecryptKeysHardware(AESKeyContext& ctx) {
+    //hardware version of prepareDecryptKeys, aesimc is inverse mix columns on a whole round key
+    const __m128i* rk = reinterpret_cast<const __m128i*>(ctx.roundKeys);
+    __m128i* dk = reinterpret_cast<__m128i*>(ctx.decryptRoundKeys);
+
+    dk[0] = rk[ctx.rounds];
+    dk[ctx.rounds] = rk[0];
+
+    for(int round = 1; round < ctx.rounds; round++) {
+        dk[round] = _mm_aesimc_si128(rk[ctx.rounds - round]);
+    }
+}
+
+inline bool expandKeyHardware(AESKeyContext& ctx, const uint8_t* key, size_t keyLength) {
+    //hardware version of expandKey, same contract and the same round key bytes
+    switch(keyLength) {
+        case 16:
+            expandKey128Hardware(ctx, key);
+            break;
+        case 24:
+            expandKey192Hardware(ctx, key);
+            break;
+        case 32:
+            expandKey256Hardware(ctx, key);
+            break;
+        default:
+            return false;
+    }
+
+    prepareDecryptKeysHardware(ctx);
+
+    return true;
+}
+
+inline constexpr size_t keyLanesHardware = 8;//keys expanded side by side by expandKeysHardware
+
+AES_TARGET_AESNI inline __m128i keyFold(__m128i key, __m128i word) {
+    //XORs each word of key with every word before it, then with word, which is broadcast to all four lanes
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 8));
+    return _mm_xor_si128(key, word);
+}
+
+template<size_t Lanes>
+AES_TARGET_AESNI_SSSE3 inline void expandKeys128HardwareLanes(AESKeyContext* contexts, const uint8_t* keys) {
+    //expands Lanes AES128 keys side by side
+    //aeskeygenassist is microcoded and slow on many cores, and its round constant has to be an immediate.
+    //Broadcasting RotWord of the last word to every column makes ShiftRows a no-op, so aesenclast with the round constant
+    //as its round key gives SubWord(RotWord(w)) ^ rcon in every lane, and it pipelines like any other aesenclast
+    const __m128i rotate = _mm_set1_epi32(0x0c0f0e0d);
+
+    __m128i k[Lanes];
+
+    for(size_t j = 0; j < Lanes; j++) {
+        k[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 16 * j));
+        _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys), k[j]);
+    }
+
+    for(int round = 1; round <= 10; round++) {
+        __m128i rcon = _mm_set1_epi32(roundConstants.entries[round]);
+
+        for(size_t j = 0; j < Lanes; j++) {
+            k[j] = keyFold(k[j], _mm_aesenclast_si128(_mm_shuffle_epi8(k[j], rotate), rcon));
+            _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys + 16 * round), k[j]);
+        }
+    }
+
+    for(size_t j = 0; j < Lanes; j++) {
+        contexts[j].rounds = 10;
+        prepareDecryptKeysHardware(contexts[j]);
+    }
+}
+
+template<size_t Lanes>
+AES_TARGET_AESNI_SSSE3 inline void expandKeys256HardwareLanes(AESKeyContext* contexts, const uint8_t* keys) {
+    //expands Lanes AES256 keys side by side, the odd steps broadcast the last word without rotating it
+    //and use a zero round constant
+    const __m128i rotate = _mm_set1_epi32(0x0c0f0e0d);
+    const __m128i broadcast = _mm_set1_epi32(0x0f0e0d0c);
+
+    __m128i even[Lanes];
+    __m128i odd[Lanes];
+
+    for(size_t j = 0; j < Lanes; j++) {
+        even[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 32 * j));
+        odd[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 32 * j + 16));
+        _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys), even[j]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys + 16), odd[j]);
+    }
+
+    for(int step = 1; step <= 7; step++) {
+        __m128i rcon = _mm_set1_epi32(roundConstants.entries[step]);
+
+        for(size_t j = 0; j < Lanes; j++) {
+            even[j] = keyFold(even[j], _mm_aesenclast_si128(_mm_shuffle_epi8(odd[j], rotate), rcon));
+            _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys + 32 * step), even[j]);
+        }
+
+        if(step == 7) {
+            break;//round key 14 is the last one
+        }
+
+        for(size_t j = 0; j < Lanes; j++) {
+            odd[j] = keyFold(odd[j], _mm_aesenclast_si128(_mm_shuffle_epi8(even[j], broadcast), _mm_setzero_si128()));
+            _mm_store_si128(reinterpret_cast<__m128i*>(contexts[j].roundKeys + 32 * step + 16), odd[j]);
+        }
+    }
+
+    for(size_t j = 0; j < Lanes; j++) {
+        contexts[j].rounds = 14;
+        prepareDecryptKeysHardware(contexts[j]);
+    }
+}
+
+inline bool expandKeysHardware(AESKeyContext* contexts, const uint8_t* keys, size_t keyLength, size_t count) {
+    //expands count keys of keyLength bytes stored back to back into contexts[0] to contexts[count - 1]
+    //AES128 and AES256 keys go keyLanesHardware at a time so their dependency chains overlap,
+    //AES192 keys go one at a time through expandKeyHardware. Needs SSSE3 as well as AES-NI
+    //returns false and leaves contexts untouched if keyLength is not 16, 24, or 32
+    if(keyLength != 16 && keyLength != 24 && keyLength != 32) {
+        return false;
+    }
+
+    size_t i = 0;
+
+    if(keyLength == 16) {
+        for(; i + keyLanesHardware <= count; i += keyLanesHardware) {
+            expandKeys128HardwareLanes<keyLanesHardware>(contexts + i, keys + 16 * i);
+        }
+    }
+    else if(keyLength == 32) {
+        for(; i + keyLanesHardware <= count; i += keyLanesHardware) {
+            expandKeys256HardwareLanes<keyLanesHardware>(contexts + i, keys + 32 * i);
+        }
+    }
+
+    for(; i < count; i++) {
+        expandKeyHardware(contexts[i], keys + keyLength * i, keyLength);
+    }
+
+    return true;
+}
+
+template<int Nr>
+AES_TARGET_AESNI inline void encryptBlocksHardwareRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //encrypts a run of independent 16 byte blocks, in and out may be the same buffer
+    //eight blocks go through each round together so the aesenc latency overlaps
+    //Nr is a compile time constant, so the round loops unroll and the round keys stay in registers
+
+    __m128i rk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        rk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(ctx.roundKey(round)));
+    }
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i b[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j))), rk[0]);
+        }
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                b[j] = _mm_aesenc_si128(b[j], rk[round]);
+            }
+        }
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_aesenclast_si128(b[j], rk[Nr]));
+        }
+    }
+
+    for(; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)), rk[0]);
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+            b = _mm_aesenc_si128(b, rk[round]);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_aesenclast_si128(b, rk[Nr]));
+    }
+}
+
+template<int Nr>
+AES_TARGET_AESNI inline void decryptBlocksHardwareRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //decrypts a run of independent 16 byte blocks, in and out may be the same buffer
+    //the same eight way interleave as encryption, with aesdec and the decryption round keys
+
+    __m128i dk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        dk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(ctx.decryptRoundKey(round)));
+    }
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i b[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j))), dk[0]);
+        }
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                b[j] = _mm_aesdec_si128(b[j], dk[round]);
+            }
+        }
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_aesdeclast_si128(b[j], dk[Nr]));
+        }
+    }
+
+    for(; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)), dk[0]);
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+            b = _mm_aesdec_si128(b, dk[round]);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_aesdeclast_si128(b, dk[Nr]));
+    }
+}
+
+AES_TARGET_AESNI inline __m128i counterBlock(uint64_t high, uint64_t low) {
+    //builds a big endian 128 bit counter block from its two halves
+    return _mm_set_epi64x(static_cast<long long>(__builtin_bswap64(low)), static_cast<long long>(__builtin_bswap64(high)));
+}
+
+template<int Nr>
+AES_TARGET_AESNI inline void ctrBlocksHardwareRounds(const AESKeyContext& ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    //XORs whole blocks with the CTR keystream starting at counter, then leaves counter pointing past the last block used
+    //counters are built in registers and the XOR happens on the way out, so there is no keystream buffer
+
+    __m128i rk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        rk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(ctx.roundKey(round)));
+    }
+
+    uint64_t high, low;
+    memcpy(&high, counter, 8);
+    memcpy(&low, counter + 8, 8);
+    high = __builtin_bswap64(high);
+    low = __builtin_bswap64(low);
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i b[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            b[j] = _mm_xor_si128(counterBlock(high, low), rk[0]);
+            low++;
+            high += (low == 0);
+        }
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                b[j] = _mm_aesenc_si128(b[j], rk[round]);
+            }
+        }
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_xor_si128(data, _mm_aesenclast_si128(b[j], rk[Nr])));
+        }
+    }
+
+    for(; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(counterBlock(high, low), rk[0]);
+        low++;
+        high += (low == 0);
+
+#pragma GCC unroll 16
+        for(int round = 1; round < Nr; round++) {
+            b = _mm_aesenc_si128(b, rk[round]);
+        }
+
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_xor_si128(data, _mm_aesenclast_si128(b, rk[Nr])));
+    }
+
+    high = __builtin_bswap64(high);
+    low = __builtin_bswap64(low);
+    memcpy(counter, &high, 8);
+    memcpy(counter + 8, &low, 8);
+}
+
+inline void encryptBlocksHardware(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call
+    switch(ctx.rounds) {
+        case 10:
+            encryptBlocksHardwareRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            encryptBlocksHardwareRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            encryptBlocksHardwareRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+inline void decryptBlocksHardware(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call
+    switch(ctx.rounds) {
+        case 10:
+            decryptBlocksHardwareRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            decryptBlocksHardwareRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            decryptBlocksHardwareRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+#endif
+
+#endif
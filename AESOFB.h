@@ -0,0 +1,188 @@
+// AESOFB.h
+// AES in output feedback (OFB) mode, with a keystream that can be made before the data arrives
+//
+// - The keystream is E(iv), E(E(iv)), ... and never depends on the data, so encryption and decryption are the same XOR
+// - Making the keystream is serial, every block is the encryption of the one before it, but none of it needs the message
+// - AESOFBStream keeps a ring of keystream ahead of the data. precompute fills it on the calling thread and
+//   precomputeInBackground on the shared background thread, so a connection can fill it while it waits for input
+//   and the later crypt call is only an XOR over the ring
+// - Whatever is not ready yet when crypt runs is made on the spot, so a stream is correct however much was precomputed
+//
+// Like CTR, reusing an IV under the same key reuses the keystream, and nothing here authenticates the data
+
+#ifndef AES_OFB_H
+#define AES_OFB_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy
+#include <atomic> //ring positions shared with the background thread
+#include <mutex> //one keystream producer at a time
+#include <vector> //the keystream ring
+
+#include "AESCore.h" //AESKeyContext, xorBytes, and secureZero
+#include "AESEngine.h" //the active engine
+#include "AESThreadPool.h" //the background queue
+
+inline constexpr size_t ofbBatchBlocks = 64;//keystream blocks made between checks of the ring
+inline constexpr size_t ofbKeystreamBytes = 16 * 1024;//default ring size of an AESOFBStream, a multiple of 16
+
+inline void ofbKeystream(const AESKeyContext& ctx, uint8_t feedback[16], uint8_t* keystream, size_t blocks) {
+    //writes the next blocks of keystream, feedback starts as the IV and is left as the last block written
+    BlockFunction encrypt = activeBlockFunction(ctx);
+
+    for(size_t i = 0; i < blocks; i++) {
+        encrypt(ctx, feedback, feedback, 1);
+        memcpy(keystream + 16 * i, feedback, 16);
+    }
+}
+
+inline void ofbEncrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length) {
+    //encrypts length bytes in OFB mode from iv, in and out may be the same buffer
+    //length does not have to be a multiple of 16, the last keystream block is cut short
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::OFB, length);
+
+    alignas(16) uint8_t keystream[ofbBatchBlocks * 16];
+    uint8_t feedback[16];
+
+    memcpy(feedback, iv, 16);
+
+    while(length > 0) {
+        size_t blocks = (length + 15) / 16;
+        if(blocks > ofbBatchBlocks) {
+            blocks = ofbBatchBlocks;
+        }
+
+        ofbKeystream(ctx, feedback, keystream, blocks);
+
+        size_t bytes = blocks * 16 < length ? blocks * 16 : length;
+
+        xorBytes(out, in, keystream, bytes);
+
+        in += bytes;
+        out += bytes;
+        length -= bytes;
+    }
+}
+
+inline void ofbDecrypt(const AESKeyContext& ctx, const uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t length) {
+    //OFB decryption is the same keystream XOR as encryption
+    ofbEncrypt(ctx, iv, in, out, length);
+}
+
+class AESOFBStream {
+    //one OFB message that arrives in pieces, with keystream made ahead of it
+    //crypt is called by one thread at a time, precompute and precomputeInBackground can run alongside it
+public:
+    AESOFBStream(const AESKeyContext& ctx, const uint8_t iv[16], size_t capacity = ofbKeystreamBytes)
+        : ctx(ctx), ring((capacity < 16 ? 16 : capacity) / 16 * 16) {
+        //copies the key, so ctx does not have to outlive the stream
+        memcpy(feedback, iv, 16);
+    }
+
+    ~AESOFBStream() {
+        //a background fill still queued is dropped, and one already running is waited for
+        if(posted) {
+            defaultBackgroundQueue().cancel(this);
+        }
+
+        secureZero(ring.data(), ring.size());
+        secureZero(feedback, sizeof(feedback));
+        secureZero(&ctx, sizeof(ctx));
+    }
+
+    AESOFBStream(const AESOFBStream&) = delete;
+    AESOFBStream& operator=(const AESOFBStream&) = delete;
+
+    size_t capacity() const { return ring.size(); }
+
+    size_t ready() const {
+        //bytes of keystream waiting in the ring
+        return static_cast<size_t>(produced.load(std::memory_order_acquire) - consumed.load(std::memory_order_acquire));
+    }
+
+    void precompute(size_t bytes = SIZE_MAX) {
+        //makes keystream until at least bytes are ready or the ring is full, on the calling thread
+        //the producer lock is let go between batches, so a crypt that runs out is never held up for long
+        while(ready() < bytes && fill(ofbBatchBlocks) > 0) {
+        }
+    }
+
+    void precomputeInBackground() {
+        //queues a fill of the whole ring on the shared background thread and returns straight away
+        //does nothing if one is already queued
+        if(queued.exchange(true)) {
+            return;
+        }
+
+        posted = true;
+        defaultBackgroundQueue().post(backgroundFill, this);
+    }
+
+    void crypt(const uint8_t* in, uint8_t* out, size_t length) {
+        //encrypts or decrypts the next length bytes of the message, in and out may be the same buffer
+        //keystream that is ready is XOR'ed straight out of the ring, the rest is made as it is needed
+        AESMetricsScope metrics(activeEngine().name, AESMetricsMode::OFB, length);
+
+        while(length > 0) {
+            uint64_t start = consumed.load(std::memory_order_relaxed);
+            size_t available = static_cast<size_t>(produced.load(std::memory_order_acquire) - start);
+
+            if(available == 0) {
+                fill((length + 15) / 16);
+                continue;
+            }
+
+            size_t position = static_cast<size_t>(start % ring.size());
+            size_t bytes = available < ring.size() - position ? available : ring.size() - position;
+            bytes = bytes < length ? bytes : length;
+
+            xorBytes(out, in, ring.data() + position, bytes);
+            consumed.store(start + bytes, std::memory_order_release);
+
+            in += bytes;
+            out += bytes;
+            length -= bytes;
+        }
+    }
+
+private:
+    static void backgroundFill(void* context) {
+        //the background job, cleared first so a fill asked for while this one runs is queued again
+        AESOFBStream* stream = static_cast<AESOFBStream*>(context);
+
+        stream->queued.store(false);
+        stream->precompute();
+    }
+
+    size_t fill(size_t blocks) {
+        //makes up to blocks more keystream blocks into free space in the ring, returns how many it made
+        //produced only moves here and under producerMutex, consumed only moves in crypt, so the part of the ring
+        //written here is never the part crypt is reading
+        std::lock_guard<std::mutex> lock(producerMutex);
+
+        uint64_t start = produced.load(std::memory_order_relaxed);
+        size_t space = static_cast<size_t>(consumed.load(std::memory_order_acquire) + ring.size() - start) / 16;
+        size_t position = static_cast<size_t>(start % ring.size());
+        size_t untilWrap = (ring.size() - position) / 16;
+
+        blocks = blocks < space ? blocks : space;
+        blocks = blocks < untilWrap ? blocks : untilWrap;
+
+        ofbKeystream(ctx, feedback, ring.data() + position, blocks);
+        produced.store(start + 16 * blocks, std::memory_order_release);
+
+        return blocks;
+    }
+
+    AESKeyContext ctx;
+    std::vector<uint8_t> ring;//keystream byte n of the message is at ring[n % ring.size()]
+    uint8_t feedback[16];//the last keystream block made
+    std::mutex producerMutex;//held while keystream is made, guards feedback
+    std::atomic<uint64_t> produced{0};//keystream bytes made, a multiple of 16
+    std::atomic<uint64_t> consumed{0};//keystream bytes used up by crypt
+    std::atomic<bool> queued{false};//a background fill is waiting to run
+    bool posted = false;//anything was ever queued, so the destructor knows to cancel
+};
+
+#endif
@@ -0,0 +1,28 @@
+// AESRandom.h
+// Random bytes for IVs and nonces
+//
+// - Bytes come from std::random_device, which reads the operating system's generator on Linux, macOS, and Windows
+// - Each call opens the generator again, so ask for everything a message needs in one call
+// - This is the entropy source for the CTR_DRBG generator in AESDRBG.h, which is what IVs and nonces should come from
+
+#ifndef AES_RANDOM_H
+#define AES_RANDOM_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <random> //random_device
+
+inline void randomBytes(uint8_t* out, size_t length) {
+    //fills out with length bytes from the operating system's random generator
+    std::random_device device;
+
+    for(size_t i = 0; i < length; i += 4) {
+        uint32_t word = device();
+
+        for(size_t k = 0; k < 4 && i + k < length; k++) {
+            out[i + k] = static_cast<uint8_t>(word >> (8 * k));
+        }
+    }
+}
+
+#endif
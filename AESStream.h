@@ -0,0 +1,282 @@
+// AESStream.h
+// Encrypts files and pipes of any size with a bounded amount of memory
+//
+// - Input is read in fixed size chunks into a small ring of reusable buffers
+// - A reader thread fills buffers, the calling thread transforms them in order, and a writer thread writes them out,
+//   so reading, encrypting, and writing the next few chunks all overlap
+// - Memory use is chunkBytes * buffers no matter how large the input is, 4 MiB with the defaults
+// - Every chunk but the last is full, so a transform can rely on chunk offsets being multiples of 16
+// - A transform can also write a different amount than it read, into a second buffer per slot, which is how
+//   ciphertext is turned into hex or Base64 text on the way out and back on the way in
+//
+// Stream format for CTR: the 16 byte initial counter block, followed by the ciphertext, which is the same length as the plaintext.
+// As text: the counter block encoded on a line of its own, then the encoded ciphertext on one line
+
+#ifndef AES_STREAM_H
+#define AES_STREAM_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //strlen for the counter block line
+#include <cstdio> //FILE streams, so stdin and stdout work the same as files
+#include <condition_variable> //handing buffers between the stages
+#include <mutex> //protects the buffer states
+#include <thread> //reader and writer threads
+#include <vector> //the ring of buffers
+
+#include "AESCore.h" //AESKeyContext
+#include "AESCTR.h" //CTR keystream for each chunk
+#include "AESDRBG.h" //fresh initial counter blocks
+#include "AESEncoding.h" //hex and Base64 streams
+
+inline constexpr size_t streamChunkBytes = 1 << 20;//bytes read per chunk, a multiple of 16
+inline constexpr size_t streamBuffers = 4;//buffers in the ring
+inline constexpr size_t streamTextChunkBytes = 3 << 18;//bytes read per chunk for text streams, a multiple of 16, 3, and 4
+inline constexpr size_t streamFailed = SIZE_MAX;//returned by a transform to stop the stream
+
+template<class Transform>
+inline bool streamChunks(FILE* in, FILE* out, Transform&& transform, size_t chunkBytes = streamChunkBytes, size_t buffers = streamBuffers, size_t outputBytes = 0) {
+    //reads in to the end, calls transform(data, length, offset, output) on each chunk in order, and writes the results to out
+    //offset is where the chunk starts in the stream. transform works on data in place and returns how many bytes to write,
+    //from data, or from output if outputBytes is set, and then output has that much room. Returning streamFailed stops the stream
+    //returns false if reading, the transform, or writing fails, whatever was already written stays written
+
+    enum class SlotState { Free, Read, Done };
+
+    struct Slot {
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> output;
+        size_t length = 0;//bytes read, then bytes to write
+        bool last = false;
+        SlotState state = SlotState::Free;
+    };
+
+    std::vector<Slot> ring(buffers);
+    for(auto& slot : ring) {
+        slot.data.resize(chunkBytes);
+        slot.output.resize(outputBytes);
+    }
+
+    std::mutex ringMutex;
+    std::condition_variable changed;
+    bool failed = false;
+
+    auto waitFor = [&](Slot& slot, SlotState state) {
+        //blocks until slot reaches state, returns false if another stage failed first
+        std::unique_lock<std::mutex> lock(ringMutex);
+        changed.wait(lock, [&] { return slot.state == state || failed; });
+        return !failed;
+    };
+
+    auto advance = [&](Slot& slot, SlotState state) {
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            slot.state = state;
+        }
+        changed.notify_all();
+    };
+
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            failed = true;
+        }
+        changed.notify_all();
+    };
+
+    std::thread reader([&] {
+        for(size_t sequence = 0; ; sequence++) {
+            Slot& slot = ring[sequence % buffers];
+
+            if(!waitFor(slot, SlotState::Free)) {
+                return;
+            }
+
+            //fread can return short counts on pipes, so keep going until the chunk is full or the input ends
+            size_t length = 0;
+            while(length < chunkBytes) {
+                size_t got = fread(slot.data.data() + length, 1, chunkBytes - length, in);
+                if(got == 0) {
+                    break;
+                }
+                length += got;
+            }
+
+            if(ferror(in)) {
+                fail();
+                return;
+            }
+
+            slot.length = length;
+            slot.last = length < chunkBytes;
+            advance(slot, SlotState::Read);
+
+            if(slot.last) {
+                return;
+            }
+        }
+    });
+
+    std::thread writer([&] {
+        for(size_t sequence = 0; ; sequence++) {
+            Slot& slot = ring[sequence % buffers];
+
+            if(!waitFor(slot, SlotState::Done)) {
+                return;
+            }
+
+            const uint8_t* result = outputBytes > 0 ? slot.output.data() : slot.data.data();
+
+            if(fwrite(result, 1, slot.length, out) != slot.length) {
+                fail();
+                return;
+            }
+
+            bool last = slot.last;
+            advance(slot, SlotState::Free);
+
+            if(last) {
+                return;
+            }
+        }
+    });
+
+    uint64_t offset = 0;
+
+    for(size_t sequence = 0; ; sequence++) {
+        Slot& slot = ring[sequence % buffers];
+
+        if(!waitFor(slot, SlotState::Read)) {
+            break;
+        }
+
+        size_t length = slot.length;
+        size_t written = transform(slot.data.data(), length, offset, slot.output.data());
+
+        if(written == streamFailed) {
+            fail();
+            break;
+        }
+
+        offset += length;
+        slot.length = written;
+
+        bool last = slot.last;
+        advance(slot, SlotState::Done);
+
+        if(last) {
+            break;
+        }
+    }
+
+    reader.join();
+    writer.join();
+
+    return !failed && fflush(out) == 0;
+}
+
+inline bool ctrStream(const AESKeyContext& ctx, const uint8_t iv[16], FILE* in, FILE* out) {
+    //runs everything left in in through CTR starting from counter block iv, and writes it to out
+    return streamChunks(in, out, [&](uint8_t* data, size_t length, uint64_t offset, uint8_t*) {
+        uint8_t counter[16];
+        ctrCounterAt(iv, offset / 16, counter);
+
+        ctrEncrypt(ctx, counter, data, data, length);
+        return length;
+    });
+}
+
+inline bool ctrStreamEncoded(const AESKeyContext& ctx, const uint8_t iv[16], FILE* in, FILE* out, AESTextEncoding encoding) {
+    //ctrStream with the ciphertext written as text. Chunks are a multiple of 3 bytes, so Base64 only pads at the very end
+    bool ok = streamChunks(in, out, [&](uint8_t* data, size_t length, uint64_t offset, uint8_t* output) {
+        uint8_t counter[16];
+        ctrCounterAt(iv, offset / 16, counter);
+
+        ctrEncrypt(ctx, counter, data, data, length);
+        return encodeText(encoding, data, length, reinterpret_cast<char*>(output));
+    }, streamTextChunkBytes, streamBuffers, encodedLength(encoding, streamTextChunkBytes));
+
+    return ok && fputc('\n', out) != EOF && fflush(out) == 0;
+}
+
+inline bool ctrDecodeStream(const AESKeyContext& ctx, const uint8_t iv[16], FILE* in, FILE* out, AESTextEncoding encoding) {
+    //decodes text written by ctrStreamEncoded and decrypts it. Text chunks are a multiple of 4 characters, so every full one
+    //decodes to a whole number of bytes, and whitespace can only end the text, so it is trimmed from the end of each chunk
+    return streamChunks(in, out, [&](uint8_t* data, size_t length, uint64_t offset, uint8_t*) {
+        while(length > 0 && (data[length - 1] == '\n' || data[length - 1] == '\r' || data[length - 1] == ' ' || data[length - 1] == '\t')) {
+            length--;
+        }
+
+        size_t decoded = 0;
+        if(!decodeText(encoding, reinterpret_cast<const char*>(data), length, data, decoded)) {
+            return streamFailed;
+        }
+
+        uint8_t counter[16];
+        ctrCounterAt(iv, (encoding == AESTextEncoding::Hex ? offset / 2 : offset / 4 * 3) / 16, counter);
+
+        ctrEncrypt(ctx, counter, data, data, decoded);
+        return decoded;
+    }, streamTextChunkBytes);
+}
+
+inline bool ctrEncryptStream(const AESKeyContext& ctx, FILE* in, FILE* out, AESTextEncoding encoding = AESTextEncoding::Binary) {
+    //encrypts in to out under a fresh random initial counter block, which is written first
+    //with a text encoding, the counter block and the ciphertext are written as two lines of hex or Base64
+    uint8_t iv[16];
+    if(!drbgRandomBytes(iv, 16)) {
+        return false;
+    }
+
+    if(encoding == AESTextEncoding::Binary) {
+        if(fwrite(iv, 1, 16, out) != 16) {
+            return false;
+        }
+
+        return ctrStream(ctx, iv, in, out);
+    }
+
+    char line[33];
+    size_t length = encodeText(encoding, iv, 16, line);
+    line[length] = '\n';
+
+    if(fwrite(line, 1, length + 1, out) != length + 1) {
+        return false;
+    }
+
+    return ctrStreamEncoded(ctx, iv, in, out, encoding);
+}
+
+inline bool ctrDecryptStream(const AESKeyContext& ctx, FILE* in, FILE* out, AESTextEncoding encoding = AESTextEncoding::Binary) {
+    //reads the initial counter block written by ctrEncryptStream and decrypts the rest of in to out
+    //encoding has to match the one the stream was encrypted with
+    //returns false if in is too short to hold the counter block, or the text is not valid in the encoding
+    uint8_t iv[base64DecodedMaxLength(24)];//room for the counter block line to be decoded as Base64
+
+    if(encoding == AESTextEncoding::Binary) {
+        if(fread(iv, 1, 16, in) != 16) {
+            return false;
+        }
+
+        return ctrStream(ctx, iv, in, out);
+    }
+
+    char line[40];
+    if(fgets(line, sizeof(line), in) == nullptr) {
+        return false;
+    }
+
+    size_t length = strlen(line);
+    while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+        length--;
+    }
+
+    size_t ivLength = 0;
+    if(length != encodedLength(encoding, 16) || !decodeText(encoding, line, length, iv, ivLength)) {
+        return false;
+    }
+
+    return ctrDecodeStream(ctx, iv, in, out, encoding);
+}
+
+#endif
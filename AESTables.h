@@ -0,0 +1,253 @@
+// AESTables.h
+// Table driven AES round engine
+//
+// - Sub bytes, shift rows, and mix columns are merged into four 256 entry tables of 32 bit words,
+//   so one round is 16 table lookups and a handful of XORs on four column words
+// - The tables are built from the S-box at compile time, nothing is computed or allocated at startup
+// - The last round has no mix columns, so it goes through the S-box directly
+// - The round count is a template parameter, so the round loop is fully unrolled for each key size
+// - Decryption has its own four tables built from the inverse S-box and inverse mix columns,
+//   and runs the equivalent inverse cipher, so its rounds cost the same as encryption rounds
+//
+// Column words are little endian, row 0 of a column is the low byte
+
+#ifndef AES_TABLES_H
+#define AES_TABLES_H
+
+#include <cstdint> //fixed width integer types for the table words
+#include <cstddef> //size_t
+#include <utility> //index_sequence for unrolling the rounds
+
+#include "AESCore.h" //the S-box, the galois helpers, and AESKeyContext
+
+struct AESRoundTable {
+    //one of the four round tables, entry x is the mixed column contribution of S(x) from a single row
+    uint32_t entries[256];
+};
+
+constexpr uint32_t rotateLeft32(uint32_t word, int bits) {
+    //rotates a word left, bits must be between 1 and 31
+    return (word << bits) | (word >> (32 - bits));
+}
+
+constexpr AESRoundTable makeRoundTable(int row) {
+    //builds the table for a byte coming from the given row
+    //row 0 contributes (2s, s, s, 3s) to the column, and each later row is the same column rotated down by one byte
+
+    AESRoundTable table{};
+
+    for(int x = 0; x < 256; x++) {
+        uint8_t s = sBox[x];
+
+        uint32_t word = static_cast<uint32_t>(galois2x(s))
+                      | static_cast<uint32_t>(s) << 8
+                      | static_cast<uint32_t>(s) << 16
+                      | static_cast<uint32_t>(galois3x(s)) << 24;
+
+        table.entries[x] = row == 0 ? word : rotateLeft32(word, 8 * row);
+    }
+
+    return table;
+}
+
+inline constexpr AESRoundTable te0 = makeRoundTable(0);
+inline constexpr AESRoundTable te1 = makeRoundTable(1);
+inline constexpr AESRoundTable te2 = makeRoundTable(2);
+inline constexpr AESRoundTable te3 = makeRoundTable(3);
+
+constexpr AESRoundTable makeInverseRoundTable(int row) {
+    //builds the decryption table for a byte coming from the given row
+    //row 0 contributes (14s, 9s, 13s, 11s) to the column, where s is the inverse S-box output
+
+    AESRoundTable table{};
+
+    for(int x = 0; x < 256; x++) {
+        uint8_t s = invSBox[x];
+
+        uint32_t word = static_cast<uint32_t>(galoisMultiply(s, 14))
+                      | static_cast<uint32_t>(galoisMultiply(s, 9)) << 8
+                      | static_cast<uint32_t>(galoisMultiply(s, 13)) << 16
+                      | static_cast<uint32_t>(galoisMultiply(s, 11)) << 24;
+
+        table.entries[x] = row == 0 ? word : rotateLeft32(word, 8 * row);
+    }
+
+    return table;
+}
+
+inline constexpr AESRoundTable td0 = makeInverseRoundTable(0);
+inline constexpr AESRoundTable td1 = makeInverseRoundTable(1);
+inline constexpr AESRoundTable td2 = makeInverseRoundTable(2);
+inline constexpr AESRoundTable td3 = makeInverseRoundTable(3);
+
+inline uint32_t loadColumn(const uint8_t* p) {
+    //reads 4 bytes as a little endian column word
+    return static_cast<uint32_t>(p[0])
+         | static_cast<uint32_t>(p[1]) << 8
+         | static_cast<uint32_t>(p[2]) << 16
+         | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline void storeColumn(uint8_t* p, uint32_t word) {
+    //writes a column word back out as 4 bytes
+    p[0] = static_cast<uint8_t>(word);
+    p[1] = static_cast<uint8_t>(word >> 8);
+    p[2] = static_cast<uint8_t>(word >> 16);
+    p[3] = static_cast<uint8_t>(word >> 24);
+}
+
+inline void tableRound(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, const uint8_t* rk) {
+    //one full round on the four column words
+    //row r of output column c comes from input column c + r, which is shift rows
+
+    uint32_t t0 = te0.entries[c0 & 0xff] ^ te1.entries[(c1 >> 8) & 0xff] ^ te2.entries[(c2 >> 16) & 0xff] ^ te3.entries[c3 >> 24] ^ loadColumn(rk);
+    uint32_t t1 = te0.entries[c1 & 0xff] ^ te1.entries[(c2 >> 8) & 0xff] ^ te2.entries[(c3 >> 16) & 0xff] ^ te3.entries[c0 >> 24] ^ loadColumn(rk + 4);
+    uint32_t t2 = te0.entries[c2 & 0xff] ^ te1.entries[(c3 >> 8) & 0xff] ^ te2.entries[(c0 >> 16) & 0xff] ^ te3.entries[c1 >> 24] ^ loadColumn(rk + 8);
+    uint32_t t3 = te0.entries[c3 & 0xff] ^ te1.entries[(c0 >> 8) & 0xff] ^ te2.entries[(c1 >> 16) & 0xff] ^ te3.entries[c2 >> 24] ^ loadColumn(rk + 12);
+
+    c0 = t0;
+    c1 = t1;
+    c2 = t2;
+    c3 = t3;
+}
+
+inline uint32_t lastRoundColumn(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    //sub bytes and shift rows for one column of the last round, rows 0 to 3 come from a to d
+    return static_cast<uint32_t>(sBox[a & 0xff])
+         | static_cast<uint32_t>(sBox[(b >> 8) & 0xff]) << 8
+         | static_cast<uint32_t>(sBox[(c >> 16) & 0xff]) << 16
+         | static_cast<uint32_t>(sBox[d >> 24]) << 24;
+}
+
+template<size_t... Round>
+inline void tableRounds(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, const AESKeyContext& ctx, std::index_sequence<Round...>) {
+    //runs rounds 1 to Nr - 1 back to back, the fold expands to one tableRound call per round
+    (tableRound(c0, c1, c2, c3, ctx.roundKey(static_cast<int>(Round) + 1)), ...);
+}
+
+template<int Nr>
+inline void encryptBlockTableRounds(const AESKeyContext& ctx, const uint8_t in[16], uint8_t out[16]) {
+    //encrypts a single 16 byte block using the round tables, with the round count fixed at compile time
+    //in and out may point to the same block
+
+    const uint8_t* rk = ctx.roundKey(0);
+
+    uint32_t c0 = loadColumn(in) ^ loadColumn(rk);
+    uint32_t c1 = loadColumn(in + 4) ^ loadColumn(rk + 4);
+    uint32_t c2 = loadColumn(in + 8) ^ loadColumn(rk + 8);
+    uint32_t c3 = loadColumn(in + 12) ^ loadColumn(rk + 12);
+
+    tableRounds(c0, c1, c2, c3, ctx, std::make_index_sequence<Nr - 1>());
+
+    //the last round is sub bytes and shift rows only
+    rk = ctx.roundKey(Nr);
+
+    storeColumn(out, lastRoundColumn(c0, c1, c2, c3) ^ loadColumn(rk));
+    storeColumn(out + 4, lastRoundColumn(c1, c2, c3, c0) ^ loadColumn(rk + 4));
+    storeColumn(out + 8, lastRoundColumn(c2, c3, c0, c1) ^ loadColumn(rk + 8));
+    storeColumn(out + 12, lastRoundColumn(c3, c0, c1, c2) ^ loadColumn(rk + 12));
+}
+
+template<int Nr>
+inline void encryptBlocksTableRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //encrypts a run of independent 16 byte blocks, in and out may be the same buffer
+    for(size_t i = 0; i < blocks; i++) {
+        encryptBlockTableRounds<Nr>(ctx, in + 16 * i, out + 16 * i);
+    }
+}
+
+inline void encryptBlocksTable(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call, so the block loop itself has no branches on it
+    switch(ctx.rounds) {
+        case 10:
+            encryptBlocksTableRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            encryptBlocksTableRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            encryptBlocksTableRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+inline void encryptBlockTable(const AESKeyContext& ctx, const uint8_t in[16], uint8_t out[16]) {
+    //encrypts a single 16 byte block using the round tables
+    encryptBlocksTable(ctx, in, out, 1);
+}
+
+inline void inverseTableRound(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, const uint8_t* rk) {
+    //one full decryption round on the four column words
+    //row r of output column c comes from input column c - r, which is inverse shift rows
+
+    uint32_t t0 = td0.entries[c0 & 0xff] ^ td1.entries[(c3 >> 8) & 0xff] ^ td2.entries[(c2 >> 16) & 0xff] ^ td3.entries[c1 >> 24] ^ loadColumn(rk);
+    uint32_t t1 = td0.entries[c1 & 0xff] ^ td1.entries[(c0 >> 8) & 0xff] ^ td2.entries[(c3 >> 16) & 0xff] ^ td3.entries[c2 >> 24] ^ loadColumn(rk + 4);
+    uint32_t t2 = td0.entries[c2 & 0xff] ^ td1.entries[(c1 >> 8) & 0xff] ^ td2.entries[(c0 >> 16) & 0xff] ^ td3.entries[c3 >> 24] ^ loadColumn(rk + 8);
+    uint32_t t3 = td0.entries[c3 & 0xff] ^ td1.entries[(c2 >> 8) & 0xff] ^ td2.entries[(c1 >> 16) & 0xff] ^ td3.entries[c0 >> 24] ^ loadColumn(rk + 12);
+
+    c0 = t0;
+    c1 = t1;
+    c2 = t2;
+    c3 = t3;
+}
+
+inline uint32_t inverseLastRoundColumn(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    //inverse sub bytes and inverse shift rows for one column of the last decryption round, rows 0 to 3 come from a to d
+    return static_cast<uint32_t>(invSBox[a & 0xff])
+         | static_cast<uint32_t>(invSBox[(b >> 8) & 0xff]) << 8
+         | static_cast<uint32_t>(invSBox[(c >> 16) & 0xff]) << 16
+         | static_cast<uint32_t>(invSBox[d >> 24]) << 24;
+}
+
+template<size_t... Round>
+inline void inverseTableRounds(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, const AESKeyContext& ctx, std::index_sequence<Round...>) {
+    //runs decryption rounds 1 to Nr - 1 back to back
+    (inverseTableRound(c0, c1, c2, c3, ctx.decryptRoundKey(static_cast<int>(Round) + 1)), ...);
+}
+
+template<int Nr>
+inline void decryptBlockTableRounds(const AESKeyContext& ctx, const uint8_t in[16], uint8_t out[16]) {
+    //decrypts a single 16 byte block using the inverse round tables, in and out may point to the same block
+
+    const uint8_t* rk = ctx.decryptRoundKey(0);
+
+    uint32_t c0 = loadColumn(in) ^ loadColumn(rk);
+    uint32_t c1 = loadColumn(in + 4) ^ loadColumn(rk + 4);
+    uint32_t c2 = loadColumn(in + 8) ^ loadColumn(rk + 8);
+    uint32_t c3 = loadColumn(in + 12) ^ loadColumn(rk + 12);
+
+    inverseTableRounds(c0, c1, c2, c3, ctx, std::make_index_sequence<Nr - 1>());
+
+    //the last round is inverse sub bytes and inverse shift rows only
+    rk = ctx.decryptRoundKey(Nr);
+
+    storeColumn(out, inverseLastRoundColumn(c0, c3, c2, c1) ^ loadColumn(rk));
+    storeColumn(out + 4, inverseLastRoundColumn(c1, c0, c3, c2) ^ loadColumn(rk + 4));
+    storeColumn(out + 8, inverseLastRoundColumn(c2, c1, c0, c3) ^ loadColumn(rk + 8));
+    storeColumn(out + 12, inverseLastRoundColumn(c3, c2, c1, c0) ^ loadColumn(rk + 12));
+}
+
+template<int Nr>
+inline void decryptBlocksTableRounds(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //decrypts a run of independent 16 byte blocks, in and out may be the same buffer
+    for(size_t i = 0; i < blocks; i++) {
+        decryptBlockTableRounds<Nr>(ctx, in + 16 * i, out + 16 * i);
+    }
+}
+
+inline void decryptBlocksTable(const AESKeyContext& ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size once per call
+    switch(ctx.rounds) {
+        case 10:
+            decryptBlocksTableRounds<10>(ctx, in, out, blocks);
+            break;
+        case 12:
+            decryptBlocksTableRounds<12>(ctx, in, out, blocks);
+            break;
+        case 14:
+            decryptBlocksTableRounds<14>(ctx, in, out, blocks);
+            break;
+    }
+}
+
+#endif
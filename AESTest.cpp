@@ -0,0 +1,659 @@
+// AESTest.cpp
+// Known answer tests for GCM, XTS, OFB, CFB, and the CTR_DRBG generator, run under every engine this machine supports,
+// and checks of the hex and Base64 encodings
+//
+// - GCM uses the test cases of the GCM specification that NIST SP 800-38D is built on, with 96 bit IVs and with the
+//   8 byte and 60 byte IVs that are hashed into the first counter block, for all three key sizes
+// - XTS uses IEEE 1619 vectors, including the 17 to 20 byte sectors that need ciphertext stealing and a 512 byte
+//   sector under two AES256 keys
+// - OFB and CFB128 use the NIST SP 800-38A examples for all three key sizes, also cut off inside the last block.
+//   An AESOFBStream with a three block ring is fed odd sized pieces, with its keystream made ahead on the calling thread,
+//   in the background, or on the spot, and CFB decryption is split across a thread pool with chunks that chain into
+//   each other, in place and out of place. Both must match the single call versions
+// - CTR_DRBG is AES256 without a derivation function, run the way the CAVP tests run it: instantiate, an optional
+//   reseed, then two 64 byte generate calls of which the second is compared. The expected outputs were made with
+//   OpenSSL's CTR-DRBG fed the same entropy, and the records have the CAVP fields so published ones can be added as they are
+// - Each vector is checked both ways, in place and out of place, and the calls that must refuse their input are checked to
+//   refuse it: a forged GCM tag, an empty GCM IV, and an XTS key whose two halves are equal
+// - Each SSSE3 and AVX2 encoder and decoder this CPU can run is finished by the scalar code, the way AESEncoding.h does it,
+//   and compared with the scalar code alone for every length up to 300 bytes, decoding out of place and in place.
+//   The decoders must refuse every byte outside the alphabet wherever it falls, and any = before the padding
+// - Prints a line for every failed check and a count at the end, and exits with 1 if anything failed
+//
+// Build: g++ -std=c++17 -O2 -pthread AESTest.cpp -o AESTest
+
+#include <iostream> //the failures and the summary
+#include <string> //check names
+#include <vector> //decoded vectors and output buffers
+#include <cstring> //strlen, strchr, and memcmp
+#include <cctype> //toupper for upper case hex
+#include <algorithm> //equal, for decodes in place and short messages
+
+#include "AESEngine.h" //every engine and useEngine
+#include "AESGCM.h" //GCM
+#include "AESXTS.h" //XTS
+#include "AESOFB.h" //OFB and AESOFBStream
+#include "AESCFB.h" //CFB128
+#include "AESThreadPool.h" //a pool for the split CFB decryption
+#include "AESDRBG.h" //CTR_DRBG
+#include "AESEncoding.h" //hex vectors
+
+using namespace std;
+
+struct GCMVector {
+    const char* name;
+    const char* key;
+    const char* iv;
+    const char* aad;
+    const char* plaintext;
+    const char* ciphertext;
+    const char* tag;
+};
+
+struct XTSVector {
+    const char* name;
+    const char* key;//the data key followed by the tweak key
+    uint64_t sector;//the data unit sequence number
+    const char* plaintext;
+    const char* ciphertext;
+};
+
+struct DRBGVector {
+    const char* entropy;
+    const char* personalization;
+    const char* entropyReseed;//empty when the record has no reseed
+    const char* additionalReseed;
+    const char* additional1;
+    const char* additional2;
+    const char* returned;
+};
+
+struct ModeVector {
+    //a NIST SP 800-38A example, which all share one IV and plaintext
+    const char* name;
+    const char* key;
+    const char* ciphertext;
+};
+
+const char* const gcmPlaintext64 = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                                   "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255";
+const char* const gcmPlaintext60 = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                                   "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+const char* const gcmAAD = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+const char* const gcmIV60 = "9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728"
+                            "c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b";
+
+const GCMVector gcmVectors[] = {
+    {"1", "00000000000000000000000000000000", "000000000000000000000000", "", "", "", "58e2fccefa7e3061367f1d57a4e7455a"},
+    {"2", "00000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+     "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf"},
+    {"3", "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "", gcmPlaintext64,
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+     "4d5c2af327cd64a62cf35abd2ba6fab4"},
+    {"4", "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", gcmAAD, gcmPlaintext60,
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+     "5bc94fbc3221a5db94fae95ae7121a47"},
+    {"5", "feffe9928665731c6d6a8f9467308308", "cafebabefacedbad", gcmAAD, gcmPlaintext60,
+     "61353b4c2806934a777ff51fa22a4755699b2a714fcdc6f83766e5f97b6c742373806900e49f24b22b097544d4896b424989b5e1ebac0f07c23f4598",
+     "3612d2e79e3b0785561be14aaca2fccb"},
+    {"6", "feffe9928665731c6d6a8f9467308308", gcmIV60, gcmAAD, gcmPlaintext60,
+     "8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca701e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5",
+     "619cc5aefffe0bfa462af43c1699d050"},
+    {"7", "000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "", "", "cd33b28ac773f74ba00ed1f312572435"},
+    {"8", "000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+     "98e7247c07f0fe411c267e4384b0f600", "2ff58d80033927ab8ef4d4587514f0fb"},
+    {"9", "feffe9928665731c6d6a8f9467308308feffe9928665731c", "cafebabefacedbaddecaf888", "", gcmPlaintext64,
+     "3980ca0b3c00e841eb06fac4872a2757859e1ceaa6efd984628593b40ca1e19c7d773d00c144c525ac619d18c84a3f4718e2448b2fe324d9ccda2710acade256",
+     "9924a7c8587336bfb118024db8674a14"},
+    {"13", "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "", "",
+     "530f8afbc74536b9a963b4f1c4cb738b"},
+    {"14", "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000", "",
+     "00000000000000000000000000000000", "cea7403d4d606b6e074ec5d3baf39d18", "d0d1c8a799996bf0265b98b5d48ab919"},
+    {"15", "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "", gcmPlaintext64,
+     "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad",
+     "b094dac5d93471bdec1a502270e3cc6c"},
+    {"16", "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", gcmAAD, gcmPlaintext60,
+     "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+     "76fc6ece0f4e1768cddf8853bb2d551b"},
+    {"17", "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbad", gcmAAD, gcmPlaintext60,
+     "c3762df1ca787d32ae47c13bf19844cbaf1ae14d0b976afac52ff7d79bba9de0feb582d33934a4f0954cc2363bc73f7862ac430e64abe499f47c9b1f",
+     "3a337dbf46a792c45e454913fe2ea8f2"},
+    {"18", "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", gcmIV60, gcmAAD, gcmPlaintext60,
+     "5a8def2f0c9e53f1f75d7853659e2a20eeb2b22aafde6419a058ab4f6f746bf40fc0c3b780f244452da3ebf1c5d82cdea2418997200ef82e44ae7e3f",
+     "a44a8266ee1c8eb0c8b5d4cf5ae9f19a"},
+};
+
+const char* const xtsPlaintext512 = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f"
+                                    "303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+                                    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f"
+                                    "909192939495969798999a9b9c9d9e9fa0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+                                    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+                                    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+                                    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f"
+                                    "303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+                                    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f"
+                                    "909192939495969798999a9b9c9d9e9fa0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+                                    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+                                    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+const XTSVector xtsVectors[] = {
+    {"2", "1111111111111111111111111111111122222222222222222222222222222222", 0x3333333333,
+     "4444444444444444444444444444444444444444444444444444444444444444", "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0"},
+    {"3", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f022222222222222222222222222222222", 0x3333333333,
+     "4444444444444444444444444444444444444444444444444444444444444444", "af85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89"},
+    {"10", "2718281828459045235360287471352662497757247093699959574966967627"
+           "3141592653589793238462643383279502884197169399375105820974944592", 0xff, xtsPlaintext512,
+     "1c3b3a102f770386e4836c99e370cf9bea00803f5e482357a4ae12d414a3e63b5d31e276f8fe4a8d66b317f9ac683f44680a86ac35adfc3345befecb4bb188fd"
+     "5776926c49a3095eb108fd1098baec70aaa66999a72a82f27d848b21d4a741b0c5cd4d5fff9dac89aeba122961d03a757123e9870f8acf1000020887891429ca"
+     "2a3e7a7d7df7b10355165c8b9a6d0a7de8b062c4500dc4cd120c0f7418dae3d0b5781c34803fa75421c790dfe1de1834f280d7667b327f6c8cd7557e12ac3a0f"
+     "93ec05c52e0493ef31a12d3d9260f79a289d6a379bc70c50841473d1a8cc81ec583e9645e07b8d9670655ba5bbcfecc6dc3966380ad8fecb17b6ba02469a020a"
+     "84e18e8f84252070c13e9f1f289be54fbc481457778f616015e1327a02b140f1505eb309326d68378f8374595c849d84f4c333ec4423885143cb47bd71c5edae"
+     "9be69a2ffeceb1bec9de244fbe15992b11b77c040f12bd8f6a975a44a0f90c29a9abc3d4d893927284c58754cce294529f8614dcd2aba991925fedc4ae74ffac"
+     "6e333b93eb4aff0479da9a410e4450e0dd7ae4c6e2910900575da401fc07059f645e8b7e9bfdef33943054ff84011493c27b3429eaedb4ed5376441a77ed4385"
+     "1ad77f16f541dfd269d50d6a5f14fb0aab1cbb4c1550be97f7ab4066193c4caa773dad38014bd2092fa755c824bb5e54c4f36ffda9fcea70b9c6e693e148c151"},
+    {"15", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789a,
+     "000102030405060708090a0b0c0d0e0f10", "6c1625db4671522d3d7599601de7ca09ed"},
+    {"16", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789a,
+     "000102030405060708090a0b0c0d0e0f1011", "d069444b7a7e0cab09e24447d24deb1fedbf"},
+    {"17", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789a,
+     "000102030405060708090a0b0c0d0e0f101112", "e5df1351c0544ba1350b3363cd8ef4beedbf9d"},
+    {"18", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789a,
+     "000102030405060708090a0b0c0d0e0f10111213", "9d84c813f719aa2c7be3f66171c7c5c2edbf9dac"},
+};
+
+const DRBGVector drbgVectors[] = {
+    {"a9c12ee1f4f6e452405b0ed15ad2437d2d29fd1cceb48d728f181b6b361009af2bbca31bc74cc545dea16c90be57ec62", "", "", "", "", "",
+     "b2b1604a26ecae216617387cacee68917e54a2ce6536933013aa1fbf8a6b792046681c161ca6fdf94e512540e8d9971839ec93c9dab65b6ecd676d4ef524ce7f"},
+    {"4ab1a9ba26b8b97aa325189343d7302a550b2276a9271dc909695620ff4b93ef257156877bb77640296a92ef2ce53efd",
+     "fc1c13a8f40045749ddbc1c743af80cff54923909939d77d795a11d65ad83637781f0eb278e9ff678f7916d762940606", "", "",
+     "98c08902c89833b91f4a14655b2002c2db40acd7ca87abd1f6606cd49b551a1a653b82387abc69e9a1576ff3c5154d36",
+     "ad86dec09a2d1661cf05fce3181896bda89dd236b1d172a28e6b403acaa0c88b6f09125ff5d814defeb86593bebd4b2d",
+     "458113afd99cf6a4957daccc3ca9b11da7c00fcd2d731e3b1e8cc9aceee44d44db071630b1b2ca2803b5367fa807847847e37f4df09497632d680f0ba0acbeda"},
+    {"d88ee8fc5d1b7e2072cd752d4a43713bc5c57ccdff7bcc500c0306bcb057bcb075f8231658d93616072cf4fa286e1c99", "",
+     "1432c560383bafa9ab99871bcdcdef27befff9598e18dea426397733cd6cc2b802d427a75fc7514ddb2171ea067f3ed7", "", "", "",
+     "a6fbaf314012f783d5cefd236e93c23f70f6128191fd2537190a54583435f64d6003a538cea7d28ac3cfd0200508fe6d4f2fc5b35ea65c86972dbc443c4267b9"},
+    {"f660b4d1892b1fe605594106415e577770d451d6eda5215dcf874b6d54dcbc127bbb7a66af4c1069c1e42fe115282341",
+     "d9b6da1d5bf20ba159bdef86e24149a1297361bf75ef4f85797390ef946509f10221dc14bd60de9eedfd598871342c29",
+     "86ad89b941359d59695467aa430ede6e082ce2894e00efb673e6090607c583f5cff156793c5b8d8b7d3b4d44c4d1b78c",
+     "45be0f4aaa35a8ed8eaa7ab04741cd0ddb1e1f9f1cc3911536cb8761583b2a2a4d5403d10d45f8df13d2053c761e1bd3",
+     "d9bf0bab66ae1382fe8f0c9274fa84748023addfaf232320eb9cfc7db7c8c4b430df0b6fd87b8b962ebd18270791c4db",
+     "a0e3cf21696fc5f507bdc3327528e4b8086ea865264e3cd0e18043d4b7b71092b7f858cf4575beb98fe24692aca87403",
+     "ae0c7c96eb4ed9f8beaa9a5859b9a9faa52c379c9bc97c7befb6f73d5201c74581f363fbc797cb658cdcf16dd180cd069e9e03d86aea33d3296bcdb3f86e470f"},
+};
+
+const char* const sp800IV = "000102030405060708090a0b0c0d0e0f";
+const char* const sp800Plaintext = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                                   "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+
+const ModeVector ofbVectors[] = {
+    {"F.4.1", "2b7e151628aed2a6abf7158809cf4f3c",
+     "3b3fd92eb72dad20333449f8e83cfb4a7789508d16918f03f53c52dac54ed8259740051e9c5fecf64344f7a82260edcc304c6528f659c77866a510d9c1d6ae5e"},
+    {"F.4.3", "8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b",
+     "cdc80d6fddf18cab34c25909c99a4174fcc28b8d4c63837c09e81700c11004018d9a9aeac0f6596f559c6d4daf59a5f26d9f200857ca6c3e9cac524bd9acc92a"},
+    {"F.4.5", "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+     "dc7e84bfda79164b7ecd8486985d38604febdc6740d20b3ac88f6ad82a4fb08d71ab47a086e86eedf39d1c5bba97c4080126141d67f37be8538f5a8be740e484"},
+};
+
+const ModeVector cfbVectors[] = {
+    {"F.3.13", "2b7e151628aed2a6abf7158809cf4f3c",
+     "3b3fd92eb72dad20333449f8e83cfb4ac8a64537a0b3a93fcde3cdad9f1ce58b26751f67a3cbb140b1808cf187a4f4dfc04b05357c5d1c0eeac4c66f9ff7f2e6"},
+    {"F.3.15", "8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b",
+     "cdc80d6fddf18cab34c25909c99a417467ce7f7f81173621961a2b70171d3d7a2e1e8a1dd59b88b1c8e60fed1efac4c9c05f9f9ca9834fa042ae8fba584b09ff"},
+    {"F.3.17", "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+     "dc7e84bfda79164b7ecd8486985d386039ffed143b28b1c832113c6331e5407bdf10132415e54b92a13ed0a8267ae2f975a385741ab9cef82031623d55b1e471"},
+};
+
+class TestReport {
+    //counts checks and prints the ones that fail
+public:
+    void check(bool passed, const string& name) {
+        checks++;
+        if(!passed) {
+            failures++;
+            cout << "FAIL " << name << endl;
+        }
+    }
+
+    int finish() const {
+        cout << checks - failures << " of " << checks << " checks passed" << endl;
+        return failures == 0 ? 0 : 1;
+    }
+
+private:
+    int checks = 0;
+    int failures = 0;
+};
+
+vector<uint8_t> fromHex(const char* text) {
+    //the bytes of a hex string from the tables above, which are always well formed
+    vector<uint8_t> bytes(strlen(text) / 2);
+    size_t length = 0;
+
+    hexDecode(text, strlen(text), bytes.data(), length);
+    bytes.resize(length);
+
+    return bytes;
+}
+
+vector<uint8_t> testBytes(size_t length) {
+    //a different run of bytes for every length, from a linear congruential generator
+    vector<uint8_t> bytes(length);
+    uint32_t state = 0x9e3779b9u ^ static_cast<uint32_t>(length);
+
+    for(uint8_t& byte : bytes) {
+        state = state * 1103515245u + 12345u;
+        byte = static_cast<uint8_t>(state >> 24);
+    }
+
+    return bytes;
+}
+
+void testGCM(TestReport& report, const string& engine) {
+    for(const GCMVector& test : gcmVectors) {
+        string name = "gcm " + string(test.name) + " " + engine;
+
+        auto key = fromHex(test.key);
+        auto iv = fromHex(test.iv);
+        auto aad = fromHex(test.aad);
+        auto plaintext = fromHex(test.plaintext);
+        auto ciphertext = fromHex(test.ciphertext);
+        auto tag = fromHex(test.tag);
+
+        AESGCMContext gcm;
+        report.check(gcmSetKey(gcm, key.data(), key.size()), name + " key");
+
+        vector<uint8_t> out(plaintext.size());
+        uint8_t sealed[16];
+
+        bool encrypted = gcmEncrypt(gcm, iv.data(), iv.size(), aad.data(), aad.size(), plaintext.data(), out.data(), plaintext.size(), sealed);
+        report.check(encrypted && out == ciphertext && memcmp(sealed, tag.data(), 16) == 0, name + " encrypt");
+
+        bool opened = gcmDecrypt(gcm, iv.data(), iv.size(), aad.data(), aad.size(), out.data(), out.data(), out.size(), tag.data());
+        report.check(opened && out == plaintext, name + " decrypt in place");
+
+        //a forged tag is refused and nothing of the plaintext comes back
+        tag[15] ^= 1;
+        out = ciphertext;
+        bool forged = gcmDecrypt(gcm, iv.data(), iv.size(), aad.data(), aad.size(), ciphertext.data(), out.data(), out.size(), tag.data());
+        report.check(!forged && out == vector<uint8_t>(out.size(), 0), name + " forged tag");
+
+        report.check(!gcmEncrypt(gcm, iv.data(), 0, aad.data(), aad.size(), plaintext.data(), out.data(), plaintext.size(), sealed),
+                     name + " empty iv");
+    }
+}
+
+void testXTS(TestReport& report, const string& engine) {
+    for(const XTSVector& test : xtsVectors) {
+        string name = "xts " + string(test.name) + " " + engine;
+
+        auto key = fromHex(test.key);
+        auto plaintext = fromHex(test.plaintext);
+        auto ciphertext = fromHex(test.ciphertext);
+
+        AESXTSContext xts;
+        report.check(xtsSetKey(xts, key.data(), key.size()), name + " key");
+
+        vector<uint8_t> out(plaintext.size());
+
+        bool encrypted = xtsEncryptSector(xts, test.sector, plaintext.data(), out.data(), plaintext.size());
+        report.check(encrypted && out == ciphertext, name + " encrypt");
+
+        bool decrypted = xtsDecryptSector(xts, test.sector, out.data(), out.data(), out.size());
+        report.check(decrypted && out == plaintext, name + " decrypt in place");
+    }
+
+    //IEEE 1619 vector 1 uses two all zero keys, which SP 800-38E forbids, so it has to be refused
+    uint8_t zeroKeys[32] = {};
+    AESXTSContext xts;
+    report.check(!xtsSetKey(xts, zeroKeys, sizeof(zeroKeys)), "xts 1 " + engine + " equal key halves");
+}
+
+struct DRBGEntropy {
+    //hands out a record's entropy inputs in the order the generator asks for them
+    vector<uint8_t> inputs[2];
+    size_t next = 0;
+};
+
+bool vectorEntropy(void* context, uint8_t* out, size_t length) {
+    DRBGEntropy& entropy = *static_cast<DRBGEntropy*>(context);
+
+    if(entropy.next == 2 || entropy.inputs[entropy.next].size() != length) {
+        return false;
+    }
+
+    memcpy(out, entropy.inputs[entropy.next++].data(), length);
+    return true;
+}
+
+void testDRBG(TestReport& report, const string& engine) {
+    for(size_t i = 0; i < sizeof(drbgVectors) / sizeof(drbgVectors[0]); i++) {
+        const DRBGVector& test = drbgVectors[i];
+        string name = "ctr_drbg " + to_string(i + 1) + " " + engine;
+
+        DRBGEntropy entropy;
+        entropy.inputs[0] = fromHex(test.entropy);
+        entropy.inputs[1] = fromHex(test.entropyReseed);
+
+        auto personalization = fromHex(test.personalization);
+        auto additionalReseed = fromHex(test.additionalReseed);
+        auto additional1 = fromHex(test.additional1);
+        auto additional2 = fromHex(test.additional2);
+        auto returned = fromHex(test.returned);
+
+        AESCTRDRBG drbg(vectorEntropy, &entropy);
+        vector<uint8_t> out(returned.size());
+
+        bool ok = drbg.instantiate(personalization.data(), personalization.size());
+
+        if(ok && !entropy.inputs[1].empty()) {
+            ok = drbg.reseed(additionalReseed.data(), additionalReseed.size());
+        }
+
+        ok = ok && drbg.generate(out.data(), out.size(), additional1.data(), additional1.size());
+        ok = ok && drbg.generate(out.data(), out.size(), additional2.data(), additional2.size());
+
+        report.check(ok && out == returned, name);
+    }
+}
+
+void testOFB(TestReport& report, const string& engine) {
+    auto iv = fromHex(sp800IV);
+    auto plaintext = fromHex(sp800Plaintext);
+
+    for(const ModeVector& test : ofbVectors) {
+        string name = "ofb " + string(test.name) + " " + engine;
+
+        auto key = fromHex(test.key);
+        auto ciphertext = fromHex(test.ciphertext);
+
+        AESKeyContext ctx;
+        report.check(prepareKey(ctx, key.data(), key.size()), name + " key");
+
+        vector<uint8_t> out(plaintext.size());
+        ofbEncrypt(ctx, iv.data(), plaintext.data(), out.data(), plaintext.size());
+        report.check(out == ciphertext, name + " encrypt");
+
+        ofbDecrypt(ctx, iv.data(), out.data(), out.data(), out.size());
+        report.check(out == plaintext, name + " decrypt in place");
+
+        //a message that ends inside a block uses the front of the last keystream block
+        ofbEncrypt(ctx, iv.data(), plaintext.data(), out.data(), 60);
+        report.check(equal(out.begin(), out.begin() + 60, ciphertext.begin()), name + " short");
+    }
+
+    //a stream with a ring of three blocks, fed pieces that start and end inside blocks and wrap the ring,
+    //with some of the keystream made ahead on this thread or in the background and the rest made on the spot
+    auto key = fromHex(ofbVectors[0].key);
+    AESKeyContext ctx;
+    prepareKey(ctx, key.data(), key.size());
+
+    auto message = testBytes(1000);
+    vector<uint8_t> expected(message.size());
+    ofbEncrypt(ctx, iv.data(), message.data(), expected.data(), message.size());
+
+    AESOFBStream stream(ctx, iv.data(), 48);
+    report.check(stream.capacity() == 48, "ofb stream " + engine + " capacity");
+
+    const size_t pieces[] = {1, 5, 17, 31, 47, 48, 49, 3, 100, 13};
+    vector<uint8_t> buffer = message;
+    size_t offset = 0;
+
+    for(size_t call = 0; offset < buffer.size(); call++) {
+        size_t length = pieces[call % 10] < buffer.size() - offset ? pieces[call % 10] : buffer.size() - offset;
+
+        if(call % 3 == 0) {
+            stream.precompute(20);
+        }
+        else if(call % 3 == 1) {
+            stream.precomputeInBackground();
+        }
+
+        stream.crypt(buffer.data() + offset, buffer.data() + offset, length);
+        offset += length;
+    }
+
+    report.check(buffer == expected, "ofb stream " + engine + " matches ofbEncrypt");
+}
+
+void testCFB(TestReport& report, const string& engine) {
+    auto iv = fromHex(sp800IV);
+    auto plaintext = fromHex(sp800Plaintext);
+
+    for(const ModeVector& test : cfbVectors) {
+        string name = "cfb " + string(test.name) + " " + engine;
+
+        auto key = fromHex(test.key);
+        auto ciphertext = fromHex(test.ciphertext);
+
+        AESKeyContext ctx;
+        report.check(prepareKey(ctx, key.data(), key.size()), name + " key");
+
+        vector<uint8_t> out(plaintext.size());
+        cfbEncrypt(ctx, iv.data(), plaintext.data(), out.data(), plaintext.size());
+        report.check(out == ciphertext, name + " encrypt");
+
+        cfbDecrypt(ctx, iv.data(), out.data(), out.data(), out.size());
+        report.check(out == plaintext, name + " decrypt in place");
+
+        cfbEncrypt(ctx, iv.data(), plaintext.data(), out.data(), 60);
+        report.check(equal(out.begin(), out.begin() + 60, ciphertext.begin()), name + " short");
+    }
+
+    //buffers over cfbChunkBytes are split across the pool, and every chunk but the first chains off the
+    //last ciphertext block of the one before it. One length ends on a chunk boundary and one in the middle of a block
+    auto key = fromHex(cfbVectors[0].key);
+    AESKeyContext ctx;
+    prepareKey(ctx, key.data(), key.size());
+
+    AESThreadPool pool(4);
+    const size_t lengths[] = {2 * cfbChunkBytes, 3 * cfbChunkBytes + 100};
+
+    for(size_t length : lengths) {
+        string name = "cfb " + to_string(length) + " " + engine;
+
+        auto message = testBytes(length);
+        vector<uint8_t> ciphertext(length);
+        cfbEncrypt(ctx, iv.data(), message.data(), ciphertext.data(), length);
+
+        vector<uint8_t> out(length);
+        cfbDecrypt(ctx, iv.data(), ciphertext.data(), out.data(), length, nullptr);
+        report.check(out == message, name + " serial");
+
+        cfbDecrypt(ctx, iv.data(), ciphertext.data(), out.data(), length, &pool);
+        report.check(out == message, name + " pooled");
+
+        cfbDecrypt(ctx, iv.data(), ciphertext.data(), ciphertext.data(), length, &pool);
+        report.check(ciphertext == message, name + " pooled in place");
+    }
+}
+
+using BulkEncoder = size_t (*)(const uint8_t* in, size_t length, char* out);
+using BulkDecoder = size_t (*)(const char* in, size_t textLength, uint8_t* out);
+
+struct EncodingVariant {
+    //one set of bulk encoders and decoders from AESEncoding.h, which leave the rest to the scalar code
+    string name;
+    BulkEncoder hexEncode;
+    BulkDecoder hexDecode;
+    BulkEncoder base64Encode;
+    BulkDecoder base64Decode;
+};
+
+vector<EncodingVariant> encodingVariants() {
+    //the scalar code on its own, then every vector version this CPU can run
+    BulkEncoder noEncoder = [](const uint8_t*, size_t, char*) -> size_t { return 0; };
+    BulkDecoder noDecoder = [](const char*, size_t, uint8_t*) -> size_t { return 0; };
+
+    vector<EncodingVariant> variants = {{"scalar", noEncoder, noDecoder, noEncoder, noDecoder}};
+
+#if AES_HAVE_AESNI
+    if(cpuFeatures().ssse3) {
+        variants.push_back({"ssse3", hexEncodeSSSE3, hexDecodeSSSE3, base64EncodeSSSE3, base64DecodeSSSE3});
+    }
+    if(cpuFeatures().avx2) {
+        variants.push_back({"avx2", hexEncodeAVX2, hexDecodeAVX2, base64EncodeAVX2, base64DecodeAVX2});
+    }
+#endif
+
+    return variants;
+}
+
+string hexEncodeWith(const EncodingVariant& variant, const vector<uint8_t>& data) {
+    string text(hexEncodedLength(data.size()), '\0');
+
+    size_t done = variant.hexEncode(data.data(), data.size(), &text[0]);
+    hexEncodeScalar(data.data() + done, data.size() - done, &text[2 * done]);
+
+    return text;
+}
+
+bool hexDecodeWith(const EncodingVariant& variant, const char* in, size_t textLength, uint8_t* out) {
+    size_t done = variant.hexDecode(in, textLength, out);
+    return hexDecodeScalar(in + done, textLength - done, out + done / 2);
+}
+
+string base64EncodeWith(const EncodingVariant& variant, const vector<uint8_t>& data) {
+    string text(base64EncodedLength(data.size()), '\0');
+
+    size_t done = variant.base64Encode(data.data(), data.size(), &text[0]);
+    base64EncodeScalar(data.data() + done, data.size() - done, &text[done / 3 * 4]);
+
+    return text;
+}
+
+bool base64DecodeWith(const EncodingVariant& variant, const char* in, size_t textLength, uint8_t* out, size_t& outLength) {
+    size_t done = variant.base64Decode(in, textLength, out);
+
+    size_t tailLength = 0;
+    bool ok = base64DecodeScalar(in + done, textLength - done, out + done / 4 * 3, tailLength);
+
+    outLength = done / 4 * 3 + tailLength;
+    return ok;
+}
+
+bool inAlphabet(const char* alphabet, unsigned character) {
+    return character != 0 && strchr(alphabet, static_cast<int>(character)) != nullptr;
+}
+
+void testEncodingRoundTrips(TestReport& report, const EncodingVariant& variant) {
+    for(size_t length = 0; length <= 300; length++) {
+        string name = variant.name + " " + to_string(length);
+
+        auto data = testBytes(length);
+
+        string hex = hexEncodeWith(variant, data);
+        string scalarHex(hexEncodedLength(length), '\0');
+        hexEncodeScalar(data.data(), length, &scalarHex[0]);
+        report.check(hex == scalarHex, "hex encode " + name);
+
+        vector<uint8_t> out(length);
+        bool decoded = hexDecodeWith(variant, hex.data(), hex.size(), out.data());
+        report.check(decoded && out == data, "hex decode " + name);
+
+        //upper case digits decode the same
+        string upper = hex;
+        for(char& digit : upper) {
+            digit = static_cast<char>(toupper(static_cast<unsigned char>(digit)));
+        }
+        decoded = hexDecodeWith(variant, upper.data(), upper.size(), out.data());
+        report.check(decoded && out == data, "hex decode upper case " + name);
+
+        vector<uint8_t> buffer(hex.begin(), hex.end());
+        decoded = hexDecodeWith(variant, reinterpret_cast<const char*>(buffer.data()), buffer.size(), buffer.data());
+        report.check(decoded && equal(data.begin(), data.end(), buffer.begin()), "hex decode in place " + name);
+
+        string base64 = base64EncodeWith(variant, data);
+        string scalarBase64(base64EncodedLength(length), '\0');
+        base64EncodeScalar(data.data(), length, &scalarBase64[0]);
+        report.check(base64 == scalarBase64, "base64 encode " + name);
+
+        out.assign(base64DecodedMaxLength(base64.size()), 0);
+        size_t outLength = 0;
+        decoded = base64DecodeWith(variant, base64.data(), base64.size(), out.data(), outLength);
+        report.check(decoded && outLength == length && equal(data.begin(), data.end(), out.begin()), "base64 decode " + name);
+
+        buffer.assign(base64.begin(), base64.end());
+        decoded = base64DecodeWith(variant, reinterpret_cast<const char*>(buffer.data()), buffer.size(), buffer.data(), outLength);
+        report.check(decoded && outLength == length && equal(data.begin(), data.end(), buffer.begin()), "base64 decode in place " + name);
+    }
+}
+
+void testEncodingRejects(TestReport& report, const EncodingVariant& variant) {
+    //one bad character at a time, at the start, inside a vector step, in the scalar tail, and at the end
+    auto data = testBytes(150);
+    string hex = hexEncodeWith(variant, data);
+    string base64 = base64EncodeWith(variant, data);//150 bytes leave no padding
+
+    vector<uint8_t> out(base64DecodedMaxLength(hex.size()));
+    size_t outLength = 0;
+
+    const size_t hexPositions[] = {0, 45, 290, hex.size() - 1};
+    const size_t base64Positions[] = {0, 45, 190, base64.size() - 1};
+
+    for(unsigned character = 0; character < 256; character++) {
+        if(!inAlphabet("0123456789abcdefABCDEF", character)) {
+            for(size_t position : hexPositions) {
+                string text = hex;
+                text[position] = static_cast<char>(character);
+                report.check(!hexDecodeWith(variant, text.data(), text.size(), out.data()),
+                             "hex rejects " + to_string(character) + " at " + to_string(position) + " " + variant.name);
+            }
+        }
+
+        if(!inAlphabet(base64Alphabet, character) && character != '=') {
+            for(size_t position : base64Positions) {
+                string text = base64;
+                text[position] = static_cast<char>(character);
+                report.check(!base64DecodeWith(variant, text.data(), text.size(), out.data(), outLength),
+                             "base64 rejects " + to_string(character) + " at " + to_string(position) + " " + variant.name);
+            }
+        }
+    }
+
+    //= is only allowed as the last one or two characters
+    const size_t paddingPositions[] = {0, 1, 2, 3, 45, 190, base64.size() - 4, base64.size() - 3, base64.size() - 2};
+
+    for(size_t position : paddingPositions) {
+        string text = base64;
+        text[position] = '=';
+        report.check(!base64DecodeWith(variant, text.data(), text.size(), out.data(), outLength),
+                     "base64 rejects = at " + to_string(position) + " " + variant.name);
+    }
+
+    string text = base64;
+    text.replace(text.size() - 4, 4, "A===");
+    report.check(!base64DecodeWith(variant, text.data(), text.size(), out.data(), outLength), "base64 rejects A=== " + variant.name);
+}
+
+void testEncoding(TestReport& report) {
+    for(const EncodingVariant& variant : encodingVariants()) {
+        testEncodingRoundTrips(report, variant);
+        testEncodingRejects(report, variant);
+    }
+
+    //the public decoders refuse text whose length cannot be whole bytes
+    uint8_t out[8];
+    size_t outLength = 0;
+    report.check(!hexDecode("abc", 3, out, outLength), "hex rejects an odd length");
+    report.check(!base64Decode("QUJDRA=", 7, out, outLength), "base64 rejects a length that is not a multiple of 4");
+}
+
+int main() {
+    TestReport report;
+
+    for(const AESEngine* engine : allEngines) {
+        if(!useEngine(*engine)) {
+            continue;
+        }
+
+        testGCM(report, engine->name);
+        testXTS(report, engine->name);
+        testOFB(report, engine->name);
+        testCFB(report, engine->name);
+        testDRBG(report, engine->name);
+    }
+
+    testEncoding(report);
+
+    return report.finish();
+}
@@ -0,0 +1,251 @@
+// AESThreadPool.h
+// Small fixed size thread pool for splitting large buffers across cores
+//
+// - parallelFor hands out task indices to the workers and the calling thread, and returns once every task is done
+// - Jobs are passed as a function pointer and a context pointer, so handing out work never allocates
+// - A parallelFor called from inside a worker runs inline, so nested use cannot deadlock the pool
+//
+// Most callers use defaultThreadPool(), which has one thread per core and is created on first use.
+// AESBackgroundQueue is the other way round: one thread that works through jobs posted for later, so work that can be
+// done ahead of time happens while the caller is waiting on something else
+
+#ifndef AES_THREAD_POOL_H
+#define AES_THREAD_POOL_H
+
+#include <cstddef> //size_t
+#include <atomic> //task counters shared between workers
+#include <condition_variable> //waking workers and the caller
+#include <deque> //jobs waiting for the background thread
+#include <mutex> //protects the current job
+#include <thread> //worker threads
+#include <type_traits> //remove_reference for the job trampoline
+#include <vector> //holds the worker threads
+
+class AESThreadPool {
+public:
+    explicit AESThreadPool(unsigned threads) {
+        //starts threads - 1 workers, the thread calling parallelFor is always the last one
+        for(unsigned i = 1; i < threads; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~AESThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+
+        for(auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    AESThreadPool(const AESThreadPool&) = delete;
+    AESThreadPool& operator=(const AESThreadPool&) = delete;
+
+    unsigned size() const {
+        //how many threads work on a job, including the caller
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    template<class Fn>
+    void parallelFor(size_t count, Fn&& fn) {
+        //calls fn(i) for every i in [0, count) across the pool and waits for all of them
+        using Function = std::remove_reference_t<Fn>;
+        run(count, [](void* context, size_t index) { (*static_cast<Function*>(context))(index); }, const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+
+private:
+    using TaskFunction = void (*)(void* context, size_t index);
+
+    static bool& insideWorker() {
+        //set on pool threads, so nested jobs run inline
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    void run(size_t count, TaskFunction call, void* context) {
+        if(count == 0) {
+            return;
+        }
+
+        if(workers.empty() || count == 1 || insideWorker()) {
+            for(size_t i = 0; i < count; i++) {
+                call(context, i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> jobLock(jobMutex);//one job at a time, other callers queue here
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            jobCall = call;
+            jobContext = context;
+            jobCount = count;
+            nextTask.store(0, std::memory_order_relaxed);
+            busyWorkers = static_cast<unsigned>(workers.size());
+            generation++;
+        }
+        wakeWorkers.notify_all();
+
+        insideWorker() = true;
+        runTasks(call, context, count);
+        insideWorker() = false;
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        jobDone.wait(lock, [this] { return busyWorkers == 0; });
+    }
+
+    void runTasks(TaskFunction call, void* context, size_t count) {
+        //takes task indices until there are none left
+        for(size_t i = nextTask.fetch_add(1, std::memory_order_relaxed); i < count; i = nextTask.fetch_add(1, std::memory_order_relaxed)) {
+            call(context, i);
+        }
+    }
+
+    void workerLoop() {
+        insideWorker() = true;
+
+        unsigned long long seen = 0;
+
+        while(true) {
+            TaskFunction call;
+            void* context;
+            size_t count;
+
+            {
+                std::unique_lock<std::mutex> lock(stateMutex);
+                wakeWorkers.wait(lock, [&] { return stopping || generation != seen; });
+
+                if(stopping) {
+                    return;
+                }
+
+                seen = generation;
+                call = jobCall;
+                context = jobContext;
+                count = jobCount;
+            }
+
+            runTasks(call, context, count);
+
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                busyWorkers--;
+            }
+            jobDone.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    std::mutex jobMutex;
+    std::mutex stateMutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable jobDone;
+
+    TaskFunction jobCall = nullptr;
+    void* jobContext = nullptr;
+    size_t jobCount = 0;
+    std::atomic<size_t> nextTask{0};
+    unsigned busyWorkers = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+};
+
+inline AESThreadPool& defaultThreadPool() {
+    //shared pool with one thread per core
+    static AESThreadPool pool(std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1);
+    return pool;
+}
+
+class AESBackgroundQueue {
+    //a single thread that runs posted jobs one after another, in the order they were posted
+public:
+    using Job = void (*)(void* context);
+
+    AESBackgroundQueue() : worker([this] { workerLoop(); }) {}
+
+    ~AESBackgroundQueue() {
+        //jobs still queued are dropped, a running one is finished first
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        worker.join();
+    }
+
+    AESBackgroundQueue(const AESBackgroundQueue&) = delete;
+    AESBackgroundQueue& operator=(const AESBackgroundQueue&) = delete;
+
+    void post(Job job, void* context) {
+        //queues job(context) and returns straight away
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.push_back({job, context});
+        }
+        wake.notify_one();
+    }
+
+    void cancel(void* context) {
+        //drops the jobs queued for context and waits for one already running on it, so context can then be freed
+        //must not be called from a job, it would wait for itself
+        std::unique_lock<std::mutex> lock(queueMutex);
+
+        for(auto it = jobs.begin(); it != jobs.end(); ) {
+            it = it->context == context ? jobs.erase(it) : it + 1;
+        }
+
+        finished.wait(lock, [&] { return running != context; });
+    }
+
+private:
+    struct Entry {
+        Job job;
+        void* context;
+    };
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+
+        while(true) {
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            if(stopping) {
+                return;
+            }
+
+            Entry entry = jobs.front();
+            jobs.pop_front();
+            running = entry.context;
+
+            lock.unlock();
+            entry.job(entry.context);
+            lock.lock();
+
+            running = nullptr;
+            finished.notify_all();
+        }
+    }
+
+    std::mutex queueMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::deque<Entry> jobs;
+    void* running = nullptr;//context of the job in progress
+    bool stopping = false;
+    std::thread worker;//last, so everything it uses exists before it starts
+};
+
+inline AESBackgroundQueue& defaultBackgroundQueue() {
+    //shared background thread, started the first time something is posted to it
+    static AESBackgroundQueue queue;
+    return queue;
+}
+
+#endif
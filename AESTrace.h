@@ -0,0 +1,77 @@
+// AESTrace.h
+// Debug tracing that is compiled out unless it is asked for
+//
+// - Build with -DAES_TRACE=1 to turn it on. Trace lines go to stderr with the file and line they came from
+// - With AES_TRACE off (the default) every macro expands to ((void)0), so its arguments are never evaluated
+//   and the hot paths compile to exactly what they would without the trace points
+// - AES_TRACE_MESSAGE takes a printf format, AES_TRACE_BYTES prints a buffer in hex,
+//   and AES_TRACE_STATE prints a 16 byte state as the 4x4 matrix FIPS-197 draws, followed by a printf style label
+//
+// Traces print intermediate cipher states, which reveal the key. Never ship a build with AES_TRACE on
+
+#ifndef AES_TRACE_H
+#define AES_TRACE_H
+
+#ifndef AES_TRACE
+#define AES_TRACE 0
+#endif
+
+#if AES_TRACE
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstdarg> //the printf style labels
+#include <cstdio> //fprintf to stderr
+
+inline void traceMessage(const char* file, int line, const char* format, ...) {
+    //one line of text
+    fprintf(stderr, "[trace %s:%d] ", file, line);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    fputc('\n', stderr);
+}
+
+inline void traceBytes(const char* file, int line, const char* label, const uint8_t* data, size_t length) {
+    //a label and the buffer in hex on one line
+    fprintf(stderr, "[trace %s:%d] %s:", file, line, label);
+
+    for(size_t i = 0; i < length; i++) {
+        fprintf(stderr, " %02x", data[i]);
+    }
+
+    fputc('\n', stderr);
+}
+
+inline void traceState(const char* file, int line, const uint8_t bytes[16], const char* format, ...) {
+    //the label, then the state one row per line. The bytes are column major, so row r is bytes r, r + 4, r + 8, r + 12
+    fprintf(stderr, "[trace %s:%d] ", file, line);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    fputc('\n', stderr);
+
+    for(int row = 0; row < 4; row++) {
+        fprintf(stderr, "    %02x %02x %02x %02x\n", bytes[row], bytes[row + 4], bytes[row + 8], bytes[row + 12]);
+    }
+}
+
+#define AES_TRACE_MESSAGE(...) traceMessage(__FILE__, __LINE__, __VA_ARGS__)
+#define AES_TRACE_BYTES(label, data, length) traceBytes(__FILE__, __LINE__, (label), (data), (length))
+#define AES_TRACE_STATE(bytes, ...) traceState(__FILE__, __LINE__, (bytes), __VA_ARGS__)
+
+#else
+
+#define AES_TRACE_MESSAGE(...) ((void)0)
+#define AES_TRACE_BYTES(label, data, length) ((void)0)
+#define AES_TRACE_STATE(bytes, ...) ((void)0)
+
+#endif
+
+#endif
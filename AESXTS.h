@@ -0,0 +1,363 @@
+// AESXTS.h
+// AES in XTS mode, for encrypting fixed size storage sectors at rest
+//
+// - Two independent keys: the tweak key encrypts the sector number into the sector's first tweak, and the data key
+//   encrypts each block XOR'ed with its tweak before and after, as in IEEE 1619 and NIST SP 800-38E
+// - Each block's tweak is the one before it times x in GF(2^128), so a whole sector is known up front and its blocks
+//   go through the engine together. With AES-NI the tweaks never leave registers
+// - Every sector stands alone, any one can be read or rewritten without touching its neighbours
+// - A sector whose length is not a multiple of 16 uses ciphertext stealing, so the ciphertext is exactly as long as the plaintext
+// - The sector calls handle one sector at a time, the batch calls take a run of equal sized sectors with consecutive numbers,
+//   spread them across the thread pool, and encrypt their first tweaks together
+//
+// Sector numbers are 64 bit little endian in the first 8 bytes of the tweak block, the layout dm-crypt calls plain64
+
+#ifndef AES_XTS_H
+#define AES_XTS_H
+
+#include <cstdint> //fixed width integer types
+#include <cstddef> //size_t
+#include <cstring> //memcpy and memcmp
+
+#include "AESCore.h" //AESKeyContext and xorBytes
+#include "AESEngine.h" //the active engine
+#include "AESThreadPool.h" //splits large batches across cores
+#include "AESNI.h" //AES_HAVE_AESNI and the target attribute for the fused loop
+
+inline constexpr size_t xtsBatchBlocks = 64;//blocks handed to the engine per call, whole groups for the 8 and 16 block engines
+inline constexpr size_t xtsChunkBytes = 256 * 1024;//bytes of sectors per thread pool task, rounded to whole sectors
+
+struct AESXTSContext {
+    //the data and tweak keys, filled in once by xtsSetKey and then only read
+    AESKeyContext dataKey;
+    AESKeyContext tweakKey;
+};
+
+inline uint64_t loadLittleEndian64(const uint8_t* p) {
+    //reads 8 bytes as a little endian number
+    uint64_t value;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&value, p, 8);
+#else
+    value = 0;
+    for(int i = 7; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+#endif
+    return value;
+}
+
+inline void storeLittleEndian64(uint8_t* p, uint64_t value) {
+    //writes a number out as 8 little endian bytes
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(p, &value, 8);
+#else
+    for(int i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+#endif
+}
+
+inline bool xtsSetKey(AESXTSContext& xts, const uint8_t* key, size_t keyLength) {
+    //splits key into the data key (first half) and the tweak key (second half) and expands both
+    //returns false if the halves are not 16, 24, or 32 bytes, or are equal, which SP 800-38E forbids
+    size_t half = keyLength / 2;
+
+    if(keyLength % 2 != 0 || memcmp(key, key + half, half) == 0) {
+        return false;
+    }
+
+    return prepareKey(xts.dataKey, key, half) && prepareKey(xts.tweakKey, key + half, half);
+}
+
+inline void xtsSectorTweak(uint64_t sector, uint8_t tweak[16]) {
+    //the plaintext tweak block for a sector number, before it is encrypted with the tweak key
+    storeLittleEndian64(tweak, sector);
+    memset(tweak + 8, 0, 8);
+}
+
+inline void xtsNextTweak(uint64_t& low, uint64_t& high) {
+    //multiplies a tweak by x, a one bit left shift of the 128 bit little endian value with x^128 = x^7 + x^2 + x + 1
+    uint64_t carry = high >> 63;
+    high = (high << 1) | (low >> 63);
+    low = (low << 1) ^ (0x87 & (0 - carry));
+}
+
+#if AES_HAVE_AESNI
+
+AES_TARGET_AESNI inline __m128i xtsNextTweakHardware(__m128i tweak) {
+    //xtsNextTweak in a register: both 64 bit halves shift left, the top bit of the low half carries into the high half
+    //and the top bit of the high half folds back in as 0x87
+    __m128i signs = _mm_srai_epi32(tweak, 31);
+    __m128i carries = _mm_and_si128(_mm_shuffle_epi32(signs, 0x13), _mm_set_epi32(0, 1, 0, 0x87));
+    return _mm_xor_si128(_mm_add_epi64(tweak, tweak), carries);
+}
+
+template<bool Decrypt>
+AES_TARGET_AESNI inline __m128i xtsRoundHardware(__m128i b, __m128i roundKey) {
+    return Decrypt ? _mm_aesdec_si128(b, roundKey) : _mm_aesenc_si128(b, roundKey);
+}
+
+template<bool Decrypt>
+AES_TARGET_AESNI inline __m128i xtsLastRoundHardware(__m128i b, __m128i roundKey) {
+    return Decrypt ? _mm_aesdeclast_si128(b, roundKey) : _mm_aesenclast_si128(b, roundKey);
+}
+
+template<int Nr, bool Decrypt>
+AES_TARGET_AESNI inline void xtsBlocksHardwareRounds(const AESKeyContext& key, uint64_t& tweakLow, uint64_t& tweakHigh, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //xtsCryptBlocks with the tweaks built in registers and XOR'ed in on the way in and out of the rounds,
+    //eight blocks at a time like the other AES-NI loops
+    __m128i rk[Nr + 1];
+
+#pragma GCC unroll 16
+    for(int round = 0; round <= Nr; round++) {
+        rk[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(Decrypt ? key.decryptRoundKey(round) : key.roundKey(round)));
+    }
+
+    __m128i tweak = _mm_set_epi64x(static_cast<long long>(tweakHigh), static_cast<long long>(tweakLow));
+
+    size_t i = 0;
+
+    for(; i + 8 <= blocks; i += 8) {
+        __m128i t[8];
+        __m128i b[8];
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            t[j] = tweak;
+            tweak = xtsNextTweakHardware(tweak);
+
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j)));
+            b[j] = _mm_xor_si128(_mm_xor_si128(data, t[j]), rk[0]);
+        }
+
+#pragma GCC unroll 16
+        for(int r = 1; r < Nr; r++) {
+#pragma GCC unroll 8
+            for(int j = 0; j < 8; j++) {
+                b[j] = xtsRoundHardware<Decrypt>(b[j], rk[r]);
+            }
+        }
+
+#pragma GCC unroll 8
+        for(int j = 0; j < 8; j++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_xor_si128(xtsLastRoundHardware<Decrypt>(b[j], rk[Nr]), t[j]));
+        }
+    }
+
+    for(; i < blocks; i++) {
+        __m128i b = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)), tweak), rk[0]);
+
+#pragma GCC unroll 16
+        for(int r = 1; r < Nr; r++) {
+            b = xtsRoundHardware<Decrypt>(b, rk[r]);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_xor_si128(xtsLastRoundHardware<Decrypt>(b, rk[Nr]), tweak));
+        tweak = xtsNextTweakHardware(tweak);
+    }
+
+    alignas(16) uint64_t halves[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(halves), tweak);
+    tweakLow = halves[0];
+    tweakHigh = halves[1];
+}
+
+template<bool Decrypt>
+inline void xtsBlocksHardware(const AESKeyContext& key, uint64_t& tweakLow, uint64_t& tweakHigh, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //picks the instantiation for the key size
+    switch(key.rounds) {
+        case 10:
+            xtsBlocksHardwareRounds<10, Decrypt>(key, tweakLow, tweakHigh, in, out, blocks);
+            break;
+        case 12:
+            xtsBlocksHardwareRounds<12, Decrypt>(key, tweakLow, tweakHigh, in, out, blocks);
+            break;
+        case 14:
+            xtsBlocksHardwareRounds<14, Decrypt>(key, tweakLow, tweakHigh, in, out, blocks);
+            break;
+    }
+}
+
+#endif
+
+inline void xtsCryptBlocks(const AESKeyContext& key, bool decrypt, uint64_t& tweakLow, uint64_t& tweakHigh, const uint8_t* in, uint8_t* out, size_t blocks) {
+    //runs whole blocks through the cipher between two tweak XORs, starting from the given tweak and leaving it on the next one
+    //in and out may be the same buffer
+#if AES_HAVE_AESNI
+    if(&activeEngine() == &hardwareEngine) {
+        if(decrypt) {
+            xtsBlocksHardware<true>(key, tweakLow, tweakHigh, in, out, blocks);
+        }
+        else {
+            xtsBlocksHardware<false>(key, tweakLow, tweakHigh, in, out, blocks);
+        }
+        return;
+    }
+#endif
+
+    //other engines get the tweaks laid out next to the data, xtsBatchBlocks at a time
+    BlockFunction cipher = decrypt ? activeDecryptBlockFunction(key) : activeBlockFunction(key);
+
+    alignas(16) uint8_t tweaks[xtsBatchBlocks * 16];
+    alignas(16) uint8_t buffer[xtsBatchBlocks * 16];
+
+    while(blocks > 0) {
+        size_t batch = blocks < xtsBatchBlocks ? blocks : xtsBatchBlocks;
+
+        for(size_t i = 0; i < batch; i++) {
+            storeLittleEndian64(tweaks + 16 * i, tweakLow);
+            storeLittleEndian64(tweaks + 16 * i + 8, tweakHigh);
+            xtsNextTweak(tweakLow, tweakHigh);
+        }
+
+        xorBytes(buffer, in, tweaks, 16 * batch);
+        cipher(key, buffer, buffer, batch);
+        xorBytes(out, buffer, tweaks, 16 * batch);
+
+        in += 16 * batch;
+        out += 16 * batch;
+        blocks -= batch;
+    }
+}
+
+inline void xtsCryptWithTweak(const AESXTSContext& xts, const uint8_t tweak[16], const uint8_t* in, uint8_t* out, size_t length, bool decrypt) {
+    //encrypts or decrypts one sector given its already encrypted first tweak, length is at least 16
+    //in and out may be the same buffer
+    uint64_t tweakLow = loadLittleEndian64(tweak);
+    uint64_t tweakHigh = loadLittleEndian64(tweak + 8);
+
+    size_t tail = length % 16;
+    size_t whole = length / 16 - (tail != 0);//with a partial block at the end, the last whole block is left for the stealing
+
+    xtsCryptBlocks(xts.dataKey, decrypt, tweakLow, tweakHigh, in, out, whole);
+
+    if(tail == 0) {
+        return;
+    }
+
+    //ciphertext stealing: the last whole block is processed, its first tail bytes become the partial block,
+    //and the rest of it fills out the partial block to make the new last whole block.
+    //Decryption has to take the two tweaks in the opposite order, so the second one is worked out first there
+    in += 16 * whole;
+    out += 16 * whole;
+
+    uint64_t secondLow = tweakLow;
+    uint64_t secondHigh = tweakHigh;
+    xtsNextTweak(secondLow, secondHigh);
+
+    uint64_t firstLow = decrypt ? secondLow : tweakLow;
+    uint64_t firstHigh = decrypt ? secondHigh : tweakHigh;
+    uint64_t lastLow = decrypt ? tweakLow : secondLow;
+    uint64_t lastHigh = decrypt ? tweakHigh : secondHigh;
+
+    uint8_t stolen[16];
+    uint8_t partial[16];
+
+    xtsCryptBlocks(xts.dataKey, decrypt, firstLow, firstHigh, in, stolen, 1);
+
+    memcpy(partial, in + 16, tail);//read before an in place call overwrites it
+    memcpy(partial + tail, stolen + tail, 16 - tail);
+    memcpy(out + 16, stolen, tail);
+
+    xtsCryptBlocks(xts.dataKey, decrypt, lastLow, lastHigh, partial, out, 1);
+}
+
+inline bool xtsEncryptSector(const AESXTSContext& xts, uint64_t sector, const uint8_t* in, uint8_t* out, size_t length) {
+    //encrypts one sector of length bytes, in and out may be the same buffer
+    //returns false if the sector is shorter than one block, which XTS cannot encrypt
+    if(length < 16) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::XTSEncrypt, length);
+
+    uint8_t tweak[16];
+    xtsSectorTweak(sector, tweak);
+    encryptBlocks(xts.tweakKey, tweak, tweak, 1);
+
+    xtsCryptWithTweak(xts, tweak, in, out, length, false);
+    return true;
+}
+
+inline bool xtsDecryptSector(const AESXTSContext& xts, uint64_t sector, const uint8_t* in, uint8_t* out, size_t length) {
+    //decrypts one sector written by xtsEncryptSector, in and out may be the same buffer
+    //returns false if the sector is shorter than one block
+    if(length < 16) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, AESMetricsMode::XTSDecrypt, length);
+
+    uint8_t tweak[16];
+    xtsSectorTweak(sector, tweak);
+    encryptBlocks(xts.tweakKey, tweak, tweak, 1);//the tweak is always encrypted, even when decrypting
+
+    xtsCryptWithTweak(xts, tweak, in, out, length, true);
+    return true;
+}
+
+inline void xtsCryptSectorRange(const AESXTSContext& xts, uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorBytes, size_t sectors, bool decrypt) {
+    //encrypts or decrypts a run of consecutive sectors on the calling thread
+    //the first tweaks of up to xtsBatchBlocks sectors go through the engine in one call
+    BlockFunction encrypt = activeBlockFunction(xts.tweakKey);
+
+    alignas(16) uint8_t tweaks[xtsBatchBlocks * 16];
+
+    for(size_t i = 0; i < sectors; i += xtsBatchBlocks) {
+        size_t batch = sectors - i < xtsBatchBlocks ? sectors - i : xtsBatchBlocks;
+
+        for(size_t j = 0; j < batch; j++) {
+            xtsSectorTweak(firstSector + i + j, tweaks + 16 * j);
+        }
+
+        encrypt(xts.tweakKey, tweaks, tweaks, batch);
+
+        for(size_t j = 0; j < batch; j++) {
+            size_t offset = (i + j) * sectorBytes;
+            xtsCryptWithTweak(xts, tweaks + 16 * j, in + offset, out + offset, sectorBytes, decrypt);
+        }
+    }
+}
+
+inline bool xtsCryptSectors(const AESXTSContext& xts, uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorBytes, size_t sectors, bool decrypt, AESThreadPool* pool) {
+    //splits a run of sectors into tasks of about xtsChunkBytes each and spreads them over pool
+    if(sectorBytes < 16) {
+        return false;
+    }
+
+    AESMetricsScope metrics(activeEngine().name, decrypt ? AESMetricsMode::XTSDecrypt : AESMetricsMode::XTSEncrypt, static_cast<uint64_t>(sectorBytes) * sectors);
+
+    size_t chunkSectors = xtsChunkBytes / sectorBytes > 0 ? xtsChunkBytes / sectorBytes : 1;
+
+    if(pool == nullptr || pool->size() == 1 || sectors <= chunkSectors) {
+        xtsCryptSectorRange(xts, firstSector, in, out, sectorBytes, sectors, decrypt);
+        return true;
+    }
+
+    size_t chunks = (sectors + chunkSectors - 1) / chunkSectors;
+
+    pool->parallelFor(chunks, [&](size_t chunk) {
+        size_t first = chunk * chunkSectors;
+        size_t count = sectors - first < chunkSectors ? sectors - first : chunkSectors;
+
+        xtsCryptSectorRange(xts, firstSector + first, in + first * sectorBytes, out + first * sectorBytes, sectorBytes, count, decrypt);
+    });
+
+    return true;
+}
+
+inline bool xtsEncryptSectors(const AESXTSContext& xts, uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorBytes, size_t sectors, AESThreadPool* pool = &defaultThreadPool()) {
+    //encrypts sectors back to back sectors of sectorBytes each, numbered from firstSector. in and out may be the same buffer
+    //large batches are spread over pool, pass nullptr to stay on the calling thread
+    //returns false if sectorBytes is shorter than one block
+    return xtsCryptSectors(xts, firstSector, in, out, sectorBytes, sectors, false, pool);
+}
+
+inline bool xtsDecryptSectors(const AESXTSContext& xts, uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorBytes, size_t sectors, AESThreadPool* pool = &defaultThreadPool()) {
+    //decrypts sectors written by xtsEncryptSectors or xtsEncryptSector
+    return xtsCryptSectors(xts, firstSector, in, out, sectorBytes, sectors, true, pool);
+}
+
+#endif